@@ -1,7 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h> 
+#include <stdint.h>
+#include <time.h>
 
 // --- Constantes ---
 #define MAX_STRING 50
@@ -20,6 +21,34 @@ typedef struct {
     int tropas;
 } Territorio;
 
+/**
+ * @brief Resultado de uma rodada de batalha, preenchido pelo motor sem E/S.
+ * @note dado_ataque == 0 indica que o pedido era invalido e nao foi resolvido.
+ */
+typedef struct {
+    int dado_ataque;
+    int dado_defesa;
+    int perdas_atacante;
+    int perdas_defensor;
+    int conquista; // 1 se o defensor foi conquistado nesta rodada
+} ResultadoBatalha;
+
+/**
+ * @brief Par atacante/defensor (indices base 0) para o motor em lote.
+ */
+typedef struct {
+    int atacante;
+    int defensor;
+} PedidoAtaque;
+
+/**
+ * @brief Estado do gerador pseudoaleatório (xoshiro256**).
+ * @note Cada jogo e cada thread possui o seu próprio gerador; nada é global.
+ */
+typedef struct {
+    uint64_t s[4];
+} GeradorAleatorio;
+
 // ============================================================================
 // --- Protótipos de Funções ---
 // ============================================================================
@@ -33,20 +62,39 @@ void cadastrarTerritorios(Territorio* mapa, int tamanho);
 void exibirMapa(const Territorio* mapa, int tamanho);
 
 // Lógica do Jogo
-void faseDeAtaque(Territorio* mapa, int tamanho);
-void atacar(Territorio* atacante, Territorio* defensor);
+void faseDeAtaque(Territorio* mapa, int tamanho, GeradorAleatorio* gerador);
+void atacar(Territorio* atacante, Territorio* defensor, GeradorAleatorio* gerador);
+
+// Motor de Batalha (sem E/S)
+void resolverBatalha(Territorio* atacante, Territorio* defensor, ResultadoBatalha* resultado,
+                     GeradorAleatorio* gerador);
+int resolverBatalhasEmLote(Territorio* mapa, int tamanho, const PedidoAtaque* pedidos,
+                           int quantidade, ResultadoBatalha* resultados, GeradorAleatorio* gerador);
+
+// Gerador Aleatório
+void semearGerador(GeradorAleatorio* gerador, uint64_t semente, uint64_t fluxo);
+uint64_t proximoAleatorio(GeradorAleatorio* gerador);
+uint32_t sortearLimitado(GeradorAleatorio* gerador, uint32_t limite);
+int rolarDado(GeradorAleatorio* gerador);
+void rolarVariosDados(GeradorAleatorio* gerador, unsigned char* destino, size_t quantidade);
 
 // Utilitárias
 void limparBufferEntrada(void);
-int rolarDado(void);
 
 // ============================================================================
 // --- Função Principal (main) ---
 // ============================================================================
 
-int main() {
-    // Inicializa a semente para garantir aleatoriedade nas rolagens de dado
-    srand((unsigned int)time(NULL)); 
+int main(int argc, char* argv[]) {
+    // Semente do jogo: --semente N reproduz uma partida; sem ela, usa o relogio
+    uint64_t semente = (uint64_t)time(NULL);
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--semente") == 0) {
+            semente = strtoull(argv[i + 1], NULL, 10);
+        }
+    }
+    GeradorAleatorio gerador;
+    semearGerador(&gerador, semente, 0);
     
     int num_territorios = 0;
     Territorio* mapa = NULL; 
@@ -54,6 +102,7 @@ int main() {
     printf("=======================================================\n");
     printf("         WAR ESTRUTURADO - SIMULACAO DE BATALHA\n");
     printf("=======================================================\n");
+    printf("Semente do jogo: %llu\n", (unsigned long long)semente);
 
     // Solicita o número de territórios
     printf("Informe o numero total de territorios para o mapa: ");
@@ -90,7 +139,7 @@ int main() {
         }
 
         if (escolha == 1) {
-            faseDeAtaque(mapa, num_territorios);
+            faseDeAtaque(mapa, num_territorios, &gerador);
         } else if (escolha != 0) {
             printf("\nOpcao invalida. Tente novamente.\n");
         }
@@ -188,20 +237,13 @@ void exibirMapa(const Territorio* mapa, int tamanho) {
 // --- Implementação das Funções de Lógica do Jogo ---
 // ============================================================================
 
-/**
- * @brief Rola um dado de 6 faces (1 a 6).
- * @return O resultado da rolagem.
- */
-int rolarDado(void) {
-    return (rand() % 6) + 1;
-}
-
 /**
  * @brief Gerencia a interface de ataque e valida as escolhas do jogador.
  * @param mapa O ponteiro para o vetor de territorios.
  * @param tamanho O numero total de territorios.
+ * @param gerador O gerador aleatorio da partida.
  */
-void faseDeAtaque(Territorio* mapa, int tamanho) {
+void faseDeAtaque(Territorio* mapa, int tamanho, GeradorAleatorio* gerador) {
     int id_atacante, id_defensor;
     
     printf("\n--- FASE DE ATAQUE ---\n");
@@ -239,56 +281,223 @@ void faseDeAtaque(Territorio* mapa, int tamanho) {
     }
     
     // Chama a simulacao de batalha, passando os ponteiros
-    atacar(&mapa[i_atacante], &mapa[i_defensor]);
+    atacar(&mapa[i_atacante], &mapa[i_defensor], gerador);
 }
 
 /**
- * @brief Simula um ataque entre dois territorios e atualiza os dados.
+ * @brief Apresenta uma rodada de batalha no terminal.
+ * @note Toda a regra fica em resolverBatalha(); aqui ficam apenas as mensagens.
  * @param atacante Ponteiro para o territorio atacante.
  * @param defensor Ponteiro para o territorio defensor.
  */
-void atacar(Territorio* atacante, Territorio* defensor) {
-    int dado_a = rolarDado();
-    int dado_d = rolarDado();
-    
+void atacar(Territorio* atacante, Territorio* defensor, GeradorAleatorio* gerador) {
+    ResultadoBatalha resultado;
+
     printf("\n--- RESULTADO DA BATALHA ---\n");
     printf("Batalha: %s (%s) vs %s (%s)\n", atacante->nome, atacante->cor, defensor->nome, defensor->cor);
-    printf("Dados Sorteados: Atacante (%d) contra Defensor (%d)\n", dado_a, dado_d);
-           
-    if (dado_a > dado_d) {
-        // Atacante vence
+
+    resolverBatalha(atacante, defensor, &resultado, gerador);
+
+    printf("Dados Sorteados: Atacante (%d) contra Defensor (%d)\n", resultado.dado_ataque, resultado.dado_defesa);
+
+    if (resultado.dado_ataque > resultado.dado_defesa) {
         printf("O Atacante %s VENCEU a rodada.\n", atacante->nome);
-        
-        // Atualizacao: defensor perde metade das tropas
-        if (defensor->tropas > 0) {
-            int tropas_perdidas = (defensor->tropas + 1) / 2; // Arredonda para cima
-            defensor->tropas -= tropas_perdidas;
-            printf("Defensor perde %d tropas. Tropas restantes: %d\n", tropas_perdidas, defensor->tropas);
+
+        if (resultado.perdas_defensor > 0) {
+            printf("Defensor perde %d tropas. Tropas restantes: %d\n", resultado.perdas_defensor,
+                   resultado.conquista ? 0 : defensor->tropas);
         }
 
-        if (defensor->tropas <= 0) {
+        if (resultado.conquista) {
             printf("\nTERRITORIO CONQUISTADO! %s agora pertence ao exercito %s.\n",
                    defensor->nome, atacante->cor);
-                   
-            // Altera o dono e move tropas
-            strcpy(defensor->cor, atacante->cor);
-            atacante->tropas -= 1;
-            defensor->tropas = 1; // Tropa conquistadora
-            
             printf("Uma tropa de %s move-se para %s.\n", atacante->nome, defensor->nome);
         }
-        
+
     } else { // Defensor vence ou ha empate
         printf("O Defensor %s RESISTIU. Atacante perde 1 tropa.\n", defensor->nome);
-        
-        // Atacante perde 1 tropa
-        atacante->tropas -= 1;
-        
         printf("Atacante perde 1 tropa. Tropas restantes em %s: %d\n", atacante->nome, atacante->tropas);
     }
-    
+
     printf("\nPressione ENTER para continuar...");
-    getchar(); 
+    getchar();
+}
+
+// ============================================================================
+// --- Implementação do Motor de Batalha (sem E/S) ---
+// ============================================================================
+
+/**
+ * @brief Resolve uma rodada de batalha e atualiza os territorios, sem imprimir nada.
+ * @param atacante Ponteiro para o territorio atacante.
+ * @param defensor Ponteiro para o territorio defensor.
+ * @param resultado Destino dos dados sorteados e das perdas da rodada.
+ */
+void resolverBatalha(Territorio* atacante, Territorio* defensor, ResultadoBatalha* resultado,
+                     GeradorAleatorio* gerador) {
+    int dado_a = rolarDado(gerador);
+    int dado_d = rolarDado(gerador);
+
+    resultado->dado_ataque = dado_a;
+    resultado->dado_defesa = dado_d;
+    resultado->perdas_atacante = 0;
+    resultado->perdas_defensor = 0;
+    resultado->conquista = 0;
+
+    if (dado_a > dado_d) {
+        // Atacante vence: defensor perde metade das tropas (arredonda para cima)
+        if (defensor->tropas > 0) {
+            int tropas_perdidas = (defensor->tropas + 1) / 2;
+            defensor->tropas -= tropas_perdidas;
+            resultado->perdas_defensor = tropas_perdidas;
+        }
+
+        if (defensor->tropas <= 0) {
+            // Altera o dono e move uma tropa conquistadora
+            strcpy(defensor->cor, atacante->cor);
+            atacante->tropas -= 1;
+            defensor->tropas = 1;
+            resultado->conquista = 1;
+        }
+    } else {
+        // Defensor vence ou ha empate: atacante perde 1 tropa
+        atacante->tropas -= 1;
+        resultado->perdas_atacante = 1;
+    }
+}
+
+/**
+ * @brief Resolve uma sequencia de ataques de uma so vez, sem E/S.
+ * @note Pedidos invalidos no momento da resolucao (mesmo territorio, indice fora
+ *       do mapa, atacante com menos de 2 tropas ou mesmo exercito) nao alteram o
+ *       mapa e recebem dado_ataque == 0 no resultado.
+ * @param mapa O ponteiro para o vetor de territorios.
+ * @param tamanho O numero total de territorios.
+ * @param pedidos Vetor de pares atacante/defensor (indices base 0).
+ * @param quantidade O numero de pedidos.
+ * @param resultados Vetor de saida com 'quantidade' posicoes, fornecido pelo chamador.
+ * @return O numero de pedidos efetivamente resolvidos.
+ */
+int resolverBatalhasEmLote(Territorio* mapa, int tamanho, const PedidoAtaque* pedidos,
+                           int quantidade, ResultadoBatalha* resultados, GeradorAleatorio* gerador) {
+    int resolvidos = 0;
+
+    for (int i = 0; i < quantidade; i++) {
+        int a = pedidos[i].atacante;
+        int d = pedidos[i].defensor;
+
+        if (a < 0 || a >= tamanho || d < 0 || d >= tamanho || a == d ||
+            mapa[a].tropas <= 1 || strcmp(mapa[a].cor, mapa[d].cor) == 0) {
+            memset(&resultados[i], 0, sizeof(ResultadoBatalha));
+            continue;
+        }
+
+        resolverBatalha(&mapa[a], &mapa[d], &resultados[i], gerador);
+        resolvidos++;
+    }
+    return resolvidos;
+}
+
+// ============================================================================
+// --- Implementação do Gerador Aleatório ---
+// ============================================================================
+
+/**
+ * @brief Passo do splitmix64, usado apenas para espalhar a semente no estado.
+ */
+static uint64_t splitmix64(uint64_t* x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl64(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * @brief Inicializa um gerador a partir da semente do jogo.
+ * @param semente A semente de 64 bits do jogo (reproduz a partida inteira).
+ * @param fluxo Identificador do fluxo (0 para o jogo, 1..N para threads), gerando
+ *              sequências independentes a partir da mesma semente.
+ */
+void semearGerador(GeradorAleatorio* gerador, uint64_t semente, uint64_t fluxo) {
+    uint64_t x = semente;
+    x = splitmix64(&x) ^ (fluxo * 0xD1B54A32D192ED03ULL);
+    for (int i = 0; i < 4; i++) {
+        gerador->s[i] = splitmix64(&x);
+    }
+}
+
+/**
+ * @brief Gera o próximo valor de 64 bits (xoshiro256**).
+ */
+uint64_t proximoAleatorio(GeradorAleatorio* gerador) {
+    uint64_t* s = gerador->s;
+    uint64_t resultado = rotl64(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl64(s[3], 45);
+
+    return resultado;
+}
+
+/**
+ * @brief Converte 32 bits aleatórios em um valor sem viés em [0, limite).
+ * @note Método da multiplicação de Lemire: só sorteia de novo quando o valor cai
+ *       na faixa que causaria viés, o que é raríssimo para limites pequenos.
+ */
+static inline uint32_t limitarSemVies(GeradorAleatorio* gerador, uint32_t x, uint32_t limite) {
+    uint64_t m = (uint64_t)x * limite;
+    uint32_t baixo = (uint32_t)m;
+
+    if (baixo < limite) {
+        uint32_t corte = (uint32_t)(-limite) % limite;
+        while (baixo < corte) {
+            x = (uint32_t)(proximoAleatorio(gerador) >> 32);
+            m = (uint64_t)x * limite;
+            baixo = (uint32_t)m;
+        }
+    }
+    return (uint32_t)(m >> 32);
+}
+
+/**
+ * @brief Sorteia um inteiro sem viés em [0, limite).
+ */
+uint32_t sortearLimitado(GeradorAleatorio* gerador, uint32_t limite) {
+    return limitarSemVies(gerador, (uint32_t)(proximoAleatorio(gerador) >> 32), limite);
+}
+
+/**
+ * @brief Rola um dado de 6 faces (1 a 6).
+ * @return O resultado da rolagem.
+ */
+int rolarDado(GeradorAleatorio* gerador) {
+    return (int)sortearLimitado(gerador, 6) + 1;
+}
+
+/**
+ * @brief Preenche um buffer com rolagens de dado (1 a 6) em uma única chamada.
+ * @note Cada saída de 64 bits do gerador produz dois dados.
+ */
+void rolarVariosDados(GeradorAleatorio* gerador, unsigned char* destino, size_t quantidade) {
+    size_t i = 0;
+
+    for (; i + 1 < quantidade; i += 2) {
+        uint64_t x = proximoAleatorio(gerador);
+        destino[i] = (unsigned char)(limitarSemVies(gerador, (uint32_t)(x >> 32), 6) + 1);
+        destino[i + 1] = (unsigned char)(limitarSemVies(gerador, (uint32_t)x, 6) + 1);
+    }
+    if (i < quantidade) {
+        destino[i] = (unsigned char)rolarDado(gerador);
+    }
 }
 
 // ============================================================================
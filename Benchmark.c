@@ -0,0 +1,618 @@
+// Benchmarks do núcleo do jogo (Missao_estrategica.c), com resultados em JSON.
+// Compile com: make bench   (ou: gcc -O2 -Wall -o Benchmark Benchmark.c -pthread -lm)
+
+#define WAR_SEM_MAIN // Reaproveita o jogo inteiro, menos a sua main()
+#include "Missao_estrategica.c"
+
+// --- Constantes ---
+#define TEMPO_MINIMO_MEDICAO 0.25 // Segundos: as repetições dobram até atingir este tempo
+#define MAX_RESULTADOS 64
+#define PARES_DE_ATAQUE 4096
+#define TERRITORIOS_EXIBICAO 100000
+#define TERRITORIOS_CARGA 1000000
+#define TERRITORIOS_CSV 200000
+#define CORES_SINTETICAS 4
+#define TROPAS_SINTETICAS 1000
+#define RODADAS_VERIFICACAO 100003 // Não múltiplo de 32: confere também as sobras dos núcleos
+#define TERRITORIOS_VERIFICACAO 4096
+
+// ============================================================================
+// --- Estrutura de Dados ---
+// ============================================================================
+
+/**
+ * @brief Uma medição: quantas operações couberam em quanto tempo.
+ */
+typedef struct {
+    char nome[64];
+    long long parametro;  // Tamanho do mapa, ou 0 quando não se aplica
+    long long operacoes;
+    double segundos;
+} ResultadoBenchmark;
+
+typedef struct {
+    ResultadoBenchmark itens[MAX_RESULTADOS];
+    int quantidade;
+} RelatorioBenchmark;
+
+/**
+ * @brief Função medida: executa 'repeticoes' operações sobre o contexto.
+ * @return Número de operações de fato realizadas (para taxas por território, por exemplo).
+ */
+typedef long long (*FuncaoMedida)(void* contexto, long long repeticoes);
+
+/**
+ * @brief Mapa sintético com fronteiras em grade, agregados e regiões, como numa partida.
+ */
+typedef struct {
+    Arena arena;
+    Mapa* mapa;
+    Missao missoes[TOTAL_MISSOES];
+    int missao;                          // Índice da missão medida
+    int colunas;                         // Largura da grade
+    PedidoAtaque pares[PARES_DE_ATAQUE]; // Ataques entre vizinhos de cores diferentes
+    ResultadoBatalha resultados[PARES_DE_ATAQUE];
+    GeradorAleatorio gerador;
+} MapaSintetico;
+
+/**
+ * @brief Arquivos de entrada e saída do conversor medido.
+ */
+typedef struct {
+    const char* csv;
+    const char* wmap;
+    int linhas;
+} ConversaoCsv;
+
+// ============================================================================
+// --- Protótipos de Funções ---
+// ============================================================================
+
+// Medição e Relatório
+double segundosDesde(const struct timespec* inicio);
+void medir(RelatorioBenchmark* relatorio, const char* nome, long long parametro, FuncaoMedida funcao,
+           void* contexto);
+void gravarRelatorioJson(const RelatorioBenchmark* relatorio, FILE* saida);
+
+// Mapas Sintéticos
+int criarMapaSintetico(MapaSintetico* sintetico, int tamanho, int com_nomes);
+void liberarMapaSintetico(MapaSintetico* sintetico);
+
+int gravarCsvSintetico(const char* caminho, int tamanho);
+
+// Saída Padrão Silenciada (exibirMapa e o conversor escrevem no stdout)
+int silenciarSaida(void);
+void restaurarSaida(int copia);
+
+// Funções Medidas
+long long medirRolarDado(void* contexto, long long repeticoes);
+long long medirRolarVariosDados(void* contexto, long long repeticoes);
+long long medirBatalhas(void* contexto, long long repeticoes);
+long long medirLoteParalelo(void* contexto, long long repeticoes);
+long long medirCercoRodadas(void* contexto, long long repeticoes);
+long long medirCercoBlitz(void* contexto, long long repeticoes);
+long long medirRodadasClassicas(void* contexto, long long repeticoes);
+long long medirCompararDadosEmLote(void* contexto, long long repeticoes);
+long long medirVerificarMissao(void* contexto, long long repeticoes);
+long long medirVarredura(void* contexto, long long repeticoes);
+long long medirExibirMapa(void* contexto, long long repeticoes);
+long long medirCarregarMapa(void* contexto, long long repeticoes);
+long long medirConverterCsv(void* contexto, long long repeticoes);
+const char* nomeDoTipoDeMissao(int tipo);
+
+// ============================================================================
+// --- Função Principal (main) ---
+// ============================================================================
+
+int main(int argc, char* argv[]) {
+    const char* arquivo_saida = NULL;
+    int rapido = 0, verificar = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--saida") == 0 && i + 1 < argc) {
+            arquivo_saida = argv[++i];
+        } else if (strcmp(argv[i], "--rapido") == 0) {
+            rapido = 1;
+        } else if (strcmp(argv[i], "--verificar") == 0) {
+            verificar = 1;
+        }
+    }
+
+    // Confere os núcleos vetoriais contra o escalar e o sorteio rodada a rodada, e o lote
+    // paralelo contra o serial, sem medir nada
+    if (verificar) {
+        if (!conferirCompararDados(RODADAS_VERIFICACAO, 42)) return 1;
+        printf("compararDadosEmLote: escalar, SSE2 e AVX2 conferem com sortearRodada.\n");
+        if (!conferirLoteParalelo(TERRITORIOS_VERIFICACAO, 42)) return 1;
+        printf("resolverLoteParalelo: 1, 2, 3, 4 e 8 threads dao o mesmo mapa e os mesmos resultados.\n");
+        return 0;
+    }
+
+    static RelatorioBenchmark relatorio;
+    GeradorAleatorio gerador;
+    semearGerador(&gerador, 42, 0);
+
+    // --- Dados ---
+    medir(&relatorio, "rolarDado", 0, medirRolarDado, &gerador);
+    medir(&relatorio, "rolarVariosDados", 0, medirRolarVariosDados, &gerador);
+
+    // --- Cerco completo (TROPAS_SINTETICAS contra TROPAS_SINTETICAS): rodada a rodada e blitz ---
+    medir(&relatorio, "cerco/rodadas", TROPAS_SINTETICAS, medirCercoRodadas, &gerador);
+    medir(&relatorio, "cerco/resolverBlitz", TROPAS_SINTETICAS, medirCercoBlitz, &gerador);
+
+    // --- Rodadas de 3 contra 2 dados (regra clássica): uma a uma e em planos ---
+    medir(&relatorio, "rodada3x2/sortearRodada", 0, medirRodadasClassicas, &gerador);
+    medir(&relatorio, "rodada3x2/compararDadosEmLote", 0, medirCompararDadosEmLote, &gerador);
+
+    // --- Batalhas (núcleo de atacar(), sem E/S) e missões ---
+    const int tamanhos[] = { 1000, 1000000, 10000000 };
+    int num_tamanhos = rapido ? 2 : 3;
+    for (int t = 0; t < num_tamanhos; t++) {
+        static MapaSintetico sintetico;
+        if (!criarMapaSintetico(&sintetico, tamanhos[t], 0)) {
+            fprintf(stderr, "Memoria insuficiente para o mapa de %d territorios.\n", tamanhos[t]);
+            continue;
+        }
+        medir(&relatorio, "resolverBatalha", tamanhos[t], medirBatalhas, &sintetico);
+        medir(&relatorio, "resolverLoteParalelo", tamanhos[t], medirLoteParalelo, &sintetico);
+        for (int m = 0; m < TOTAL_MISSOES; m++) {
+            char nome[64];
+            sintetico.missao = m;
+            snprintf(nome, sizeof(nome), "verificarMissao/%s", nomeDoTipoDeMissao(m));
+            medir(&relatorio, nome, tamanhos[t], medirVerificarMissao, &sintetico);
+        }
+        medir(&relatorio, "contarTerritoriosComMaisTropas", tamanhos[t], medirVarredura, &sintetico);
+        liberarMapaSintetico(&sintetico);
+    }
+
+    // --- Exibição (linhas formatadas por segundo) ---
+    static MapaSintetico exibicao;
+    if (criarMapaSintetico(&exibicao, rapido ? TERRITORIOS_EXIBICAO / 10 : TERRITORIOS_EXIBICAO, 1)) {
+        medir(&relatorio, "exibirMapa", exibicao.mapa->tamanho, medirExibirMapa, &exibicao);
+    }
+
+    // --- Carga de mapas (.wmap com mmap e conversão de CSV) ---
+    char caminho_wmap[64], caminho_csv[64];
+    snprintf(caminho_wmap, sizeof(caminho_wmap), "/tmp/war_bench_%d.wmap", (int)getpid());
+    snprintf(caminho_csv, sizeof(caminho_csv), "/tmp/war_bench_%d.csv", (int)getpid());
+    int tamanho_carga = rapido ? TERRITORIOS_CARGA / 10 : TERRITORIOS_CARGA;
+    if (exibicao.mapa != NULL && exibicao.mapa->tamanho != tamanho_carga) {
+        liberarMapaSintetico(&exibicao);
+    }
+    if (exibicao.mapa != NULL || criarMapaSintetico(&exibicao, tamanho_carga, 1)) {
+        TabelaCores cores = { .quantidade = 0 };
+        for (int c = 0; c < CORES_SINTETICAS; c++) {
+            char nome[MAX_COR];
+            snprintf(nome, sizeof(nome), "COR%d", c);
+            registrarCor(&cores, nome);
+        }
+        if (salvarMapaBinario(exibicao.mapa, &cores, caminho_wmap)) {
+            medir(&relatorio, "carregarMapaBinario", tamanho_carga, medirCarregarMapa, caminho_wmap);
+        }
+        liberarMapaSintetico(&exibicao);
+    }
+    ConversaoCsv conversao = { caminho_csv, caminho_wmap, rapido ? TERRITORIOS_CSV / 10 : TERRITORIOS_CSV };
+    if (gravarCsvSintetico(conversao.csv, conversao.linhas)) {
+        medir(&relatorio, "converterCsvParaBinario", conversao.linhas, medirConverterCsv, &conversao);
+    }
+    unlink(caminho_wmap);
+    unlink(caminho_csv);
+
+    FILE* saida = arquivo_saida ? fopen(arquivo_saida, "w") : stdout;
+    if (saida == NULL) {
+        fprintf(stderr, "Nao foi possivel criar '%s'.\n", arquivo_saida);
+        return 1;
+    }
+    gravarRelatorioJson(&relatorio, saida);
+    if (saida != stdout) fclose(saida);
+    return 0;
+}
+
+// ============================================================================
+// --- Implementação da Medição e do Relatório ---
+// ============================================================================
+
+double segundosDesde(const struct timespec* inicio) {
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    return (double)(agora.tv_sec - inicio->tv_sec) + (double)(agora.tv_nsec - inicio->tv_nsec) * 1e-9;
+}
+
+/**
+ * @brief Mede 'funcao', dobrando as repetições até durar TEMPO_MINIMO_MEDICAO, e
+ *        guarda a última rodada no relatório.
+ * @note A primeira rodada (1 repetição) também aquece caches e páginas.
+ */
+void medir(RelatorioBenchmark* relatorio, const char* nome, long long parametro, FuncaoMedida funcao,
+           void* contexto) {
+    if (relatorio->quantidade >= MAX_RESULTADOS) return;
+
+    long long repeticoes = 1;
+    long long operacoes = 0;
+    double segundos = 0.0;
+    for (;;) {
+        struct timespec inicio;
+        clock_gettime(CLOCK_MONOTONIC, &inicio);
+        operacoes = funcao(contexto, repeticoes);
+        segundos = segundosDesde(&inicio);
+        if (segundos >= TEMPO_MINIMO_MEDICAO || repeticoes >= (1LL << 40)) break;
+        repeticoes *= 2;
+    }
+
+    ResultadoBenchmark* r = &relatorio->itens[relatorio->quantidade++];
+    snprintf(r->nome, sizeof(r->nome), "%s", nome);
+    r->parametro = parametro;
+    r->operacoes = operacoes;
+    r->segundos = segundos;
+    fprintf(stderr, "%-40s %12lld  %12.2f ns/op\n", nome, parametro,
+            operacoes > 0 ? segundos * 1e9 / (double)operacoes : 0.0);
+}
+
+void gravarRelatorioJson(const RelatorioBenchmark* relatorio, FILE* saida) {
+    fprintf(saida, "{\n  \"resultados\": [\n");
+    for (int i = 0; i < relatorio->quantidade; i++) {
+        const ResultadoBenchmark* r = &relatorio->itens[i];
+        double ns = r->operacoes > 0 ? r->segundos * 1e9 / (double)r->operacoes : 0.0;
+        double taxa = r->segundos > 0.0 ? (double)r->operacoes / r->segundos : 0.0;
+        fprintf(saida,
+                "    {\"nome\": \"%s\", \"parametro\": %lld, \"operacoes\": %lld, "
+                "\"segundos\": %.6f, \"ns_por_op\": %.3f, \"ops_por_s\": %.1f}%s\n",
+                r->nome, r->parametro, r->operacoes, r->segundos, ns, taxa,
+                i + 1 < relatorio->quantidade ? "," : "");
+    }
+    fprintf(saida, "  ]\n}\n");
+}
+
+// ============================================================================
+// --- Implementação dos Mapas Sintéticos ---
+// ============================================================================
+
+/**
+ * @brief Cor inicial do território na grade: vizinhos diferem sempre em 1 (mod CORES_SINTETICAS).
+ */
+static CorId corSintetica(const MapaSintetico* sintetico, int territorio) {
+    return (CorId)(((territorio % sintetico->colunas) + (territorio / sintetico->colunas)) % CORES_SINTETICAS);
+}
+
+/**
+ * @brief Cria um mapa em grade, numa arena, com as estruturas de uma partida
+ *        (fronteiras, agregados, regiões e alterados) e os pares de ataque.
+ * @note Vizinhos na grade sempre têm cores diferentes, então todo par é um ataque
+ *       válido enquanto o defensor não for conquistado (ver medirBatalhas()).
+ * @return 1 em caso de sucesso, 0 se faltou memória (nada fica alocado).
+ */
+int criarMapaSintetico(MapaSintetico* sintetico, int tamanho, int com_nomes) {
+    memset(sintetico, 0, sizeof(*sintetico));
+    Mapa* mapa = alocarMapa(&sintetico->arena, tamanho);
+    if (mapa == NULL) return 0;
+
+    mapa->fronteiras = criarFronteirasEmGrade(mapa->arena, tamanho, &sintetico->colunas);
+    int ok = (mapa->fronteiras != NULL);
+    for (int i = 0; i < tamanho; i++) {
+        mapa->dono[i] = corSintetica(sintetico, i);
+        mapa->tropas[i] = TROPAS_SINTETICAS + i % 7;
+        if (com_nomes) {
+            char nome[MAX_STRING];
+            int comprimento = snprintf(nome, sizeof(nome), "Territorio %d", i + 1);
+            mapa->nomes[i] = adicionarNome(mapa->pool_nomes, nome, (size_t)comprimento);
+        }
+        if (mapa->nomes[i] == NOME_INVALIDO) ok = 0;
+    }
+    if (!ok || !inicializarAgregados(mapa) || !inicializarRegioes(mapa) ||
+        !inicializarAlterados(mapa)) {
+        liberarMemoria(mapa);
+        destruirArena(&sintetico->arena);
+        return 0;
+    }
+    sintetico->mapa = mapa;
+
+    const Missao missoes[TOTAL_MISSOES] = {
+        { MISSAO_TERRITORIOS_SEGUIDOS, COR_INVALIDA, 4, 0 },
+        { MISSAO_ELIMINAR_COR, 1, 0, 0 },
+        { MISSAO_CONQUISTAR_TERRITORIOS, COR_INVALIDA, 3, 0 },
+        { MISSAO_TERRITORIOS_FORTES, COR_INVALIDA, 3, 5 },
+        { MISSAO_DOMINAR_MAPA, COR_INVALIDA, 0, 0 }
+    };
+    for (int m = 0; m < TOTAL_MISSOES; m++) {
+        sintetico->missoes[m] = missoes[m];
+        prepararMissao(mapa, &missoes[m]);
+    }
+
+    // Pares espalhados pelo mapa inteiro, para que o lote não fique todo no cache
+    semearGerador(&sintetico->gerador, 7, 0);
+    for (int p = 0; p < PARES_DE_ATAQUE; p++) {
+        int a = (int)sortearLimitado(&sintetico->gerador, (uint32_t)tamanho);
+        const GrafoFronteiras* grafo = mapa->fronteiras;
+        sintetico->pares[p].atacante = a;
+        sintetico->pares[p].defensor = grafo->vizinhos[grafo->inicio[a]];
+    }
+    return 1;
+}
+
+void liberarMapaSintetico(MapaSintetico* sintetico) {
+    liberarMemoria(sintetico->mapa);
+    destruirArena(&sintetico->arena);
+    sintetico->mapa = NULL;
+}
+
+/**
+ * @brief Grava um CSV de 'tamanho' territórios no formato de converterCsvParaBinario().
+ */
+int gravarCsvSintetico(const char* caminho, int tamanho) {
+    FILE* arquivo = fopen(caminho, "w");
+    if (arquivo == NULL) return 0;
+
+    fprintf(arquivo, "# Mapa sintetico do benchmark\n");
+    for (int i = 0; i < tamanho; i++) {
+        fprintf(arquivo, "Territorio %d,COR%d,%d\n", i + 1, i % CORES_SINTETICAS, 1 + i % 50);
+    }
+    return fclose(arquivo) == 0;
+}
+
+// ============================================================================
+// --- Implementação da Saída Padrão Silenciada ---
+// ============================================================================
+
+/**
+ * @brief Redireciona o stdout para /dev/null, para medir a formatação sem o terminal.
+ * @return Cópia do descritor original, a entregar a restaurarSaida().
+ */
+int silenciarSaida(void) {
+    fflush(stdout);
+    int copia = dup(STDOUT_FILENO);
+    int nulo = open("/dev/null", O_WRONLY);
+    if (nulo >= 0) {
+        dup2(nulo, STDOUT_FILENO);
+        close(nulo);
+    }
+    return copia;
+}
+
+void restaurarSaida(int copia) {
+    fflush(stdout);
+    if (copia >= 0) {
+        dup2(copia, STDOUT_FILENO);
+        close(copia);
+    }
+}
+
+// ============================================================================
+// --- Implementação das Funções Medidas ---
+// ============================================================================
+
+// Impede que o compilador descarte os resultados calculados
+static volatile long long sumidouro;
+
+const char* nomeDoTipoDeMissao(int tipo) {
+    static const char* const nomes[TOTAL_TIPOS_MISSAO] = {
+        "territorios_seguidos", "eliminar_cor", "conquistar_territorios", "territorios_fortes", "dominar_mapa"
+    };
+    return (tipo >= 0 && tipo < TOTAL_TIPOS_MISSAO) ? nomes[tipo] : "desconhecida";
+}
+
+long long medirRolarDado(void* contexto, long long repeticoes) {
+    GeradorAleatorio* gerador = (GeradorAleatorio*)contexto;
+    long long soma = 0;
+    for (long long i = 0; i < repeticoes; i++) soma += rolarDado(gerador);
+    sumidouro = soma;
+    return repeticoes;
+}
+
+/**
+ * @brief Cercos completos num duelo de dois territórios, repetindo resolverBatalha().
+ */
+long long medirCercoRodadas(void* contexto, long long repeticoes) {
+    GeradorAleatorio* gerador = (GeradorAleatorio*)contexto;
+    long long conquistas = 0;
+    for (long long i = 0; i < repeticoes; i++) {
+        CorId dono[2] = { 0, 1 };
+        int tropas[2] = { TROPAS_SINTETICAS, TROPAS_SINTETICAS };
+        Mapa duelo = { .tamanho = 2, .dono = dono, .tropas = tropas };
+        ResultadoBatalha resultado = { 0 };
+        while (tropas[0] > 1 && !resultado.conquista) resolverBatalha(&duelo, 0, 1, &resultado, gerador);
+        conquistas += resultado.conquista;
+    }
+    sumidouro = conquistas;
+    return repeticoes;
+}
+
+/**
+ * @brief Rodadas de 3 contra 2 dados com o núcleo escalar da regra clássica (dados incluídos).
+ */
+long long medirRodadasClassicas(void* contexto, long long repeticoes) {
+    GeradorAleatorio* gerador = (GeradorAleatorio*)contexto;
+    FuncaoRodadaBatalha sortear = regras_batalha[REGRA_CLASSICA]->sortear;
+    long long perdas = 0;
+    for (long long i = 0; i < repeticoes; i++) {
+        ResultadoBatalha resultado;
+        sortear(TROPAS_SINTETICAS, TROPAS_SINTETICAS, &resultado, gerador);
+        perdas += resultado.perdas_defensor;
+    }
+    sumidouro = perdas;
+    return repeticoes;
+}
+
+/**
+ * @brief As mesmas rodadas em planos de RODADAS_POR_LOTE_DADOS, com os dados de
+ *        rolarVariosDados() e a comparação de compararDadosEmLote().
+ */
+long long medirCompararDadosEmLote(void* contexto, long long repeticoes) {
+    GeradorAleatorio* gerador = (GeradorAleatorio*)contexto;
+    unsigned char planos[6][RODADAS_POR_LOTE_DADOS];
+    unsigned char perdas_a[RODADAS_POR_LOTE_DADOS], perdas_d[RODADAS_POR_LOTE_DADOS];
+    unsigned char* const ataque[3] = { planos[0], planos[1], planos[2] };
+    unsigned char* const defesa[3] = { planos[3], planos[4], planos[5] };
+    long long perdas = 0;
+    for (long long i = 0; i < repeticoes; i++) {
+        rolarVariosDados(gerador, planos[0], 5 * RODADAS_POR_LOTE_DADOS); // Planos 0 a 4
+        memset(planos[5], 0, RODADAS_POR_LOTE_DADOS);                      // Terceiro dado da defesa ausente
+        compararDadosEmLote(ataque, defesa, 0, RODADAS_POR_LOTE_DADOS, perdas_a, perdas_d);
+        perdas += perdas_d[i % RODADAS_POR_LOTE_DADOS];
+    }
+    sumidouro = perdas;
+    return repeticoes * RODADAS_POR_LOTE_DADOS;
+}
+
+/**
+ * @brief Os mesmos cercos de medirCercoRodadas(), cada um numa chamada de resolverBlitz().
+ */
+long long medirCercoBlitz(void* contexto, long long repeticoes) {
+    GeradorAleatorio* gerador = (GeradorAleatorio*)contexto;
+    long long conquistas = 0;
+    for (long long i = 0; i < repeticoes; i++) {
+        CorId dono[2] = { 0, 1 };
+        int tropas[2] = { TROPAS_SINTETICAS, TROPAS_SINTETICAS };
+        Mapa duelo = { .tamanho = 2, .dono = dono, .tropas = tropas };
+        ResultadoBlitz resultado;
+        resolverBlitz(&duelo, 0, 1, &resultado, gerador);
+        conquistas += resultado.conquista;
+    }
+    sumidouro = conquistas;
+    return repeticoes;
+}
+
+long long medirRolarVariosDados(void* contexto, long long repeticoes) {
+    GeradorAleatorio* gerador = (GeradorAleatorio*)contexto;
+    unsigned char dados[4096];
+    long long soma = 0;
+    for (long long i = 0; i < repeticoes; i++) {
+        rolarVariosDados(gerador, dados, sizeof(dados));
+        soma += dados[i & (sizeof(dados) - 1)];
+    }
+    sumidouro = soma;
+    return repeticoes * (long long)sizeof(dados);
+}
+
+/**
+ * @brief Devolve à cor e às tropas iniciais os pares conquistados ou esgotados no lote anterior.
+ */
+static void restaurarPares(MapaSintetico* sintetico) {
+    Mapa* mapa = sintetico->mapa;
+    for (int p = 0; p < PARES_DE_ATAQUE; p++) {
+        int a = sintetico->pares[p].atacante;
+        int d = sintetico->pares[p].defensor;
+        if (mapa->dono[a] != corSintetica(sintetico, a)) transferirTerritorio(mapa, a, corSintetica(sintetico, a));
+        if (mapa->dono[d] != corSintetica(sintetico, d)) transferirTerritorio(mapa, d, corSintetica(sintetico, d));
+        if (mapa->tropas[a] < 2) definirTropas(mapa, a, TROPAS_SINTETICAS);
+        if (mapa->tropas[d] < 2) definirTropas(mapa, d, TROPAS_SINTETICAS);
+    }
+}
+
+/**
+ * @brief Rodadas de batalha por segundo: o núcleo de atacar(), sem a E/S do terminal,
+ *        com agregados, regiões e alterados atualizados a cada rodada.
+ * @note Conquistas acontecem de verdade; antes de cada lote, os pares conquistados
+ *       voltam à cor e às tropas iniciais (custo incluído na medição, ~2 escritas por par).
+ */
+long long medirBatalhas(void* contexto, long long repeticoes) {
+    MapaSintetico* sintetico = (MapaSintetico*)contexto;
+    long long resolvidas = 0;
+    for (long long i = 0; i < repeticoes; i++) {
+        restaurarPares(sintetico);
+        resolvidas += resolverBatalhasEmLote(sintetico->mapa, sintetico->pares, PARES_DE_ATAQUE,
+                                             sintetico->resultados, &sintetico->gerador);
+        limparAlterados(sintetico->mapa);
+    }
+    return resolvidas;
+}
+
+/**
+ * @brief Como medirBatalhas(), mas com o lote agrupado em níveis de conflito e sorteado
+ *        em todos os núcleos (o custo do agrupamento entra na medição).
+ */
+long long medirLoteParalelo(void* contexto, long long repeticoes) {
+    MapaSintetico* sintetico = (MapaSintetico*)contexto;
+    long long resolvidas = 0;
+    for (long long i = 0; i < repeticoes; i++) {
+        restaurarPares(sintetico);
+        resolvidas += resolverLoteParalelo(sintetico->mapa, sintetico->pares, PARES_DE_ATAQUE,
+                                           sintetico->resultados, &sintetico->gerador, 0);
+        limparAlterados(sintetico->mapa);
+    }
+    return resolvidas;
+}
+
+long long medirVerificarMissao(void* contexto, long long repeticoes) {
+    MapaSintetico* sintetico = (MapaSintetico*)contexto;
+    const Missao* missao = &sintetico->missoes[sintetico->missao];
+    long long cumpridas = 0;
+    for (long long i = 0; i < repeticoes; i++) {
+        cumpridas += verificarMissao(missao, sintetico->mapa, (CorId)(i % CORES_SINTETICAS));
+    }
+    sumidouro = cumpridas;
+    return repeticoes;
+}
+
+/**
+ * @brief Varredura completa de dono e tropas (o caminho sem agregados), em territórios por segundo.
+ */
+long long medirVarredura(void* contexto, long long repeticoes) {
+    MapaSintetico* sintetico = (MapaSintetico*)contexto;
+    long long total = 0;
+    for (long long i = 0; i < repeticoes; i++) {
+        total += contarTerritoriosComMaisTropas(sintetico->mapa, (CorId)(i % CORES_SINTETICAS), 5);
+    }
+    sumidouro = total;
+    return repeticoes * sintetico->mapa->tamanho;
+}
+
+/**
+ * @brief Linhas da tabela completa formatadas e escritas (em /dev/null) por segundo.
+ */
+long long medirExibirMapa(void* contexto, long long repeticoes) {
+    MapaSintetico* sintetico = (MapaSintetico*)contexto;
+    TabelaCores cores = { .quantidade = 0 };
+    for (int c = 0; c < CORES_SINTETICAS; c++) {
+        char nome[MAX_COR];
+        snprintf(nome, sizeof(nome), "COR%d", c);
+        registrarCor(&cores, nome);
+    }
+    FiltroMapa filtro = { VISAO_COMPLETA, 0, 0, COR_INVALIDA, 0 };
+    BufferSaida saida = { 0 };
+
+    int copia = silenciarSaida();
+    for (long long i = 0; i < repeticoes; i++) {
+        exibirMapa(sintetico->mapa, &cores, &filtro, &saida);
+    }
+    restaurarSaida(copia);
+    liberarSaida(&saida);
+    return repeticoes * sintetico->mapa->tamanho;
+}
+
+/**
+ * @brief Territórios carregados por segundo de um .wmap (mmap, validação e agregados).
+ */
+long long medirCarregarMapa(void* contexto, long long repeticoes) {
+    const char* caminho = (const char*)contexto;
+    Arena sessao = { 0 };
+    long long territorios = 0;
+    for (long long i = 0; i < repeticoes; i++) {
+        TabelaCores cores = { .quantidade = 0 };
+        Mapa* mapa = carregarMapaBinario(caminho, &cores, &sessao);
+        if (mapa == NULL) break;
+        if (mapa->fronteiras == NULL) {
+            int colunas = 0;
+            mapa->fronteiras = criarFronteirasEmGrade(mapa->arena, mapa->tamanho, &colunas);
+        }
+        if (mapa->fronteiras != NULL && inicializarAgregados(mapa) && inicializarRegioes(mapa)) {
+            territorios += mapa->tamanho;
+        }
+        liberarMemoria(mapa);
+    }
+    destruirArena(&sessao);
+    return territorios;
+}
+
+/**
+ * @brief Linhas de CSV convertidas para .wmap por segundo.
+ */
+long long medirConverterCsv(void* contexto, long long repeticoes) {
+    const ConversaoCsv* conversao = (const ConversaoCsv*)contexto;
+    long long linhas = 0;
+    int copia = silenciarSaida();
+    for (long long i = 0; i < repeticoes; i++) {
+        if (!converterCsvParaBinario(conversao->csv, conversao->wmap)) break;
+        linhas += conversao->linhas;
+    }
+    restaurarSaida(copia);
+    return linhas;
+}
@@ -1,394 +1,7539 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h> 
+#include <stdint.h>
+#include <time.h>
 #include <ctype.h> // Necessária para a função toupper()
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <signal.h>
+#include <errno.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define WAR_SIMD_X86 1
+#else
+#define WAR_SIMD_X86 0
+#endif
 
 // --- Constantes ---
 #define MAX_STRING 50
 #define MAX_COR 10
+#define MAX_CORES 255
+#define COR_INVALIDA 255
+#define NOME_INVALIDO UINT32_MAX
+#define CAPACIDADE_INICIAL_NOMES 64 // Entradas da tabela de espalhamento do pool (potência de 2)
+#define TEXTO_INICIAL_NOMES 1024     // Bytes de texto do pool antes do primeiro crescimento
+#define MAX_LIMIARES 4
 #define MAX_MISSAO_LEN 100
 #define TOTAL_MISSOES 5
+#define MAX_THREADS 64
+#define PEDIDOS_MINIMOS_POR_THREAD 1024 // Lotes menores são resolvidos só pela chamadora
+#define ENSAIOS_POR_BLOCO 4096
+#define RODADAS_POR_LOTE_DADOS 256 // Rodadas juntadas para compararDadosEmLote()
+#define ENSAIOS_PADRAO 200000
+#define MAGICA_MAPA "WARMAPA" // 8 bytes com o terminador
+#define VERSAO_MAPA 2
+#define MARCA_ORDEM_BYTES 0x01020304u
+#define ALINHAMENTO_SECAO 64
+#define ALINHAMENTO_ARENA 64 // Linha de cache: vetores da arena não compartilham linhas
+#define MAGICA_DIARIO "WARLOG"
+#define VERSAO_DIARIO 1
+#define TAMANHO_BUFFER_DIARIO (64 * 1024)
+#define INTERVALO_INSTANTANEO 65536 // Eventos entre instantâneos do mapa no .idx
+#define MAX_BYTES_EVENTO 51         // 1 byte de dados + 5 varints de até 10 bytes
+#define BIT_CONQUISTA 0x40
+#define TEMPO_IA_PADRAO_MS 200
+#define NOS_MCTS_POR_THREAD (1 << 17)
+#define MAX_PROFUNDIDADE_MCTS 32
+#define JOGADAS_SIMULACAO 20       // Lances aleatórios após a folha, antes de avaliar
+#define TENTATIVAS_LANCE_ALEATORIO 16
+#define UCT_EXPLORACAO 0.25f       // As recompensas variam pouco entre lances (frações do mapa)
+#define LIMITE_TABELA_COMPLETA 100 // Acima disso, a tabela é paginada e só as alterações são reexibidas
+#define LINHAS_POR_PAGINA 50
+#define TAMANHO_BLOCO_SCRIPT (64 * 1024) // Leitura e escrita do modo script
+#define TAMANHO_LINHA_TECLADO 256        // Trecho de linha lido de uma vez pelos prompts interativos
+#define TRABALHADORES_PADRAO 4
+#define MAX_EVENTOS_EPOLL 256
+#define TAMANHO_ENTRADA_CONEXAO 4096
+#define BALDES_LATENCIA 512             // Log2 com 8 sub-baldes lineares por potência de 2
+#define INTERVALO_RELATORIO_SERVIDOR 5  // Segundos entre relatórios do servidor
+#define CONEXOES_CLIENTE_PADRAO 64
+#define PEDIDOS_CLIENTE_PADRAO 100000   // Por conexão
+#define JANELA_CLIENTE 32               // Pedidos enviados de uma vez por conexão
+#define MAX_CONEXOES_THREAD_CLIENTE 1024
+#define PARTIDAS_POR_BLOCO_TORNEIO 64
+#define TURNOS_MAXIMOS_TORNEIO 500
+#define PARTIDAS_TORNEIO_PADRAO 100000
+#define TERRITORIOS_POR_BLOCO 64  // Granularidade da cópia na escrita dos retratos
+#define BITS_POR_NO 6             // Cada nó da árvore dos retratos tem 2^6 filhos
+#define RAMOS_POR_NO (1 << BITS_POR_NO)
+#define PASSOS_HISTORICO 64       // Jogadas que podem ser desfeitas
+#define FLUXO_HIPOTESE 0x48495054ULL // Fluxo dos dados das hipóteses, separado do jogo (fluxo 0)
+#define BALDES_HISTOGRAMA 48         // Baldes log2 de ciclos: até 2^47 ciclos por medição
+#define PROB_VITORIA_ATAQUE (15.0 / 36.0) // P(dado do atacante > dado do defensor)
+#define RODADAS_MINIMAS_BLOCO 8           // Abaixo disso, o cerco de vários dados rola rodada a rodada
 
 // ============================================================================
 // --- Estrutura de Dados ---
 // ============================================================================
 
 /**
- * @brief Estrutura que representa um território no mapa.
+ * @brief Identificador de uma cor de exército (índice na TabelaCores).
+ */
+typedef unsigned char CorId;
+
+/**
+ * @brief Tabela de cores registradas. O texto é convertido para MAIÚSCULAS uma
+ *        única vez, no registro; depois disso a cor circula apenas como CorId.
+ */
+typedef struct {
+    char nomes[MAX_CORES][MAX_COR];
+    int quantidade;
+} TabelaCores;
+
+/**
+ * @brief Nome de um território: deslocamento do seu texto no PoolNomes do mapa.
+ * @note 4 bytes em vez de MAX_STRING; o deslocamento 0 é sempre o nome vazio.
+ */
+typedef uint32_t NomeTerritorio;
+
+/**
+ * @brief Pool de nomes: textos terminados em '\0', contíguos e sem repetição.
+ * @note Nomes iguais compartilham o mesmo deslocamento. A tabela de espalhamento
+ *       (endereçamento aberto, NOME_INVALIDO = entrada livre) só existe enquanto
+ *       o pool aceita nomes novos; o de um .wmap carregado aponta para o arquivo
+ *       mapeado e é somente leitura.
+ */
+typedef struct {
+    char* texto;
+    uint32_t usado, capacidade;     // Bytes de texto
+    uint32_t* tabela;               // NULL: somente leitura
+    uint32_t capacidade_tabela;     // Potência de 2
+    uint32_t num_nomes;
+    int externo;                    // 'texto' pertence ao arquivo mapeado
+} PoolNomes;
+
+/**
+ * @brief Agregados por cor, mantidos a cada alteração do mapa.
+ * @note Com eles, as missões são verificadas sem percorrer o mapa. Os membros de
+ *       cada cor formam uma lista duplamente encadeada pelos índices dos
+ *       territórios, o que torna a troca de dono O(1).
+ */
+typedef struct {
+    int territorios[MAX_CORES];           // Territórios de cada cor
+    long long tropas[MAX_CORES];          // Soma das tropas de cada cor
+    int limiares[MAX_LIMIARES];           // Limiares de tropas registrados
+    int num_limiares;
+    int acima[MAX_LIMIARES][MAX_CORES];   // Territórios da cor com tropas > limiar
+    int primeiro[MAX_CORES];              // Primeiro membro de cada cor (-1 se nenhum)
+    int* proximo;                         // Próximo membro da mesma cor (por território)
+    int* anterior;                        // Membro anterior da mesma cor (por território)
+} AgregadosMapa;
+
+/**
+ * @brief Grafo de fronteiras em formato CSR (compressed sparse row).
+ * @note Os vizinhos do território i são vizinhos[inicio[i]] .. vizinhos[inicio[i + 1] - 1].
+ */
+typedef struct {
+    int* inicio;   // tamanho + 1 posições
+    int* vizinhos; // inicio[tamanho] posições
+    int externo;   // 1 se os vetores pertencem a um arquivo mapeado (não liberar)
+} GrafoFronteiras;
+
+/**
+ * @brief Regiões contíguas por cor (union-find sobre os territórios).
+ * @note Ganhar um território só une conjuntos. Perder um pode partir uma região,
+ *       então a cor é marcada como desatualizada e refeita sob demanda, visitando
+ *       apenas os seus próprios membros.
+ */
+typedef struct {
+    int* pai;                              // Por território
+    int* tamanho_conjunto;                 // Válido nas raízes
+    int maior[MAX_CORES];                  // Maior região de cada cor
+    unsigned char desatualizada[MAX_CORES];
+} RegioesMapa;
+
+/**
+ * @brief Arena de alocação sequencial (bump allocator) de uma sessão de jogo.
+ * @note Um único bloco contíguo. Nada é liberado individualmente: reiniciarArena()
+ *       devolve tudo de uma vez, em O(1), para reutilizar o bloco no próximo jogo.
+ */
+typedef struct {
+    unsigned char* base;
+    size_t usado;
+    size_t capacidade;
+} Arena;
+
+/**
+ * @brief Conjunto de arenas pré-dimensionadas para simulações em lote.
+ * @note Cada thread obtém uma arena, joga as suas partidas nela e a devolve.
+ */
+typedef struct {
+    Arena* arenas;
+    int* livres;         // Pilha de índices das arenas disponíveis
+    int num_livres;
+    int quantidade;
+    pthread_mutex_t trava;
+} PoolArenas;
+
+/**
+ * @brief Conjunto de territórios alterados desde a última exibição do mapa.
+ * @note Preenchido por definirTropas() e transferirTerritorio(); 'marcado'
+ *       evita duplicatas, então cada território entra no máximo uma vez.
+ */
+typedef struct {
+    int* itens;
+    unsigned char* marcado;
+    int quantidade;
+} ConjuntoAlterados;
+
+/**
+ * @brief Cabeçalho comum ao diário de batalhas e ao seu índice (.idx).
+ */
+typedef struct {
+    char magica[8];                  // "WARLOG\0"
+    uint32_t versao;
+    uint32_t tamanho;                // Territórios do mapa
+    uint32_t intervalo_instantaneos; // Eventos entre instantâneos no .idx
+    uint32_t reservado;
+    uint64_t semente;
+} CabecalhoDiario;
+
+/**
+ * @brief Instantâneo no .idx, seguido de dono[tamanho] e tropas[tamanho] (alinhado a 8 bytes).
+ * @note Guarda o estado do decodificador para retomar a leitura do log dali.
+ */
+typedef struct {
+    uint64_t evento;           // Eventos já aplicados no instantâneo
+    uint64_t deslocamento;     // Posição, no log, do evento seguinte
+    uint64_t posicao_gerador;  // Valores sorteados até o instantâneo
+    uint32_t atacante_anterior;
+    uint32_t reservado;
+} EntradaIndiceDiario;
+
+/**
+ * @brief Diário de batalhas aberto para gravação (ver registrarBatalha()).
+ * @note Os eventos se acumulam no buffer e vão para o disco em blocos de 64 KB.
+ */
+typedef struct {
+    int fd_log;
+    int fd_indice;
+    unsigned char buffer[TAMANHO_BUFFER_DIARIO];
+    size_t usado;
+    uint64_t deslocamento;     // Bytes do log já emitidos (gravados ou no buffer)
+    uint64_t eventos;
+    int atacante_anterior;
+    uint64_t posicao_anterior;
+    int falhou;                // Após um erro de escrita, nada mais é gravado
+} DiarioBatalhas;
+
+/**
+ * @brief Resultado de reconstruirDiario().
+ */
+typedef struct {
+    uint64_t evento;          // Eventos aplicados no mapa devolvido
+    uint64_t partida;         // Evento do instantâneo usado como ponto de partida
+    uint64_t posicao_gerador; // Valores sorteados até 'evento'
+    uint64_t semente;
+    double segundos;          // Tempo de decodificação e aplicação
+} ResumoReproducao;
+
+/**
+ * @brief Bloco de TERRITORIOS_POR_BLOCO territórios de um retrato, compartilhado por contagem de referências.
+ */
+typedef struct {
+    int referencias;
+    CorId dono[TERRITORIOS_POR_BLOCO];
+    int tropas[TERRITORIOS_POR_BLOCO];
+} BlocoRetrato;
+
+/**
+ * @brief Nó interno da árvore dos retratos, compartilhado por contagem de referências.
+ * @note Os filhos são blocos no nível 0 e nós nos demais; NULL além do fim do mapa.
+ */
+typedef struct NoRetrato {
+    int referencias;
+    union {
+        struct NoRetrato* no;
+        BlocoRetrato* bloco;
+    } filhos[RAMOS_POR_NO];
+} NoRetrato;
+
+/**
+ * @brief Retrato persistente de dono e tropas: a raiz de uma árvore de altura fixa,
+ *        com cópia na escrita.
+ * @note Capturar só guarda a raiz viva (O(1)); o caminho da raiz até um bloco é
+ *       copiado quando o mapa altera o bloco pela primeira vez depois da captura.
+ */
+typedef struct {
+    int referencias;
+    int tamanho;
+    int altura;      // Níveis de nós acima dos blocos
+    NoRetrato* raiz;
+} RetratoMapa;
+
+/**
+ * @brief Retratos de um mapa vivo: a árvore que o espelha, o último retrato e a
+ *        lista de passos para desfazer/refazer.
+ * @note A árvore viva é atualizada por definirTropas() e transferirTerritorio(),
+ *       como os alterados, e compartilha com os retratos o que não mudou.
+ */
+typedef struct {
+    NoRetrato* vivo;
+    int altura;
+    RetratoMapa* ultimo;           // Último retrato capturado ou restaurado; NULL se o mapa mudou desde então
+    RetratoMapa* passos[PASSOS_HISTORICO];
+    int num_passos;
+    int cursor;                    // Passo que corresponde ao estado atual
+} HistoricoMapa;
+
+/**
+ * @brief Regras de batalha disponíveis, escolhidas uma vez por partida (--regra).
+ * @note Cada regra vira um núcleo de batalha próprio, gerado em tempo de compilação
+ *       (ver DEFINIR_REGRA_BATALHA). REGRA_DUELO é o valor zero, então mapas
+ *       temporários montados na pilha usam a regra original sem configuração.
+ */
+typedef enum {
+    REGRA_DUELO,            // 1 dado contra 1; o defensor perde metade das tropas
+    REGRA_CLASSICA,         // Até 3 dados contra 2; cada par comparado custa 1 tropa
+    REGRA_BRASILEIRA,       // Até 3 dados contra 3, como no WAR de tabuleiro
+    REGRA_EMPATE_ATACANTE,  // Como a clássica, mas o empate favorece o atacante
+    TOTAL_REGRAS_BATALHA
+} RegraBatalha;
+
+/**
+ * @brief Mapa em estrutura de vetores (SoA): dono e tropas ficam em vetores
+ *        contíguos, e os nomes ficam à parte, lidos apenas na exibição.
+ * @note As varreduras de missão tocam só 5 bytes por território (dono + tropas).
+ *       Com o nome no pool, cada território custa 9 bytes, mais o texto de cada
+ *       nome distinto uma única vez.
+ */
+typedef struct {
+    int tamanho;
+    CorId* dono;           // Cor do exército dominante de cada território
+    int* tropas;           // Tropas de cada território
+    NomeTerritorio* nomes; // Nomes (dados frios): deslocamentos em pool_nomes
+    PoolNomes* pool_nomes; // Compartilhado pelos clones
+    AgregadosMapa* agregados;    // NULL em mapas temporários (ex.: simulações)
+    GrafoFronteiras* fronteiras; // NULL: qualquer território pode atacar qualquer outro
+    RegioesMapa* regioes;        // Exige fronteiras e agregados
+    ConjuntoAlterados* alterados; // NULL: alterações não são rastreadas
+    DiarioBatalhas* diario;      // NULL: batalhas não são registradas
+    HistoricoMapa* historico;    // NULL: sem retratos nem desfazer/refazer (sempre no heap)
+    RegraBatalha regra;          // Regra de batalha da partida (copiada pelos clones)
+    Arena* arena;                // Arena da sessão (NULL: estruturas alocadas no heap)
+    void* mapeamento;            // Arquivo .wmap mapeado (NULL se alocado com calloc)
+    size_t tamanho_mapeamento;
+} Mapa;
+
+/**
+ * @brief Cabeçalho do formato binário de mapa (.wmap).
+ * @note Seções alinhadas a ALINHAMENTO_SECAO bytes: cores (MAX_COR bytes cada),
+ *       dono (1 byte), tropas (int32), nomes (deslocamentos uint32), o texto do
+ *       pool de nomes e, se houver fronteiras, o grafo CSR (inicio e vizinhos,
+ *       int32). Inteiros na ordem de bytes da máquina que gravou, conferida por
+ *       marca_ordem.
+ */
+typedef struct {
+    char magica[8];          // "WARMAPA\0"
+    uint32_t versao;
+    uint32_t marca_ordem;    // MARCA_ORDEM_BYTES
+    uint32_t num_cores;
+    uint32_t reservado;
+    uint64_t tamanho;        // Número de territórios
+    uint64_t num_vizinhos;   // Entradas em vizinhos[] (0 = sem fronteiras)
+    uint64_t secao_cores;
+    uint64_t secao_dono;
+    uint64_t secao_tropas;
+    uint64_t secao_nomes;
+    uint64_t secao_texto_nomes;
+    uint64_t tamanho_texto_nomes; // Bytes do pool; o primeiro é o nome vazio
+    uint64_t secao_inicio;
+    uint64_t secao_vizinhos;
+    uint64_t tamanho_arquivo;
+} CabecalhoMapaBinario;
+
+/**
+ * @brief Tipos de missão. Cada tipo tem um avaliador na tabela avaliadoresMissao.
+ */
+typedef enum {
+    MISSAO_TERRITORIOS_SEGUIDOS,   // Ter 'quantidade' territórios seguidos
+    MISSAO_ELIMINAR_COR,           // A cor 'cor_alvo' não pode ter territórios
+    MISSAO_CONQUISTAR_TERRITORIOS, // Ter pelo menos 'quantidade' territórios
+    MISSAO_TERRITORIOS_FORTES,     // 'quantidade' territórios com mais de 'limiar_tropas'
+    MISSAO_DOMINAR_MAPA,           // Ter todos os territórios
+    TOTAL_TIPOS_MISSAO
+} TipoMissao;
+
+/**
+ * @brief Modos de exibição do mapa.
+ */
+typedef enum {
+    VISAO_COMPLETA,  // Todos os territórios que passam nos filtros (paginados)
+    VISAO_ALTERADOS  // Apenas os territórios alterados desde a última exibição
+} ModoVisao;
+
+/**
+ * @brief O que exibirMapa() mostra: modo, página e filtros.
+ */
+typedef struct {
+    int modo;          // ModoVisao
+    int pagina;        // Base 0; usada quando linhas > 0
+    int linhas;        // Linhas por página (0 = sem paginação)
+    CorId cor;         // COR_INVALIDA = todas as cores
+    int tropas_acima;  // Apenas territórios com mais tropas que isto (0 = todos)
+} FiltroMapa;
+
+/**
+ * @brief Buffer de saída reutilizado entre exibições e descarregado com um único write().
+ */
+typedef struct {
+    char* dados;
+    size_t usado;
+    size_t capacidade;
+} BufferSaida;
+
+/**
+ * @brief Missão já interpretada: tipo e parâmetros, sem texto (8 bytes).
+ * @note O texto é gerado por descreverMissao() apenas para exibição.
+ */
+typedef struct {
+    unsigned char tipo;     // TipoMissao
+    CorId cor_alvo;         // Usada por MISSAO_ELIMINAR_COR
+    uint16_t quantidade;    // Número de territórios exigido
+    int32_t limiar_tropas;  // Usado por MISSAO_TERRITORIOS_FORTES
+} Missao;
+
+/**
+ * @brief Resultado de uma rodada de batalha, preenchido pelo motor sem E/S.
+ * @note dado_ataque == 0 indica que o pedido era invalido e nao foi resolvido.
+ *       Nas regras com vários dados, guardam-se os maiores de cada lado.
+ */
+typedef struct {
+    int dado_ataque;
+    int dado_defesa;
+    int perdas_atacante;
+    int perdas_defensor;
+    int conquista; // 1 se o defensor foi conquistado nesta rodada
+} ResultadoBatalha;
+
+/**
+ * @brief Resultado de um ataque relâmpago (blitz): o cerco inteiro, somado rodada a rodada.
+ * @note Os totais são os mesmos que as rodadas avulsas de resolverBatalha() produziriam;
+ *       só os dados de cada rodada não existem.
+ */
+typedef struct {
+    int rodadas;          // Rodadas de dados do cerco
+    int vitorias;         // Rodadas vencidas pelo atacante
+    int perdas_atacante;
+    int perdas_defensor;
+    int conquista;
+} ResultadoBlitz;
+
+/**
+ * @brief Motivos pelos quais um ataque do jogador é recusado (ver validarAtaque()).
+ */
+typedef enum {
+    ATAQUE_VALIDO,
+    ATAQUE_PROPRIO_TERRITORIO,
+    ATAQUE_TERRITORIO_ALHEIO,
+    ATAQUE_SEM_TROPAS,
+    ATAQUE_MESMO_EXERCITO,
+    ATAQUE_SEM_FRONTEIRA
+} ErroAtaque;
+
+/**
+ * @brief Leitor de linhas por blocos grandes com read(), sem stdio (modo script).
+ * @note As linhas são devolvidas no próprio buffer, terminadas em '\0'; o buffer
+ *       cresce se uma linha não couber nele.
+ */
+typedef struct {
+    int fd;
+    char* dados;
+    size_t inicio;     // Início da próxima linha
+    size_t fim;        // Bytes válidos em dados
+    size_t capacidade;
+    int fim_arquivo;
+} LeitorLinhas;
+
+/**
+ * @brief Operações do protocolo do servidor de sessões.
+ */
+typedef enum {
+    OP_NOVA_SESSAO = 1, // Cria (ou recria) a sessão da conexão a partir do mapa modelo
+    OP_ATACAR,          // Uma rodada de batalha do jogador
+    OP_VERIFICAR,       // Verifica a missão
+    OP_CONSULTAR        // Dono e tropas de um território
+} OperacaoServidor;
+
+typedef enum {
+    RESPOSTA_OK,
+    RESPOSTA_SEM_SESSAO,  // OP_NOVA_SESSAO ainda não foi enviado
+    RESPOSTA_RECUSADO,    // Ataque recusado; o motivo (ErroAtaque) vai em dado_ataque
+    RESPOSTA_INVALIDO,    // Operação desconhecida ou território fora do mapa
+    RESPOSTA_SEM_MEMORIA
+} StatusResposta;
+
+/**
+ * @brief Pedido do protocolo (12 bytes, na ordem de bytes da máquina: o socket é local).
+ */
+typedef struct {
+    uint8_t operacao;     // OperacaoServidor
+    uint8_t reservado[3];
+    uint32_t a;           // NOVA_SESSAO: semente (32 bits baixos); ATACAR: atacante; CONSULTAR: território
+    uint32_t b;           // NOVA_SESSAO: semente (32 bits altos); ATACAR: defensor
+} PedidoServidor;
+
+/**
+ * @brief Resposta do protocolo (16 bytes), uma por pedido, na mesma ordem.
+ */
+typedef struct {
+    uint8_t operacao;
+    uint8_t status;        // StatusResposta
+    uint8_t dado_ataque;   // RESPOSTA_RECUSADO: motivo (ErroAtaque)
+    uint8_t dado_defesa;
+    int32_t valor_a;       // Tropas do atacante; NOVA_SESSAO: territórios; CONSULTAR: tropas
+    int32_t valor_b;       // Tropas do defensor; CONSULTAR: dono (CorId)
+    uint8_t conquista;
+    uint8_t missao_cumprida;
+    uint16_t reservado;
+} RespostaServidor;
+
+/**
+ * @brief Par atacante/defensor (índices base 0) para o motor em lote.
+ */
+typedef struct {
+    int atacante;
+    int defensor;
+} PedidoAtaque;
+
+/**
+ * @brief Estado do gerador pseudoaleatório (xoshiro256**).
+ * @note Cada jogo e cada thread possui o seu próprio gerador; nada é global.
+ */
+typedef struct {
+    uint64_t s[4];
+    uint64_t posicao; // Valores de 64 bits já gerados (registrada no diário)
+} GeradorAleatorio;
+
+// Núcleos de uma regra de batalha: uma rodada, e um cerco inteiro só com os totais
+typedef void (*FuncaoRodadaBatalha)(int tropas_atacante, int tropas_defensor, ResultadoBatalha* resultado,
+                                    GeradorAleatorio* gerador);
+typedef void (*FuncaoCercoBatalha)(int tropas_atacante, int tropas_defensor, ResultadoBlitz* resultado,
+                                   GeradorAleatorio* gerador);
+
+/**
+ * @brief Uma regra de batalha e os seus núcleos especializados (ver regras_batalha).
+ */
+typedef struct {
+    const char* nome;
+    const char* descricao;
+    int max_ataque;         // Dados do atacante (até tropas - 1)
+    int max_defesa;         // Dados do defensor (até as tropas)
+    int perde_metade;       // 1: a vitória custa ao defensor metade das tropas (duelo)
+    int empate_atacante;    // 1: dados iguais contam como vitória do atacante
+    FuncaoRodadaBatalha sortear;
+    FuncaoCercoBatalha sitiar;
+} RegraBatalhaInfo;
+
+/**
+ * @brief Nó da árvore de busca do adversário (MCTS). O nó guarda o lance que leva a ele.
+ * @note Os filhos ficam contíguos no conjunto de nós pré-alocado da thread.
+ */
+typedef struct {
+    int32_t atacante;       // -1: passar a vez
+    int32_t defensor;
+    int32_t primeiro_filho; // -1: ainda não expandido
+    int32_t num_filhos;
+    int32_t visitas;
+    float soma;             // Recompensa acumulada da cor que fez o lance
+} NoMcts;
+
+/**
+ * @brief Adversário controlado pelo computador: uma arena por thread e o tempo por lance.
+ */
+typedef struct {
+    PoolArenas arenas;
+    int num_threads;
+    int tempo_ms;
+} AdversarioMcts;
+
+/**
+ * @brief Lance escolhido pela busca (atacante == -1 significa passar a vez).
+ */
+typedef struct {
+    int atacante;
+    int defensor;
+    long long simulacoes; // Simulações somadas de todas as threads
+} LanceIa;
+
+/**
+ * @brief Resultado de uma estimativa de Monte Carlo de um cerco completo.
+ */
+typedef struct {
+    long long ensaios;
+    double prob_conquista;
+    double ic_conquista_inf, ic_conquista_sup; // Intervalo de confiança de 95%
+    double tropas_restantes;                   // Média de tropas do atacante ao fim
+    double ic_tropas_inf, ic_tropas_sup;
+} EstimativaConquista;
+
+/**
+ * @brief Resultado exato de um cerco completo para um par (atacante, defensor).
+ */
+typedef struct {
+    double prob_conquista;
+    double perdas_atacante; // Tropas do atacante perdidas em média
+    double perdas_defensor; // Tropas do defensor perdidas em média
+} CelulaProbabilidade;
+
+/**
+ * @brief Coluna da tabela (tropas do defensor fixas), indexada pelas tropas do atacante.
+ */
+typedef struct {
+    CelulaProbabilidade* celulas;
+    int preenchidas; // Células [0, preenchidas) já calculadas
+    int capacidade;
+} ColunaProbabilidade;
+
+/**
+ * @brief Tabela de probabilidades exatas, estendida sob demanda e indexada pelas
+ *        tropas do defensor. Inicialize com { 0 }.
+ */
+typedef struct {
+    ColunaProbabilidade* colunas;
+    int num_colunas;
+} TabelaProbabilidades;
+
+/**
+ * @brief Fases do turno medidas pela instrumentação (compile com -DWAR_INSTRUMENTACAO).
+ * @note As medições se aninham: o tempo "próprio" de uma fase exclui as fases
+ *       medidas dentro dela (ex.: atacar() dentro de faseDeAtaque()).
+ */
+typedef enum {
+    FASE_ENTRADA_ATAQUE, // faseDeAtaque(): leitura e validação dos IDs
+    FASE_ATAQUE,         // atacar(): batalha e mensagens
+    FASE_BATALHA,        // resolverBatalha(): motor sem E/S
+    FASE_MISSAO,         // verificarMissao()
+    FASE_EXIBICAO,       // exibirMapa(): formatação no buffer
+    FASE_ESCRITA,        // descarregarSaida(): write() no terminal
+    FASE_ESTIMATIVA,     // estimarConquista()
+    FASE_TURNO_IA,       // turnoDosAdversarios()
+    FASE_BUSCA_MCTS,     // Busca de uma thread do adversário
+    TOTAL_FASES
+} FaseInstrumentada;
+
+/**
+ * @brief Contadores de eventos da instrumentação.
+ */
+typedef enum {
+    CONTADOR_BATALHAS,
+    CONTADOR_CONQUISTAS,
+    CONTADOR_LINHAS_EXIBIDAS,
+    CONTADOR_BYTES_ESCRITOS,
+    CONTADOR_SIMULACOES_MCTS,
+    TOTAL_CONTADORES
+} ContadorInstrumentado;
+
+#ifdef WAR_INSTRUMENTACAO
+/**
+ * @brief Estatísticas de uma fase, em ciclos (rdtsc em x86; nanossegundos nas demais).
+ */
+typedef struct {
+    uint64_t chamadas;
+    uint64_t total;     // Inclui as fases aninhadas
+    uint64_t proprio;   // Exclui as fases aninhadas
+    uint64_t minimo;
+    uint64_t maximo;
+    uint64_t histograma[BALDES_HISTOGRAMA]; // Balde b: duração em [2^b, 2^(b+1))
+} EstatisticaFase;
+
+/**
+ * @brief Medição em andamento; vive na pilha de quem a abriu com MEDIR_ESCOPO().
+ */
+typedef struct MedicaoEscopo {
+    int fase;
+    uint64_t inicio;
+    uint64_t filhos;                // Ciclos das medições aninhadas já encerradas
+    struct MedicaoEscopo* anterior; // Medição que envolve esta (NULL na mais externa)
+} MedicaoEscopo;
+
+/**
+ * @brief Registro de uma thread: cada thread escreve só no seu, sem travas nem atômicos.
+ * @note Ao fim da thread, o registro é somado ao acumulado global e liberado.
+ */
+typedef struct RegistroInstrumentacao {
+    EstatisticaFase fases[TOTAL_FASES];
+    uint64_t contadores[TOTAL_CONTADORES];
+    MedicaoEscopo* atual;
+    struct RegistroInstrumentacao* proximo; // Lista dos registros de threads vivas
+} RegistroInstrumentacao;
+#endif
+
+// ============================================================================
+// --- Protótipos de Funções ---
+// ============================================================================
+
+// Gerenciamento de Memória
+Mapa* alocarMapa(Arena* sessao, int tamanho);
+void liberarMemoria(Mapa* mapa);
+
+// Arenas de Sessão
+int criarArena(Arena* arena, size_t capacidade);
+void* alocarNaArena(Arena* arena, size_t tamanho);
+void reiniciarArena(Arena* arena);
+void destruirArena(Arena* arena);
+size_t tamanhoArenaSessao(int tamanho, int com_vetores, int com_grade);
+size_t tamanhoArenaClone(int tamanho);
+Mapa* clonarMapa(Arena* arena, const Mapa* modelo);
+int criarPoolArenas(PoolArenas* pool, int quantidade, size_t capacidade);
+Arena* obterArena(PoolArenas* pool);
+void devolverArena(PoolArenas* pool, Arena* arena);
+void destruirPoolArenas(PoolArenas* pool);
+
+// Pool de Nomes dos Territórios
+int iniciarPoolNomes(PoolNomes* pool);
+NomeTerritorio adicionarNome(PoolNomes* pool, const char* nome, size_t comprimento);
+void liberarPoolNomes(PoolNomes* pool);
+
+// Mapa Binário (.wmap) e Conversor CSV
+int salvarMapaBinario(const Mapa* mapa, const TabelaCores* cores, const char* caminho);
+Mapa* carregarMapaBinario(const char* caminho, TabelaCores* cores, Arena* sessao);
+int converterCsvParaBinario(const char* entrada, const char* saida);
+
+// Setup e Exibição
+void cadastrarTerritorios(Mapa* mapa, TabelaCores* cores);
+void exibirMapa(Mapa* mapa, const TabelaCores* cores, const FiltroMapa* filtro, BufferSaida* saida);
+void escolherVisao(const TabelaCores* cores, FiltroMapa* filtro);
+void exibirMissao(const Missao* missao, const TabelaCores* cores);
+const char* descreverMissao(const Missao* missao, const TabelaCores* cores, char* destino, size_t tamanho);
+
+// Lógica do Jogo (Missões e Batalha)
+void atribuirMissao(Missao* destino, const Missao missoes[], int totalMissoes, GeradorAleatorio* gerador);
+void prepararMissao(Mapa* mapa, const Missao* missao);
+int verificarMissao(const Missao* missao, const Mapa* mapa, CorId cor_jogador);
+void faseDeAtaque(Mapa* mapa, CorId cor_jogador, const TabelaCores* cores, GeradorAleatorio* gerador, int blitz);
+void atacar(Mapa* mapa, int atacante, int defensor, const TabelaCores* cores, GeradorAleatorio* gerador);
+void atacarBlitz(Mapa* mapa, int atacante, int defensor, const TabelaCores* cores, GeradorAleatorio* gerador);
+ErroAtaque validarAtaque(const Mapa* mapa, CorId cor_jogador, int atacante, int defensor);
+
+// Modo Script (comandos lidos em blocos, sem scanf nem prompts)
+int abrirLeitor(LeitorLinhas* leitor, const char* caminho);
+char* proximaLinha(LeitorLinhas* leitor, size_t* tamanho);
+void fecharLeitor(LeitorLinhas* leitor);
+int executarScript(Mapa* mapa, const TabelaCores* cores, const Missao* missao, CorId cor_jogador,
+                   GeradorAleatorio* gerador, AdversarioMcts* ia, const char* caminho);
+
+// Agregados por Cor (atualizados incrementalmente)
+int inicializarAgregados(Mapa* mapa);
+int registrarLimiar(Mapa* mapa, int limiar);
+int buscarLimiar(const Mapa* mapa, int limiar);
+void definirTropas(Mapa* mapa, int territorio, int valor);
+void transferirTerritorio(Mapa* mapa, int territorio, CorId nova_cor);
+int conferirAgregados(const Mapa* mapa);
+void liberarAgregados(Mapa* mapa);
+
+// Territórios Alterados e Buffer de Saída
+int inicializarAlterados(Mapa* mapa);
+void limparAlterados(Mapa* mapa);
+void liberarAlterados(Mapa* mapa);
+void anexarSaida(BufferSaida* saida, const char* formato, ...);
+void descarregarSaida(BufferSaida* saida);
+void liberarSaida(BufferSaida* saida);
+
+// Retratos do Mapa (cópia na escrita) e Histórico de Desfazer/Refazer
+int iniciarHistorico(Mapa* mapa);
+void encerrarHistorico(Mapa* mapa);
+RetratoMapa* capturarRetrato(Mapa* mapa);
+int restaurarRetrato(Mapa* mapa, RetratoMapa* retrato);
+void liberarRetrato(RetratoMapa* retrato);
+int registrarPasso(Mapa* mapa);
+int desfazerPasso(Mapa* mapa);
+int refazerPasso(Mapa* mapa);
+
+// Fronteiras (CSR) e Regiões Contíguas
+GrafoFronteiras* criarFronteiras(Arena* arena, int tamanho, const int (*arestas)[2], int num_arestas);
+GrafoFronteiras* criarFronteirasEmGrade(Arena* arena, int tamanho, int* colunas);
+int saoVizinhos(const Mapa* mapa, int a, int b);
+void liberarFronteiras(GrafoFronteiras* grafo);
+int inicializarRegioes(Mapa* mapa);
+void atualizarRegioes(Mapa* mapa, int territorio, CorId antiga);
+int maiorRegiao(const Mapa* mapa, CorId cor);
+int conferirRegioes(const Mapa* mapa);
+void liberarRegioes(Mapa* mapa);
+
+// Varreduras do Mapa (SIMD com alternativa escalar)
+int contarTerritoriosDaCor(const Mapa* mapa, CorId cor);
+int contarTerritoriosComMaisTropas(const Mapa* mapa, CorId cor, int limiar);
+
+// Tabela Exata de Probabilidades (cerco completo, calculada por programação dinâmica)
+const CelulaProbabilidade* consultarTabela(TabelaProbabilidades* tabela, int tropas_atacante,
+                                           int tropas_defensor);
+double consultarProbabilidadeConquista(TabelaProbabilidades* tabela, int tropas_atacante,
+                                       int tropas_defensor);
+int consultarPerdasEsperadas(TabelaProbabilidades* tabela, int tropas_atacante, int tropas_defensor,
+                             double* perdas_atacante, double* perdas_defensor);
+void liberarTabelaProbabilidades(TabelaProbabilidades* tabela);
+
+// Motor de Batalha (sem E/S)
+void resolverBatalha(Mapa* mapa, int atacante, int defensor, ResultadoBatalha* resultado,
+                     GeradorAleatorio* gerador);
+int resolverBatalhasEmLote(Mapa* mapa, const PedidoAtaque* pedidos, int quantidade,
+                           ResultadoBatalha* resultados, GeradorAleatorio* gerador);
+int resolverLoteParalelo(Mapa* mapa, const PedidoAtaque* pedidos, int quantidade, ResultadoBatalha* resultados,
+                         GeradorAleatorio* gerador, int num_threads);
+void resolverBlitz(Mapa* mapa, int atacante, int defensor, ResultadoBlitz* resultado, GeradorAleatorio* gerador);
+int buscarRegraBatalha(const char* nome);
+const char* descreverRegraBatalha(RegraBatalha regra);
+void listarRegrasBatalha(void);
+void compararDadosEmLote(unsigned char* const ataque[3], unsigned char* const defesa[3], int empate_atacante,
+                         int rodadas, unsigned char* perdas_atacante, unsigned char* perdas_defensor);
+int conferirCompararDados(int rodadas, uint64_t semente);
+int conferirLoteParalelo(int tamanho, uint64_t semente);
+
+// Diário de Batalhas (log binário e reprodução)
+int abrirDiario(Mapa* mapa, const TabelaCores* cores, const char* caminho, uint64_t semente);
+void registrarBatalha(Mapa* mapa, int atacante, int defensor, const ResultadoBatalha* resultado,
+                      uint64_t posicao_gerador);
+int fecharDiario(Mapa* mapa);
+void aplicarBatalha(Mapa* mapa, int atacante, int defensor, const ResultadoBatalha* resultado);
+Mapa* reconstruirDiario(const char* caminho, long long ate, TabelaCores* cores, Arena* sessao,
+                        ResumoReproducao* resumo);
+int reproduzirDiario(const char* caminho, long long ate);
+
+// Estimativa de Monte Carlo (multi-thread)
+EstimativaConquista estimarConquista(int tropas_atacante, int tropas_defensor, RegraBatalha regra,
+                                     long long ensaios, int num_threads, uint64_t semente);
+void faseDeEstimativa(const Mapa* mapa, TabelaProbabilidades* tabela, GeradorAleatorio* gerador);
+int numeroDeThreads(void);
+
+// Adversário MCTS (cores controladas pelo computador)
+int criarAdversarioMcts(AdversarioMcts* ia, int tamanho_mapa, int tempo_ms);
+LanceIa escolherLanceMcts(AdversarioMcts* ia, const Mapa* mapa, CorId cor, uint64_t semente);
+void turnoDosAdversarios(Mapa* mapa, CorId cor_jogador, const TabelaCores* cores, AdversarioMcts* ia,
+                         GeradorAleatorio* gerador);
+void destruirAdversarioMcts(AdversarioMcts* ia);
+
+// Servidor de Sessões (socket Unix, epoll) e Cliente de Carga
+int executarServidor(const char* caminho, const Mapa* modelo, const Missao missoes[], int total_missoes,
+                     CorId cor_jogador, int num_trabalhadores);
+int executarCliente(const char* caminho, int conexoes, long long pedidos);
+
+// Torneio de Partidas Automáticas (estratégias plugáveis, multi-thread)
+int executarTorneio(const Mapa* modelo, const TabelaCores* cores, const Missao missoes[], int total_missoes,
+                    CorId cor_jogador, long long partidas, const char* estrategia_jogador,
+                    const char* estrategia_adversarios, uint64_t semente);
+
+// Instrumentação (macros vazias sem WAR_INSTRUMENTACAO)
+#ifdef WAR_INSTRUMENTACAO
+RegistroInstrumentacao* registroDaThread(void);
+void iniciarMedicao(MedicaoEscopo* medicao, int fase);
+void encerrarMedicao(MedicaoEscopo* medicao);
+void exibirInstrumentacao(void);
+int gravarRelatorioInstrumentacao(const char* caminho);
+void relatorioInstrumentacaoAoSair(const char* caminho);
+
+// Mede o restante do bloco atual (uma vez por bloco): a medição se encerra na saída
+// do escopo, inclusive por return, via __attribute__((cleanup))
+#define MEDIR_ESCOPO(fase) \
+    MedicaoEscopo medicao_escopo __attribute__((cleanup(encerrarMedicao))); \
+    iniciarMedicao(&medicao_escopo, (fase))
+#define CONTAR(contador, n) (registroDaThread()->contadores[(contador)] += (uint64_t)(n))
+#else
+#define MEDIR_ESCOPO(fase) ((void)0)
+#define CONTAR(contador, n) ((void)0)
+#endif
+
+// Gerador Aleatório
+void semearGerador(GeradorAleatorio* gerador, uint64_t semente, uint64_t fluxo);
+uint64_t proximoAleatorio(GeradorAleatorio* gerador);
+uint32_t sortearLimitado(GeradorAleatorio* gerador, uint32_t limite);
+int rolarDado(GeradorAleatorio* gerador);
+void rolarVariosDados(GeradorAleatorio* gerador, unsigned char* destino, size_t quantidade);
+
+// Utilitárias
+int lerInteiroDoTeclado(int* valor);
+int lerLinhaDoTeclado(char* destino, size_t tamanho);
+void limparBufferEntrada(void);
+void toUpperString(char* str); // Nova função para conversão
+
+// Tabela de Cores
+CorId registrarCor(TabelaCores* cores, const char* texto);
+CorId buscarCor(const TabelaCores* cores, const char* texto);
+const char* nomeDaCor(const TabelaCores* cores, CorId cor);
+
+// ============================================================================
+// --- Função Principal (main) ---
+// ============================================================================
+
+// WAR_SEM_MAIN omite a main() quando o jogo é incluído por outro programa (ex.: Benchmark.c)
+#ifndef WAR_SEM_MAIN
+int main(int argc, char* argv[]) {
+    // Semente do jogo: --semente N reproduz uma partida; sem ela, usa o relogio
+    uint64_t semente = (uint64_t)time(NULL);
+    const char* arquivo_mapa = NULL;
+    const char* arquivo_diario = NULL;
+    const char* arquivo_reproduzir = NULL;
+    const char* arquivo_script = NULL; // Modo script: comandos em vez do menu
+    const char* socket_servidor = NULL; // Modo servidor: uma sessão por conexão
+    const char* socket_cliente = NULL;  // Gerador de carga contra um servidor
+    int trabalhadores = TRABALHADORES_PADRAO;
+    int conexoes_cliente = CONEXOES_CLIENTE_PADRAO;
+    long long pedidos_cliente = PEDIDOS_CLIENTE_PADRAO;
+    long long partidas_torneio = 0; // Modo torneio: partidas automáticas, sem menus
+    const char* estrategia_jogador = "gulosa";
+    const char* estrategia_adversarios = "aleatoria";
+    const char* nome_regra = "duelo"; // Regra de batalha da partida
+    long long ate_evento = -1;
+    int tempo_ia = 0; // 0: as outras cores não jogam
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--semente") == 0 && i + 1 < argc) {
+            semente = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--mapa") == 0 && i + 1 < argc) {
+            arquivo_mapa = argv[++i];
+        } else if (strcmp(argv[i], "--diario") == 0 && i + 1 < argc) {
+            arquivo_diario = argv[++i];
+        } else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc) {
+            arquivo_script = argv[++i];
+        } else if (strcmp(argv[i], "--servidor") == 0 && i + 1 < argc) {
+            socket_servidor = argv[++i];
+        } else if (strcmp(argv[i], "--trabalhadores") == 0 && i + 1 < argc) {
+            trabalhadores = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cliente") == 0 && i + 1 < argc) {
+            socket_cliente = argv[++i];
+        } else if (strcmp(argv[i], "--conexoes") == 0 && i + 1 < argc) {
+            conexoes_cliente = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pedidos") == 0 && i + 1 < argc) {
+            pedidos_cliente = strtoll(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--torneio") == 0) {
+            partidas_torneio = PARTIDAS_TORNEIO_PADRAO;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) partidas_torneio = strtoll(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--estrategia") == 0 && i + 1 < argc) {
+            estrategia_jogador = argv[++i];
+        } else if (strcmp(argv[i], "--estrategia-adversarios") == 0 && i + 1 < argc) {
+            estrategia_adversarios = argv[++i];
+        } else if (strcmp(argv[i], "--regra") == 0 && i + 1 < argc) {
+            nome_regra = argv[++i];
+        } else if (strcmp(argv[i], "--reproduzir") == 0 && i + 1 < argc) {
+            arquivo_reproduzir = argv[++i];
+        } else if (strcmp(argv[i], "--ia") == 0) {
+            if (tempo_ia == 0) tempo_ia = TEMPO_IA_PADRAO_MS;
+        } else if (strcmp(argv[i], "--tempo-ia") == 0 && i + 1 < argc) {
+            tempo_ia = atoi(argv[++i]);
+            if (tempo_ia <= 0) tempo_ia = TEMPO_IA_PADRAO_MS;
+        } else if (strcmp(argv[i], "--relatorio-desempenho") == 0 && i + 1 < argc) {
+#ifdef WAR_INSTRUMENTACAO
+            relatorioInstrumentacaoAoSair(argv[++i]);
+#else
+            printf("AVISO: '%s' ignorado: compile com -DWAR_INSTRUMENTACAO para medir o desempenho.\n", argv[++i]);
+#endif
+        } else if (strcmp(argv[i], "--ate") == 0 && i + 1 < argc) {
+            ate_evento = strtoll(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--converter") == 0 && i + 2 < argc) {
+            return converterCsvParaBinario(argv[i + 1], argv[i + 2]) ? 0 : 1;
+        }
+    }
+    if (arquivo_reproduzir != NULL) {
+        return reproduzirDiario(arquivo_reproduzir, ate_evento) ? 0 : 1;
+    }
+    if (socket_cliente != NULL) {
+        return executarCliente(socket_cliente, conexoes_cliente, pedidos_cliente) ? 0 : 1;
+    }
+    // A regra é escolhida uma vez: todas as batalhas da partida usam o mesmo núcleo
+    int regra = buscarRegraBatalha(nome_regra);
+    if (regra < 0) {
+        printf("ERRO: Regra de batalha desconhecida '%s'. Disponiveis:\n", nome_regra);
+        listarRegrasBatalha();
+        return 1;
+    }
+    // Os modos script, servidor e torneio não têm cadastro interativo: o mapa vem de um .wmap
+    int interativo = (arquivo_script == NULL && socket_servidor == NULL && partidas_torneio <= 0);
+    if (!interativo && arquivo_mapa == NULL) {
+        printf("ERRO: %s exige --mapa mapa.wmap.\n",
+               arquivo_script != NULL ? "--script" : socket_servidor != NULL ? "--servidor" : "--torneio");
+        return 1;
+    }
+    GeradorAleatorio gerador;
+    semearGerador(&gerador, semente, 0);
+    
+    // As cores são registradas uma vez e comparadas apenas pelo CorId. As cores de
+    // um mapa .wmap vêm primeiro, pois os CorId gravados no arquivo apontam para elas.
+    // Todo o estado da partida fica em uma única arena, liberada de uma vez ao final
+    TabelaCores cores = { .quantidade = 0 };
+    Arena sessao = { 0 };
+    Mapa* mapa = NULL; 
+    if (arquivo_mapa != NULL) {
+        mapa = carregarMapaBinario(arquivo_mapa, &cores, &sessao);
+        if (mapa == NULL) {
+            destruirArena(&sessao);
+            printf("ERRO: Mapa '%s' inexistente ou invalido. Encerrando.\n", arquivo_mapa);
+            return 1;
+        }
+    }
+    CorId cor_jogador = registrarCor(&cores, "AZUL");
+    CorId cor_verde = registrarCor(&cores, "VERDE");
+    if (cor_jogador == COR_INVALIDA) {
+        printf("ERRO: O mapa ja usa todas as %d cores. Encerrando.\n", MAX_CORES);
+        liberarMemoria(mapa);
+        destruirArena(&sessao);
+        return 1;
+    }
+
+    // Missões já interpretadas: tipo, cor alvo, quantidade e limiar de tropas
+    const Missao missoes[TOTAL_MISSOES] = {
+        { MISSAO_TERRITORIOS_SEGUIDOS, COR_INVALIDA, 4, 0 },
+        { MISSAO_ELIMINAR_COR, cor_verde, 0, 0 },
+        { MISSAO_CONQUISTAR_TERRITORIOS, COR_INVALIDA, 3, 0 },
+        { MISSAO_TERRITORIOS_FORTES, COR_INVALIDA, 3, 5 },
+        { MISSAO_DOMINAR_MAPA, COR_INVALIDA, 0, 0 }
+    };
+
+    int num_territorios = 0;
+    Missao missao_jogador;
+    char texto_missao[MAX_MISSAO_LEN];
+    TabelaProbabilidades tabela = { 0 };
+
+    if (interativo) {
+        printf("=======================================================\n");
+        printf("         WAR ESTRUTURADO - DESAFIO FINAL\n");
+        printf("=======================================================\n");
+        printf("Semente do jogo: %llu\n", (unsigned long long)semente);
+    }
+
+    if (mapa == NULL) {
+        printf("Informe o numero total de territorios (Min. 5): ");
+        if (!lerInteiroDoTeclado(&num_territorios) || num_territorios < 5) {
+            printf("Numero de territorios ajustado para 5.\n");
+            num_territorios = 5;
+        }
+        limparBufferEntrada();
+        
+        mapa = alocarMapa(&sessao, num_territorios);
+
+        if (mapa == NULL) {
+            printf("ERRO: Falha ao alocar memoria. Encerrando o programa.\n");
+            destruirArena(&sessao);
+            return 1;
+        }
+    } else if (interativo) {
+        printf("Mapa '%s' carregado: %d territorios.\n", arquivo_mapa, mapa->tamanho);
+    }
+    
+    atribuirMissao(&missao_jogador, missoes, TOTAL_MISSOES, &gerador);
+    if (interativo) {
+        exibirMissao(&missao_jogador, &cores);
+        printf("\n[ATENCAO] Seu exercito e a cor: %s\n", nomeDaCor(&cores, cor_jogador));
+    }
+    
+    // O cadastro registra cada cor (em MAIÚSCULAS) na tabela de cores
+    if (arquivo_mapa == NULL) {
+        cadastrarTerritorios(mapa, &cores);
+    }
+
+    // Fronteiras em grade, se o mapa não trouxe as suas; a partir daqui as missões
+    // leem os agregados e as regiões
+    int colunas_grade = 0;
+    if (mapa->fronteiras == NULL) {
+        mapa->fronteiras = criarFronteirasEmGrade(mapa->arena, mapa->tamanho, &colunas_grade);
+    }
+    if (mapa->fronteiras == NULL || !inicializarAgregados(mapa) || !inicializarRegioes(mapa) ||
+        !inicializarAlterados(mapa)) {
+        printf("ERRO: Falha ao alocar memoria. Encerrando o programa.\n");
+        liberarMemoria(mapa);
+        destruirArena(&sessao);
+        return 1;
+    }
+    mapa->regra = (RegraBatalha)regra;
+    prepararMissao(mapa, &missao_jogador);
+    if (arquivo_diario != NULL && !abrirDiario(mapa, &cores, arquivo_diario, semente)) {
+        printf("AVISO: Nao foi possivel criar o diario '%s'. A partida segue sem registro.\n", arquivo_diario);
+    }
+    if ((interativo || arquivo_script != NULL) && !iniciarHistorico(mapa)) {
+        printf("AVISO: Memoria insuficiente para o historico. Desfazer e hipoteses ficam indisponiveis.\n");
+    }
+    if (colunas_grade > 0 && interativo) {
+        printf("\n[FRONTEIRAS] Os territorios formam uma grade de %d colunas, em ordem de ID.\n", colunas_grade);
+        printf("Cada territorio so pode atacar os vizinhos acima, abaixo, a esquerda e a direita.\n");
+    }
+    if (mapa->regra != REGRA_DUELO && interativo) {
+        printf("\n[REGRA] %s: %s.\n", nome_regra, descreverRegraBatalha(mapa->regra));
+    }
+
+    AdversarioMcts ia = { 0 };
+    if (tempo_ia > 0) {
+        if (!criarAdversarioMcts(&ia, mapa->tamanho, tempo_ia)) {
+            printf("AVISO: Memoria insuficiente para os adversarios. As demais cores nao jogam.\n");
+            tempo_ia = 0;
+        } else if (interativo) {
+            printf("\n[ADVERSARIOS] As demais cores jogam apos cada ataque seu (MCTS, %d ms por lance, %d threads).\n",
+                   tempo_ia, ia.num_threads);
+        }
+    }
+
+    // Mapas grandes são paginados e, após a primeira tabela, só as alterações são reexibidas
+    int mapa_grande = (mapa->tamanho > LIMITE_TABELA_COMPLETA);
+    FiltroMapa visao = { VISAO_COMPLETA, 0, mapa_grande ? LINHAS_POR_PAGINA : 0, COR_INVALIDA, 0 };
+    BufferSaida saida = { 0 };
+
+    int escolha = -1;
+    int vitoria = 0;
+    int codigo_saida = 0;
+    if (partidas_torneio > 0) {
+        codigo_saida = executarTorneio(mapa, &cores, missoes, TOTAL_MISSOES, cor_jogador, partidas_torneio,
+                                       estrategia_jogador, estrategia_adversarios, semente) ? 0 : 1;
+    } else if (socket_servidor != NULL) {
+        codigo_saida = executarServidor(socket_servidor, mapa, missoes, TOTAL_MISSOES, cor_jogador,
+                                        trabalhadores) ? 0 : 1;
+    } else if (!interativo) {
+        codigo_saida = executarScript(mapa, &cores, &missao_jogador, cor_jogador, &gerador,
+                                      tempo_ia > 0 ? &ia : NULL, arquivo_script) ? 0 : 1;
+    }
+    while (interativo && escolha != 0 && !vitoria) {
+        exibirMapa(mapa, &cores, &visao, &saida);
+        if (mapa_grande) visao.modo = VISAO_ALTERADOS;
+        printf("\n--- Menu de Acoes ---\n");
+        printf("1. Iniciar Ataque\n");
+        printf("2. Verificar Missao (Condicao de Vitoria)\n");
+        printf("3. Estimar Chance de Conquista\n");
+        printf("4. Exibir Mapa (Paginas e Filtros)\n");
+        printf("5. Ataque Relampago (ate conquistar ou restar 1 tropa)\n");
+        printf("6. Desfazer Jogada\n");
+        printf("7. Refazer Jogada\n");
+#ifdef WAR_INSTRUMENTACAO
+        printf("8. Estatisticas de Desempenho\n");
+#endif
+        printf("0. Sair do Jogo\n");
+        printf("Sua escolha: ");
+        
+        if (!lerInteiroDoTeclado(&escolha)) {
+            limparBufferEntrada();
+            escolha = -1; 
+        } else {
+            limparBufferEntrada();
+        }
+
+        if (escolha == 1 || escolha == 5) {
+            faseDeAtaque(mapa, cor_jogador, &cores, &gerador, escolha == 5);
+            vitoria = verificarMissao(&missao_jogador, mapa, cor_jogador);
+            if (!vitoria && tempo_ia > 0) {
+                turnoDosAdversarios(mapa, cor_jogador, &cores, &ia, &gerador);
+                if (mapa->agregados->territorios[cor_jogador] == 0) {
+                    printf("\nSeu exercito foi eliminado. Fim de jogo.\n");
+                    escolha = 0;
+                }
+            }
+            registrarPasso(mapa); // A jogada e a resposta dos adversários formam um passo
+        } else if (escolha == 2) {
+            vitoria = verificarMissao(&missao_jogador, mapa, cor_jogador);
+            if (vitoria) {
+                printf("\n=======================================================\n");
+                printf("!!! MISSAO CUMPRIDA: VOCE VENCEU O JOGO !!!\n");
+                printf("=======================================================\n");
+            } else {
+                printf("\nA missao '%s' ainda nao foi cumprida. Continue lutando.\n",
+                       descreverMissao(&missao_jogador, &cores, texto_missao, sizeof(texto_missao)));
+            }
+        } else if (escolha == 3) {
+            faseDeEstimativa(mapa, &tabela, &gerador);
+        } else if (escolha == 4) {
+            escolherVisao(&cores, &visao);
+        } else if (escolha == 6 || escolha == 7) {
+            if (mapa->diario != NULL) {
+                printf("\nDesfazer indisponivel com --diario: o diario registra cada batalha, em ordem.\n");
+            } else if (mapa->historico == NULL) {
+                printf("\nDesfazer indisponivel: o historico nao foi criado.\n");
+            } else if (escolha == 6 ? desfazerPasso(mapa) : refazerPasso(mapa)) {
+                printf("\nJogada %s (passo %d de %d).\n", escolha == 6 ? "desfeita" : "refeita",
+                       mapa->historico->cursor, mapa->historico->num_passos - 1);
+            } else {
+                printf("\nNada para %s.\n", escolha == 6 ? "desfazer" : "refazer");
+            }
+#ifdef WAR_INSTRUMENTACAO
+        } else if (escolha == 8) {
+            exibirInstrumentacao();
+#endif
+        } else if (escolha != 0) {
+            printf("\nOpcao invalida. Tente novamente.\n");
+        }
+
+    }
+
+    if (!fecharDiario(mapa)) {
+        printf("AVISO: Falha ao gravar o diario '%s'.\n", arquivo_diario);
+    }
+    if (tempo_ia > 0) destruirAdversarioMcts(&ia);
+    liberarMemoria(mapa);
+    destruirArena(&sessao);
+    liberarTabelaProbabilidades(&tabela);
+    liberarSaida(&saida);
+    if (interativo) printf("\nMemoria e recursos liberados. Programa finalizado.\n");
+
+    return codigo_saida;
+}
+#endif // WAR_SEM_MAIN
+
+// ============================================================================
+// --- Implementação das Funções de Gerenciamento de Memória ---
+// ============================================================================
+
+/**
+ * @brief Aloca no mapa: na arena da sessão, se houver, ou no heap (zerado, como calloc).
+ */
+static void* alocarNoMapa(const Mapa* mapa, size_t tamanho) {
+    return (mapa->arena != NULL) ? alocarNaArena(mapa->arena, tamanho) : calloc(1, tamanho);
+}
+
+/**
+ * @brief Libera um bloco obtido por alocarNoMapa(); blocos da arena ficam para reiniciarArena().
+ */
+static void liberarNoMapa(const Mapa* mapa, void* bloco) {
+    if (mapa->arena == NULL) free(bloco);
+}
+
+/**
+ * @brief Prepara a arena da sessão para um mapa de 'tamanho' territórios.
+ * @note Reutiliza o bloco (reinício em O(1)) se ele couber; senão, troca por um maior.
+ *       O que estava na arena deixa de ser válido.
+ */
+static int prepararSessao(Arena* sessao, int tamanho, int com_vetores, int com_grade) {
+    size_t necessario = tamanhoArenaSessao(tamanho, com_vetores, com_grade);
+    if (sessao->base != NULL && sessao->capacidade >= necessario) {
+        reiniciarArena(sessao);
+        return 1;
+    }
+    destruirArena(sessao);
+    return criarArena(sessao, necessario);
+}
+
+/**
+ * @brief Aloca o mapa, os seus vetores (dono, tropas e nomes) e o pool de nomes.
+ * @note Todos os territórios começam com o nome vazio.
+ * @param sessao Arena da sessão, preparada aqui com espaço para o mapa e para as
+ *        estruturas do jogo (fronteiras, agregados, regiões). NULL usa o heap.
+ * @return O mapa alocado, ou NULL se faltou memória.
+ */
+Mapa* alocarMapa(Arena* sessao, int tamanho) {
+    if (sessao != NULL && !prepararSessao(sessao, tamanho, 1, 1)) return NULL;
+
+    Mapa* mapa = (sessao != NULL) ? (Mapa*)alocarNaArena(sessao, sizeof(Mapa)) : (Mapa*)calloc(1, sizeof(Mapa));
+    if (mapa == NULL) return NULL;
+
+    mapa->arena = sessao;
+    mapa->tamanho = tamanho;
+    mapa->dono = (CorId*)alocarNoMapa(mapa, (size_t)tamanho * sizeof(CorId));
+    mapa->tropas = (int*)alocarNoMapa(mapa, (size_t)tamanho * sizeof(int));
+    mapa->nomes = (NomeTerritorio*)alocarNoMapa(mapa, (size_t)tamanho * sizeof(NomeTerritorio));
+    mapa->pool_nomes = (PoolNomes*)alocarNoMapa(mapa, sizeof(PoolNomes));
+
+    if (mapa->dono == NULL || mapa->tropas == NULL || mapa->nomes == NULL || mapa->pool_nomes == NULL ||
+        !iniciarPoolNomes(mapa->pool_nomes)) {
+        liberarMemoria(mapa);
+        return NULL;
+    }
+    return mapa;
+}
+
+/**
+ * @brief Libera o mapa. Numa sessão em arena só o arquivo mapeado e o texto do pool
+ *        de nomes são desfeitos aqui; o restante volta de uma vez com
+ *        reiniciarArena() ou destruirArena().
+ */
+void liberarMemoria(Mapa* mapa) {
+    if (mapa == NULL) return;
+
+    fecharDiario(mapa);
+    encerrarHistorico(mapa);
+    if (mapa->mapeamento != NULL) {
+        munmap(mapa->mapeamento, mapa->tamanho_mapeamento);
+    }
+    if (mapa->pool_nomes != NULL) liberarPoolNomes(mapa->pool_nomes);
+    if (mapa->arena != NULL) return;
+
+    liberarRegioes(mapa);
+    liberarFronteiras(mapa->fronteiras);
+    liberarAgregados(mapa);
+    liberarAlterados(mapa);
+    if (mapa->mapeamento == NULL) {
+        free(mapa->dono);
+        free(mapa->tropas);
+        free(mapa->nomes);
+    }
+    free(mapa->pool_nomes);
+    free(mapa);
+}
+
+// ============================================================================
+// --- Implementação das Arenas de Sessão ---
+// ============================================================================
+
+static size_t alinharArena(size_t tamanho) {
+    return (tamanho + ALINHAMENTO_ARENA - 1) & ~(size_t)(ALINHAMENTO_ARENA - 1);
+}
+
+/**
+ * @brief Reserva o bloco da arena, alinhado à linha de cache.
+ * @return 1 em caso de sucesso, 0 se faltou memória.
+ */
+int criarArena(Arena* arena, size_t capacidade) {
+    arena->capacidade = alinharArena(capacidade > 0 ? capacidade : 1);
+    arena->base = (unsigned char*)aligned_alloc(ALINHAMENTO_ARENA, arena->capacidade);
+    arena->usado = 0;
+    if (arena->base == NULL) {
+        arena->capacidade = 0;
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Reserva 'tamanho' bytes zerados no fim da arena, em O(1) mais o memset.
+ * @return O bloco, ou NULL se a arena não comporta o pedido (ela não cresce).
+ */
+void* alocarNaArena(Arena* arena, size_t tamanho) {
+    size_t inicio = alinharArena(arena->usado);
+    if (arena->base == NULL || inicio > arena->capacidade || tamanho > arena->capacidade - inicio) {
+        return NULL;
+    }
+    arena->usado = inicio + tamanho;
+    return memset(arena->base + inicio, 0, tamanho);
+}
+
+/**
+ * @brief Descarta tudo o que foi alocado, em O(1); o bloco é mantido para o próximo jogo.
+ */
+void reiniciarArena(Arena* arena) {
+    arena->usado = 0;
+}
+
+void destruirArena(Arena* arena) {
+    free(arena->base);
+    arena->base = NULL;
+    arena->usado = arena->capacidade = 0;
+}
+
+/**
+ * @brief Bytes que uma sessão de 'tamanho' territórios ocupa na arena: o mapa, as
+ *        fronteiras em grade, os agregados, as regiões e o conjunto de alterados.
+ * @param com_vetores 0 quando dono, tropas e nomes vêm de um arquivo mapeado.
+ * @param com_grade 1 quando as fronteiras serão criadas em grade (criarFronteirasEmGrade()),
+ *        0 quando vêm do arquivo ou o mapa é um clone.
+ */
+size_t tamanhoArenaSessao(int tamanho, int com_vetores, int com_grade) {
+    size_t n = (size_t)(tamanho > 0 ? tamanho : 0);
+    size_t total = alinharArena(sizeof(Mapa)) +
+                   alinharArena(sizeof(GrafoFronteiras)) +
+                   alinharArena(sizeof(AgregadosMapa)) + 2 * alinharArena(n * sizeof(int)) +
+                   alinharArena(sizeof(RegioesMapa)) + 2 * alinharArena(n * sizeof(int)) +
+                   alinharArena(sizeof(ConjuntoAlterados)) + alinharArena(n * sizeof(int)) + alinharArena(n) +
+                   alinharArena(sizeof(PoolNomes));
+    if (com_vetores) {
+        total += alinharArena(n * sizeof(CorId)) + alinharArena(n * sizeof(int)) +
+                 alinharArena(n * sizeof(NomeTerritorio));
+    }
+    if (com_grade) {
+        // Na grade, cada território tem no máximo 4 vizinhos
+        total += alinharArena((n + 1) * sizeof(int)) + alinharArena((4 * n + 1) * sizeof(int));
+    }
+    return total;
+}
+
+/**
+ * @brief Espaço de arena que clonarMapa() usa para um mapa de 'tamanho' territórios.
+ */
+size_t tamanhoArenaClone(int tamanho) {
+    size_t n = (size_t)(tamanho > 0 ? tamanho : 0);
+    return tamanhoArenaSessao(tamanho, 0, 0) + alinharArena(n * sizeof(CorId)) + alinharArena(n * sizeof(int));
+}
+
+/**
+ * @brief Copia dono e tropas do modelo para uma partida independente, com agregados e regiões próprios.
+ * @note Nomes e fronteiras só são lidos durante a partida, então apontam para os do
+ *       modelo, que deve sobreviver ao clone e ter fronteiras. Nada é registrado em diário
+ *       nem rastreado como alterado.
+ * @param arena Arena com pelo menos tamanhoArenaClone() bytes livres.
+ * @return O mapa clonado, ou NULL se a arena não coube.
+ */
+Mapa* clonarMapa(Arena* arena, const Mapa* modelo) {
+    size_t n = (size_t)modelo->tamanho;
+    Mapa* mapa = (Mapa*)alocarNaArena(arena, sizeof(Mapa));
+    if (mapa == NULL) return NULL;
+
+    mapa->arena = arena;
+    mapa->tamanho = modelo->tamanho;
+    mapa->regra = modelo->regra;
+    mapa->dono = (CorId*)alocarNaArena(arena, n * sizeof(CorId));
+    mapa->tropas = (int*)alocarNaArena(arena, n * sizeof(int));
+    if (mapa->dono == NULL || mapa->tropas == NULL) return NULL;
+    memcpy(mapa->dono, modelo->dono, n * sizeof(CorId));
+    memcpy(mapa->tropas, modelo->tropas, n * sizeof(int));
+    mapa->nomes = modelo->nomes;           // Somente leitura
+    mapa->pool_nomes = modelo->pool_nomes; // Somente leitura; liberado só com o modelo
+    mapa->fronteiras = modelo->fronteiras; // Somente leitura
+    if (!inicializarAgregados(mapa) || !inicializarRegioes(mapa)) return NULL;
+    return mapa;
+}
+
+/**
+ * @brief Cria 'quantidade' arenas de 'capacidade' bytes, todas disponíveis.
+ * @return 1 em caso de sucesso, 0 se faltou memória (nada fica alocado).
+ */
+int criarPoolArenas(PoolArenas* pool, int quantidade, size_t capacidade) {
+    memset(pool, 0, sizeof(*pool));
+    pool->arenas = (Arena*)calloc((size_t)quantidade, sizeof(Arena));
+    pool->livres = (int*)malloc((size_t)quantidade * sizeof(int));
+    if (pool->arenas == NULL || pool->livres == NULL || pthread_mutex_init(&pool->trava, NULL) != 0) {
+        free(pool->arenas);
+        free(pool->livres);
+        return 0;
+    }
+
+    pool->quantidade = quantidade;
+    for (int i = 0; i < quantidade; i++) {
+        if (!criarArena(&pool->arenas[i], capacidade)) {
+            destruirPoolArenas(pool);
+            return 0;
+        }
+        pool->livres[pool->num_livres++] = i;
+    }
+    return 1;
+}
+
+/**
+ * @brief Retira uma arena vazia do conjunto (seguro entre threads).
+ * @return A arena, ou NULL se todas estão em uso.
+ */
+Arena* obterArena(PoolArenas* pool) {
+    Arena* arena = NULL;
+
+    pthread_mutex_lock(&pool->trava);
+    if (pool->num_livres > 0) {
+        arena = &pool->arenas[pool->livres[--pool->num_livres]];
+    }
+    pthread_mutex_unlock(&pool->trava);
+    return arena;
+}
+
+/**
+ * @brief Reinicia a arena e a devolve ao conjunto.
+ */
+void devolverArena(PoolArenas* pool, Arena* arena) {
+    reiniciarArena(arena);
+    pthread_mutex_lock(&pool->trava);
+    pool->livres[pool->num_livres++] = (int)(arena - pool->arenas);
+    pthread_mutex_unlock(&pool->trava);
+}
+
+void destruirPoolArenas(PoolArenas* pool) {
+    for (int i = 0; i < pool->quantidade; i++) {
+        destruirArena(&pool->arenas[i]);
+    }
+    if (pool->arenas != NULL) {
+        pthread_mutex_destroy(&pool->trava);
+    }
+    free(pool->arenas);
+    free(pool->livres);
+    memset(pool, 0, sizeof(*pool));
+}
+
+// ============================================================================
+// --- Implementação do Pool de Nomes ---
+// ============================================================================
+
+/**
+ * @brief Prepara um pool vazio, só com o nome vazio no deslocamento 0.
+ * @return 1 em caso de sucesso, 0 se faltou memória (nada fica alocado).
+ */
+int iniciarPoolNomes(PoolNomes* pool) {
+    memset(pool, 0, sizeof(*pool));
+    pool->texto = (char*)malloc(TEXTO_INICIAL_NOMES);
+    pool->tabela = (uint32_t*)malloc(CAPACIDADE_INICIAL_NOMES * sizeof(uint32_t));
+    if (pool->texto == NULL || pool->tabela == NULL) {
+        liberarPoolNomes(pool);
+        return 0;
+    }
+    pool->texto[0] = '\0';
+    pool->usado = 1;
+    pool->capacidade = TEXTO_INICIAL_NOMES;
+    memset(pool->tabela, 0xFF, CAPACIDADE_INICIAL_NOMES * sizeof(uint32_t)); // NOME_INVALIDO
+    pool->capacidade_tabela = CAPACIDADE_INICIAL_NOMES;
+    return 1;
+}
+
+/**
+ * @brief Espalhamento FNV-1a dos 'comprimento' primeiros bytes do nome.
+ */
+static uint32_t espalharNome(const char* nome, size_t comprimento) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < comprimento; i++) {
+        h = (h ^ (unsigned char)nome[i]) * 16777619u;
+    }
+    return h;
+}
+
+/**
+ * @brief Dobra a tabela de espalhamento, reinserindo os deslocamentos guardados.
+ * @return 1 em caso de sucesso, 0 se faltou memória (a tabela antiga continua valendo).
+ */
+static int crescerTabelaNomes(PoolNomes* pool) {
+    uint32_t nova = pool->capacidade_tabela * 2;
+    uint32_t* tabela = (nova > pool->capacidade_tabela) ? (uint32_t*)malloc((size_t)nova * sizeof(uint32_t)) : NULL;
+    if (tabela == NULL) return 0;
+    memset(tabela, 0xFF, (size_t)nova * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < pool->capacidade_tabela; i++) {
+        uint32_t deslocamento = pool->tabela[i];
+        if (deslocamento == NOME_INVALIDO) continue;
+        const char* nome = pool->texto + deslocamento;
+        uint32_t h = espalharNome(nome, strlen(nome)) & (nova - 1);
+        while (tabela[h] != NOME_INVALIDO) h = (h + 1) & (nova - 1);
+        tabela[h] = deslocamento;
+    }
+    free(pool->tabela);
+    pool->tabela = tabela;
+    pool->capacidade_tabela = nova;
+    return 1;
+}
+
+/**
+ * @brief Guarda o nome no pool, ou reaproveita o de um nome igual já guardado.
+ * @note O nome é truncado em MAX_STRING - 1 caracteres, como nos campos de texto.
+ *       Os deslocamentos devolvidos continuam válidos quando o texto cresce.
+ * @return O deslocamento do nome, ou NOME_INVALIDO se faltou memória ou se o
+ *         pool é somente leitura.
+ */
+NomeTerritorio adicionarNome(PoolNomes* pool, const char* nome, size_t comprimento) {
+    comprimento = strnlen(nome, comprimento < MAX_STRING ? comprimento : MAX_STRING - 1);
+    if (comprimento == 0) return 0;
+    if (pool->tabela == NULL) return NOME_INVALIDO;
+    if ((pool->num_nomes + 1) * 2 > pool->capacidade_tabela && !crescerTabelaNomes(pool)) return NOME_INVALIDO;
+
+    uint32_t mascara = pool->capacidade_tabela - 1;
+    uint32_t h = espalharNome(nome, comprimento) & mascara;
+    for (; pool->tabela[h] != NOME_INVALIDO; h = (h + 1) & mascara) {
+        const char* guardado = pool->texto + pool->tabela[h];
+        if (strncmp(guardado, nome, comprimento) == 0 && guardado[comprimento] == '\0') {
+            return pool->tabela[h];
+        }
+    }
+
+    uint64_t necessario = (uint64_t)pool->usado + comprimento + 1;
+    if (necessario >= NOME_INVALIDO) return NOME_INVALIDO;
+    if (necessario > pool->capacidade) {
+        uint64_t nova = (uint64_t)pool->capacidade * 2;
+        if (nova < necessario) nova = necessario;
+        if (nova >= NOME_INVALIDO) nova = NOME_INVALIDO - 1;
+        char* texto = (char*)realloc(pool->texto, (size_t)nova);
+        if (texto == NULL) return NOME_INVALIDO;
+        pool->texto = texto;
+        pool->capacidade = (uint32_t)nova;
+    }
+
+    uint32_t deslocamento = pool->usado;
+    memcpy(pool->texto + deslocamento, nome, comprimento);
+    pool->texto[deslocamento + comprimento] = '\0';
+    pool->usado = (uint32_t)necessario;
+    pool->tabela[h] = deslocamento;
+    pool->num_nomes++;
+    return deslocamento;
+}
+
+/**
+ * @brief Libera o texto e a tabela do pool (não a estrutura, que é do mapa).
+ */
+void liberarPoolNomes(PoolNomes* pool) {
+    if (!pool->externo) free(pool->texto);
+    free(pool->tabela);
+    memset(pool, 0, sizeof(*pool));
+}
+
+/**
+ * @brief Nome do território, lido do pool do mapa.
+ */
+static inline const char* nomeDoTerritorio(const Mapa* mapa, int territorio) {
+    return mapa->pool_nomes->texto + mapa->nomes[territorio];
+}
+
+// ============================================================================
+// --- Implementação das Funções de Missão ---
+// ============================================================================
+
+void atribuirMissao(Missao* destino, const Missao missoes[], int totalMissoes, GeradorAleatorio* gerador) {
+    int indice_sorteado = (int)sortearLimitado(gerador, (uint32_t)totalMissoes);
+    
+    *destino = missoes[indice_sorteado];
+}
+
+/**
+ * @brief Gera o texto de uma missão a partir do seu descritor.
+ * @return O próprio 'destino', para uso direto em printf.
+ */
+const char* descreverMissao(const Missao* missao, const TabelaCores* cores, char* destino, size_t tamanho) {
+    switch (missao->tipo) {
+        case MISSAO_TERRITORIOS_SEGUIDOS:
+            snprintf(destino, tamanho, "Conquistar %d territorios seguidos.", missao->quantidade);
+            break;
+        case MISSAO_ELIMINAR_COR:
+            snprintf(destino, tamanho, "Eliminar todas as tropas da cor %s.",
+                     nomeDaCor(cores, missao->cor_alvo));
+            break;
+        case MISSAO_CONQUISTAR_TERRITORIOS:
+            snprintf(destino, tamanho, "Conquistar um total de %d territorios no mapa.", missao->quantidade);
+            break;
+        case MISSAO_TERRITORIOS_FORTES:
+            snprintf(destino, tamanho, "Garantir que pelo menos %d de seus territorios tenham mais de %d tropas.",
+                     missao->quantidade, missao->limiar_tropas);
+            break;
+        case MISSAO_DOMINAR_MAPA:
+            snprintf(destino, tamanho, "Dominar o mapa inteiro (todos os territorios).");
+            break;
+        default:
+            snprintf(destino, tamanho, "Missao desconhecida.");
+            break;
+    }
+    return destino;
+}
+
+void exibirMissao(const Missao* missao, const TabelaCores* cores) {
+    char texto[MAX_MISSAO_LEN];
+    printf("\n[MISSAO SECRETA]: %s\n", descreverMissao(missao, cores, texto, sizeof(texto)));
+}
+
+/**
+ * @brief Registra nos agregados o que a missão precisa consultar (ex.: o limiar de tropas).
+ * @note Deve ser chamada depois de inicializarAgregados().
+ */
+void prepararMissao(Mapa* mapa, const Missao* missao) {
+    if (missao->tipo == MISSAO_TERRITORIOS_FORTES) {
+        registrarLimiar(mapa, missao->limiar_tropas);
+    }
+}
+
+/**
+ * @brief Territórios de uma cor: O(1) com agregados, varredura SIMD sem eles.
+ */
+static int territoriosDaCor(const Mapa* mapa, CorId cor) {
+    return mapa->agregados ? mapa->agregados->territorios[cor] : contarTerritoriosDaCor(mapa, cor);
+}
+
+static int avaliarTerritoriosSeguidos(const Missao* missao, const Mapa* mapa, CorId cor_jogador) {
+    return maiorRegiao(mapa, cor_jogador) >= missao->quantidade;
+}
+
+static int avaliarEliminarCor(const Missao* missao, const Mapa* mapa, CorId cor_jogador) {
+    (void)cor_jogador;
+    return missao->cor_alvo == COR_INVALIDA || territoriosDaCor(mapa, missao->cor_alvo) == 0;
+}
+
+static int avaliarConquistarTerritorios(const Missao* missao, const Mapa* mapa, CorId cor_jogador) {
+    return territoriosDaCor(mapa, cor_jogador) >= missao->quantidade;
+}
+
+static int avaliarTerritoriosFortes(const Missao* missao, const Mapa* mapa, CorId cor_jogador) {
+    int j = buscarLimiar(mapa, missao->limiar_tropas);
+    int fortes = (j >= 0) ? mapa->agregados->acima[j][cor_jogador]
+                          : contarTerritoriosComMaisTropas(mapa, cor_jogador, missao->limiar_tropas);
+    return fortes >= missao->quantidade;
+}
+
+static int avaliarDominarMapa(const Missao* missao, const Mapa* mapa, CorId cor_jogador) {
+    (void)missao;
+    return territoriosDaCor(mapa, cor_jogador) == mapa->tamanho;
+}
+
+/**
+ * @brief Avaliadores indexados por TipoMissao.
+ */
+static int (*const avaliadoresMissao[TOTAL_TIPOS_MISSAO])(const Missao*, const Mapa*, CorId) = {
+    [MISSAO_TERRITORIOS_SEGUIDOS] = avaliarTerritoriosSeguidos,
+    [MISSAO_ELIMINAR_COR] = avaliarEliminarCor,
+    [MISSAO_CONQUISTAR_TERRITORIOS] = avaliarConquistarTerritorios,
+    [MISSAO_TERRITORIOS_FORTES] = avaliarTerritoriosFortes,
+    [MISSAO_DOMINAR_MAPA] = avaliarDominarMapa
+};
+
+/**
+ * @brief Verifica se a missão do jogador foi cumprida. 
+ * @note Despacha pelo tipo da missão, sem comparar textos. Com agregados, cada
+ *       verificação é O(1); sem eles, cai nas varreduras SIMD.
+ */
+int verificarMissao(const Missao* missao, const Mapa* mapa, CorId cor_jogador) {
+    MEDIR_ESCOPO(FASE_MISSAO);
+#ifdef WAR_VERIFICAR_AGREGADOS
+    if (!conferirAgregados(mapa) || !conferirRegioes(mapa)) abort();
+#endif
+
+    if (missao->tipo >= TOTAL_TIPOS_MISSAO) return 0;
+    return avaliadoresMissao[missao->tipo](missao, mapa, cor_jogador);
+}
+
+// ============================================================================
+// --- Implementação dos Agregados por Cor ---
+// ============================================================================
+
+static void ligarMembro(AgregadosMapa* ag, int territorio, CorId cor) {
+    int cabeca = ag->primeiro[cor];
+    ag->anterior[territorio] = -1;
+    ag->proximo[territorio] = cabeca;
+    if (cabeca >= 0) ag->anterior[cabeca] = territorio;
+    ag->primeiro[cor] = territorio;
+}
+
+static void desligarMembro(AgregadosMapa* ag, int territorio, CorId cor) {
+    int ant = ag->anterior[territorio];
+    int prox = ag->proximo[territorio];
+    if (ant >= 0) ag->proximo[ant] = prox;
+    else ag->primeiro[cor] = prox;
+    if (prox >= 0) ag->anterior[prox] = ant;
+}
+
+/**
+ * @brief Cria os agregados por cor a partir de uma varredura completa do mapa.
+ * @note Chamado uma vez, depois do cadastro. Dali em diante, toda alteração de
+ *       dono ou de tropas passa por transferirTerritorio() e definirTropas().
+ * @return 1 em caso de sucesso, 0 se faltou memória.
+ */
+int inicializarAgregados(Mapa* mapa) {
+    AgregadosMapa* ag = (AgregadosMapa*)alocarNoMapa(mapa, sizeof(AgregadosMapa));
+    if (ag == NULL) return 0;
+
+    ag->proximo = (int*)alocarNoMapa(mapa, (size_t)mapa->tamanho * sizeof(int));
+    ag->anterior = (int*)alocarNoMapa(mapa, (size_t)mapa->tamanho * sizeof(int));
+    if (ag->proximo == NULL || ag->anterior == NULL) {
+        liberarNoMapa(mapa, ag->proximo);
+        liberarNoMapa(mapa, ag->anterior);
+        liberarNoMapa(mapa, ag);
+        return 0;
+    }
+
+    for (int c = 0; c < MAX_CORES; c++) {
+        ag->primeiro[c] = -1;
+    }
+    // Percorre de trás para frente para que cada lista fique em ordem crescente
+    for (int i = mapa->tamanho - 1; i >= 0; i--) {
+        CorId cor = mapa->dono[i];
+        ag->territorios[cor]++;
+        ag->tropas[cor] += mapa->tropas[i];
+        ligarMembro(ag, i, cor);
+    }
+
+    mapa->agregados = ag;
+    return 1;
+}
+
+/**
+ * @brief Passa a manter a contagem de territórios com mais de 'limiar' tropas.
+ * @return O índice do limiar (a linha de agregados->acima que avaliarTerritoriosFortes()
+ *         lê), ou -1 se já há MAX_LIMIARES registrados ou o mapa não tem agregados.
+ */
+int registrarLimiar(Mapa* mapa, int limiar) {
+    AgregadosMapa* ag = mapa->agregados;
+    if (ag == NULL) return -1;
+
+    int existente = buscarLimiar(mapa, limiar);
+    if (existente >= 0) return existente;
+    if (ag->num_limiares >= MAX_LIMIARES) return -1;
+
+    int j = ag->num_limiares++;
+    ag->limiares[j] = limiar;
+    for (int i = 0; i < mapa->tamanho; i++) {
+        ag->acima[j][mapa->dono[i]] += (mapa->tropas[i] > limiar);
+    }
+    return j;
+}
+
+/**
+ * @brief Procura um limiar já registrado.
+ * @return O índice do limiar, ou -1 se ele não é mantido.
+ */
+int buscarLimiar(const Mapa* mapa, int limiar) {
+    const AgregadosMapa* ag = mapa->agregados;
+    for (int j = 0; ag != NULL && j < ag->num_limiares; j++) {
+        if (ag->limiares[j] == limiar) return j;
+    }
+    return -1;
+}
+
+static void espelharNoHistorico(Mapa* mapa, int territorio);
+
+/**
+ * @brief Registra o território no conjunto de alterados (se rastreado) e na
+ *        árvore viva do histórico (se houver).
+ */
+static inline void marcarAlterado(Mapa* mapa, int territorio) {
+    ConjuntoAlterados* alt = mapa->alterados;
+    if (alt != NULL && !alt->marcado[territorio]) {
+        alt->marcado[territorio] = 1;
+        alt->itens[alt->quantidade++] = territorio;
+    }
+    if (mapa->historico != NULL) espelharNoHistorico(mapa, territorio);
+}
+
+/**
+ * @brief Altera as tropas de um território mantendo os agregados da sua cor.
+ */
+void definirTropas(Mapa* mapa, int territorio, int valor) {
+    AgregadosMapa* ag = mapa->agregados;
+    int antigo = mapa->tropas[territorio];
+
+    mapa->tropas[territorio] = valor;
+    marcarAlterado(mapa, territorio);
+    if (ag == NULL) return;
+
+    CorId cor = mapa->dono[territorio];
+    ag->tropas[cor] += valor - antigo;
+    for (int j = 0; j < ag->num_limiares; j++) {
+        ag->acima[j][cor] += (valor > ag->limiares[j]) - (antigo > ag->limiares[j]);
+    }
+}
+
+/**
+ * @brief Troca o dono de um território em O(1), movendo-o entre as listas de membros.
+ */
+void transferirTerritorio(Mapa* mapa, int territorio, CorId nova_cor) {
+    AgregadosMapa* ag = mapa->agregados;
+    CorId antiga = mapa->dono[territorio];
+
+    mapa->dono[territorio] = nova_cor;
+    marcarAlterado(mapa, territorio);
+    if (ag == NULL || antiga == nova_cor) return;
+
+    int tropas = mapa->tropas[territorio];
+    ag->territorios[antiga]--;
+    ag->territorios[nova_cor]++;
+    ag->tropas[antiga] -= tropas;
+    ag->tropas[nova_cor] += tropas;
+    for (int j = 0; j < ag->num_limiares; j++) {
+        int acima = (tropas > ag->limiares[j]);
+        ag->acima[j][antiga] -= acima;
+        ag->acima[j][nova_cor] += acima;
+    }
+    desligarMembro(ag, territorio, antiga);
+    ligarMembro(ag, territorio, nova_cor);
+
+    if (mapa->regioes != NULL) {
+        atualizarRegioes(mapa, territorio, antiga);
+    }
+}
+
+/**
+ * @brief Confere os agregados contra uma varredura completa do mapa.
+ * @note Usada no modo de depuração (-DWAR_VERIFICAR_AGREGADOS).
+ * @return 1 se tudo confere, 0 caso contrário (com mensagem em stderr).
+ */
+int conferirAgregados(const Mapa* mapa) {
+    const AgregadosMapa* ag = mapa->agregados;
+    int ok = 1;
+    if (ag == NULL) return 1;
+
+    for (int c = 0; c < MAX_CORES; c++) {
+        long long tropas = 0;
+        int membros = 0;
+
+        for (int i = ag->primeiro[c]; i >= 0; i = ag->proximo[i]) {
+            if (mapa->dono[i] != c) ok = 0;
+            tropas += mapa->tropas[i];
+            membros++;
+        }
+        if (membros != ag->territorios[c] || tropas != ag->tropas[c] ||
+            contarTerritoriosDaCor(mapa, (CorId)c) != ag->territorios[c]) {
+            ok = 0;
+        }
+        for (int j = 0; j < ag->num_limiares; j++) {
+            if (contarTerritoriosComMaisTropas(mapa, (CorId)c, ag->limiares[j]) != ag->acima[j][c]) {
+                ok = 0;
+            }
+        }
+        if (!ok) {
+            fprintf(stderr, "ERRO: agregados da cor %d divergem da varredura completa.\n", c);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Libera os agregados do mapa.
+ */
+void liberarAgregados(Mapa* mapa) {
+    if (mapa->agregados != NULL) {
+        liberarNoMapa(mapa, mapa->agregados->proximo);
+        liberarNoMapa(mapa, mapa->agregados->anterior);
+        liberarNoMapa(mapa, mapa->agregados);
+        mapa->agregados = NULL;
+    }
+}
+
+// ============================================================================
+// --- Implementação das Fronteiras e Regiões Contíguas ---
+// ============================================================================
+
+/**
+ * @brief Monta o grafo de fronteiras (CSR) a partir de uma lista de arestas.
+ * @note Cada aresta {a, b} (índices base 0) vale nos dois sentidos. A montagem é
+ *       uma contagem seguida de prefixo, sem ordenação.
+ * @param arena Arena da sessão que guarda o grafo (NULL: heap). Numa arena, o
+ *        grafo é marcado como externo e não é liberado por liberarFronteiras().
+ * @return O grafo, ou NULL se faltou memória.
+ */
+GrafoFronteiras* criarFronteiras(Arena* arena, int tamanho, const int (*arestas)[2], int num_arestas) {
+    size_t tamanho_vizinhos = (size_t)(2 * num_arestas > 0 ? 2 * num_arestas : 1) * sizeof(int);
+    GrafoFronteiras* grafo;
+    if (arena != NULL) {
+        grafo = (GrafoFronteiras*)alocarNaArena(arena, sizeof(GrafoFronteiras));
+        if (grafo == NULL) return NULL;
+        grafo->inicio = (int*)alocarNaArena(arena, ((size_t)tamanho + 1) * sizeof(int));
+        grafo->vizinhos = (int*)alocarNaArena(arena, tamanho_vizinhos);
+        grafo->externo = 1;
+    } else {
+        grafo = (GrafoFronteiras*)calloc(1, sizeof(GrafoFronteiras));
+        if (grafo == NULL) return NULL;
+        grafo->inicio = (int*)calloc((size_t)tamanho + 1, sizeof(int));
+        grafo->vizinhos = (int*)malloc(tamanho_vizinhos);
+    }
+    int* posicao = (int*)malloc((size_t)(tamanho > 0 ? tamanho : 1) * sizeof(int));
+    if (grafo->inicio == NULL || grafo->vizinhos == NULL || posicao == NULL) {
+        free(posicao);
+        if (arena == NULL) liberarFronteiras(grafo);
+        return NULL;
+    }
+
+    for (int e = 0; e < num_arestas; e++) {
+        grafo->inicio[arestas[e][0] + 1]++;
+        grafo->inicio[arestas[e][1] + 1]++;
+    }
+    for (int i = 0; i < tamanho; i++) {
+        grafo->inicio[i + 1] += grafo->inicio[i];
+        posicao[i] = grafo->inicio[i];
+    }
+    for (int e = 0; e < num_arestas; e++) {
+        int a = arestas[e][0], b = arestas[e][1];
+        grafo->vizinhos[posicao[a]++] = b;
+        grafo->vizinhos[posicao[b]++] = a;
+    }
+
+    free(posicao);
+    return grafo;
+}
+
+/**
+ * @brief Fronteiras padrão para mapas cadastrados no terminal: os territórios são
+ *        dispostos em uma grade (em ordem de ID) e cada um faz fronteira com os
+ *        vizinhos acima, abaixo, à esquerda e à direita.
+ * @param colunas Recebe a largura da grade, para exibição.
+ */
+GrafoFronteiras* criarFronteirasEmGrade(Arena* arena, int tamanho, int* colunas) {
+    int largura = 1;
+    while (largura * largura < tamanho) largura++;
+    *colunas = largura;
+
+    int (*arestas)[2] = (int (*)[2])malloc((size_t)(2 * tamanho + 1) * sizeof(*arestas));
+    if (arestas == NULL) return NULL;
+
+    int m = 0;
+    for (int i = 0; i < tamanho; i++) {
+        if ((i % largura) + 1 < largura && i + 1 < tamanho) {
+            arestas[m][0] = i;
+            arestas[m++][1] = i + 1;
+        }
+        if (i + largura < tamanho) {
+            arestas[m][0] = i;
+            arestas[m++][1] = i + largura;
+        }
+    }
+
+    GrafoFronteiras* grafo = criarFronteiras(arena, tamanho, (const int (*)[2])arestas, m);
+    free(arestas);
+    return grafo;
+}
+
+/**
+ * @brief Verifica se dois territórios fazem fronteira, em O(grau).
+ * @note Sem grafo de fronteiras, qualquer par é considerado vizinho.
+ */
+int saoVizinhos(const Mapa* mapa, int a, int b) {
+    const GrafoFronteiras* grafo = mapa->fronteiras;
+    if (grafo == NULL) return 1;
+
+    for (int k = grafo->inicio[a]; k < grafo->inicio[a + 1]; k++) {
+        if (grafo->vizinhos[k] == b) return 1;
+    }
+    return 0;
+}
+
+void liberarFronteiras(GrafoFronteiras* grafo) {
+    if (grafo != NULL) {
+        if (!grafo->externo) {
+            free(grafo->inicio);
+            free(grafo->vizinhos);
+        }
+        free(grafo);
+    }
+}
+
+static int encontrarRaiz(RegioesMapa* regioes, int x) {
+    while (regioes->pai[x] != x) {
+        regioes->pai[x] = regioes->pai[regioes->pai[x]]; // Compressão pela metade
+        x = regioes->pai[x];
+    }
+    return x;
+}
+
+/**
+ * @brief Une os conjuntos de 'a' e 'b' (por tamanho).
+ * @return O tamanho do conjunto resultante.
+ */
+static int unirRegioes(RegioesMapa* regioes, int a, int b) {
+    int ra = encontrarRaiz(regioes, a);
+    int rb = encontrarRaiz(regioes, b);
+    if (ra == rb) return regioes->tamanho_conjunto[ra];
+
+    if (regioes->tamanho_conjunto[ra] < regioes->tamanho_conjunto[rb]) {
+        int t = ra; ra = rb; rb = t;
+    }
+    regioes->pai[rb] = ra;
+    regioes->tamanho_conjunto[ra] += regioes->tamanho_conjunto[rb];
+    return regioes->tamanho_conjunto[ra];
+}
+
+/**
+ * @brief Coloca 'territorio' em um conjunto próprio e o une aos vizinhos da mesma cor.
+ * @return O tamanho da região resultante.
+ */
+static int anexarTerritorio(const Mapa* mapa, int territorio) {
+    RegioesMapa* regioes = mapa->regioes;
+    const GrafoFronteiras* grafo = mapa->fronteiras;
+    CorId cor = mapa->dono[territorio];
+    int maior = 1;
+
+    regioes->pai[territorio] = territorio;
+    regioes->tamanho_conjunto[territorio] = 1;
+    for (int k = grafo->inicio[territorio]; k < grafo->inicio[territorio + 1]; k++) {
+        int v = grafo->vizinhos[k];
+        if (mapa->dono[v] == cor) {
+            int t = unirRegioes(regioes, territorio, v);
+            if (t > maior) maior = t;
+        }
+    }
+    return maior;
+}
+
+/**
+ * @brief Refaz as regiões de uma cor percorrendo apenas os seus membros.
+ */
+static void reconstruirRegioesDaCor(const Mapa* mapa, CorId cor) {
+    RegioesMapa* regioes = mapa->regioes;
+    const AgregadosMapa* ag = mapa->agregados;
+    int maior = 0;
+
+    for (int i = ag->primeiro[cor]; i >= 0; i = ag->proximo[i]) {
+        regioes->pai[i] = i;
+        regioes->tamanho_conjunto[i] = 1;
+    }
+    for (int i = ag->primeiro[cor]; i >= 0; i = ag->proximo[i]) {
+        const GrafoFronteiras* grafo = mapa->fronteiras;
+        for (int k = grafo->inicio[i]; k < grafo->inicio[i + 1]; k++) {
+            int v = grafo->vizinhos[k];
+            if (v < i && mapa->dono[v] == cor) unirRegioes(regioes, i, v);
+        }
+    }
+    for (int i = ag->primeiro[cor]; i >= 0; i = ag->proximo[i]) {
+        if (regioes->pai[i] == i && regioes->tamanho_conjunto[i] > maior) {
+            maior = regioes->tamanho_conjunto[i];
+        }
+    }
+    regioes->maior[cor] = maior;
+    regioes->desatualizada[cor] = 0;
+}
+
+/**
+ * @brief Cria a estrutura de regiões contíguas (union-find por cor).
+ * @note Exige fronteiras e agregados já inicializados.
+ * @return 1 em caso de sucesso, 0 se faltou memória ou faltam pré-requisitos.
+ */
+int inicializarRegioes(Mapa* mapa) {
+    if (mapa->fronteiras == NULL || mapa->agregados == NULL) return 0;
+
+    RegioesMapa* regioes = (RegioesMapa*)alocarNoMapa(mapa, sizeof(RegioesMapa));
+    if (regioes == NULL) return 0;
+    regioes->pai = (int*)alocarNoMapa(mapa, (size_t)mapa->tamanho * sizeof(int));
+    regioes->tamanho_conjunto = (int*)alocarNoMapa(mapa, (size_t)mapa->tamanho * sizeof(int));
+    if (regioes->pai == NULL || regioes->tamanho_conjunto == NULL) {
+        liberarNoMapa(mapa, regioes->pai);
+        liberarNoMapa(mapa, regioes->tamanho_conjunto);
+        liberarNoMapa(mapa, regioes);
+        return 0;
+    }
+
+    mapa->regioes = regioes;
+    for (int c = 0; c < MAX_CORES; c++) {
+        regioes->desatualizada[c] = 1; // Calculadas na primeira consulta
+    }
+    return 1;
+}
+
+/**
+ * @brief Atualiza as regiões quando 'territorio' troca da cor 'antiga' para a atual.
+ * @note A cor que ganha o território só faz uniões (quase O(1)). A que perde pode
+ *       ter a região partida; ela é marcada e refeita na próxima consulta, visitando
+ *       apenas os seus membros.
+ */
+void atualizarRegioes(Mapa* mapa, int territorio, CorId antiga) {
+    RegioesMapa* regioes = mapa->regioes;
+    CorId nova = mapa->dono[territorio];
+
+    regioes->desatualizada[antiga] = 1;
+    if (!regioes->desatualizada[nova]) {
+        int tamanho = anexarTerritorio(mapa, territorio);
+        if (tamanho > regioes->maior[nova]) regioes->maior[nova] = tamanho;
+    }
+}
+
+/**
+ * @brief Tamanho da maior região contígua da cor.
+ * @note Sem estrutura de regiões, retorna o total de territórios da cor.
+ */
+int maiorRegiao(const Mapa* mapa, CorId cor) {
+    RegioesMapa* regioes = mapa->regioes;
+    if (regioes == NULL) {
+        return mapa->agregados ? mapa->agregados->territorios[cor] : contarTerritoriosDaCor(mapa, cor);
+    }
+    if (regioes->desatualizada[cor]) {
+        reconstruirRegioesDaCor(mapa, cor);
+    }
+    return regioes->maior[cor];
+}
+
+/**
+ * @brief Confere maiorRegiao() contra uma busca em largura completa (modo de depuração).
+ * @return 1 se tudo confere, 0 caso contrário.
+ */
+int conferirRegioes(const Mapa* mapa) {
+    if (mapa->regioes == NULL) return 1;
+
+    int n = mapa->tamanho;
+    const GrafoFronteiras* grafo = mapa->fronteiras;
+    int* fila = (int*)malloc((size_t)n * sizeof(int));
+    unsigned char* visitado = (unsigned char*)calloc((size_t)n, 1);
+    int maior[MAX_CORES] = { 0 };
+    int ok = 1;
+
+    if (fila == NULL || visitado == NULL) {
+        free(fila);
+        free(visitado);
+        return 1;
+    }
+    for (int s = 0; s < n; s++) {
+        if (visitado[s]) continue;
+        int ini = 0, fim = 0;
+        fila[fim++] = s;
+        visitado[s] = 1;
+        while (ini < fim) {
+            int u = fila[ini++];
+            for (int k = grafo->inicio[u]; k < grafo->inicio[u + 1]; k++) {
+                int v = grafo->vizinhos[k];
+                if (!visitado[v] && mapa->dono[v] == mapa->dono[s]) {
+                    visitado[v] = 1;
+                    fila[fim++] = v;
+                }
+            }
+        }
+        if (fim > maior[mapa->dono[s]]) maior[mapa->dono[s]] = fim;
+    }
+    for (int c = 0; c < MAX_CORES; c++) {
+        if (maiorRegiao(mapa, (CorId)c) != maior[c]) {
+            fprintf(stderr, "ERRO: maior regiao da cor %d diverge da busca completa.\n", c);
+            ok = 0;
+            break;
+        }
+    }
+    free(fila);
+    free(visitado);
+    return ok;
+}
+
+void liberarRegioes(Mapa* mapa) {
+    if (mapa->regioes != NULL) {
+        liberarNoMapa(mapa, mapa->regioes->pai);
+        liberarNoMapa(mapa, mapa->regioes->tamanho_conjunto);
+        liberarNoMapa(mapa, mapa->regioes);
+        mapa->regioes = NULL;
+    }
+}
+
+// ============================================================================
+// --- Implementação das Varreduras do Mapa (SIMD) ---
+// ============================================================================
+
+/*
+ * As varreduras percorrem apenas os vetores dono[] e tropas[]. Em x86-64 há uma
+ * versão AVX2 (escolhida em tempo de execução, se a CPU suportar) e uma SSE2;
+ * nas demais arquiteturas fica só a versão escalar.
+ */
+
+static int contarDaCorEscalar(const CorId* dono, int inicio, int tamanho, CorId cor) {
+    int total = 0;
+    for (int i = inicio; i < tamanho; i++) {
+        total += (dono[i] == cor);
+    }
+    return total;
+}
+
+static int contarAcimaEscalar(const CorId* dono, const int* tropas, int inicio, int tamanho,
+                              CorId cor, int limiar) {
+    int total = 0;
+    for (int i = inicio; i < tamanho; i++) {
+        total += (dono[i] == cor) & (tropas[i] > limiar);
+    }
+    return total;
+}
+
+#if WAR_SIMD_X86
+
+__attribute__((target("avx2")))
+static int contarDaCorAVX2(const CorId* dono, int tamanho, CorId cor) {
+    const __m256i alvo = _mm256_set1_epi8((char)cor);
+    int total = 0;
+    int i = 0;
+
+    for (; i + 32 <= tamanho; i += 32) {
+        __m256i bloco = _mm256_loadu_si256((const __m256i*)(dono + i));
+        uint32_t mascara = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bloco, alvo));
+        total += __builtin_popcount(mascara);
+    }
+    return total + contarDaCorEscalar(dono, i, tamanho, cor);
+}
+
+__attribute__((target("avx2")))
+static int contarAcimaAVX2(const CorId* dono, const int* tropas, int tamanho, CorId cor, int limiar) {
+    const __m256i alvo = _mm256_set1_epi32(cor);
+    const __m256i minimo = _mm256_set1_epi32(limiar);
+    int total = 0;
+    int i = 0;
+
+    for (; i + 8 <= tamanho; i += 8) {
+        // 8 donos (1 byte cada) são estendidos para 32 bits e comparados junto com as tropas
+        __m256i donos = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(dono + i)));
+        __m256i qtd = _mm256_loadu_si256((const __m256i*)(tropas + i));
+        __m256i ok = _mm256_and_si256(_mm256_cmpeq_epi32(donos, alvo), _mm256_cmpgt_epi32(qtd, minimo));
+        total += __builtin_popcount((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(ok)));
+    }
+    return total + contarAcimaEscalar(dono, tropas, i, tamanho, cor, limiar);
+}
+
+static int contarDaCorSSE2(const CorId* dono, int tamanho, CorId cor) {
+    const __m128i alvo = _mm_set1_epi8((char)cor);
+    int total = 0;
+    int i = 0;
+
+    for (; i + 16 <= tamanho; i += 16) {
+        __m128i bloco = _mm_loadu_si128((const __m128i*)(dono + i));
+        total += __builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(bloco, alvo)));
+    }
+    return total + contarDaCorEscalar(dono, i, tamanho, cor);
+}
+
+static int contarAcimaSSE2(const CorId* dono, const int* tropas, int tamanho, CorId cor, int limiar) {
+    const __m128i alvo = _mm_set1_epi32(cor);
+    const __m128i minimo = _mm_set1_epi32(limiar);
+    const __m128i zero = _mm_setzero_si128();
+    int total = 0;
+    int i = 0;
+
+    for (; i + 4 <= tamanho; i += 4) {
+        int32_t quatro;
+        memcpy(&quatro, dono + i, sizeof(quatro));
+        __m128i donos = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(quatro), zero), zero);
+        __m128i qtd = _mm_loadu_si128((const __m128i*)(tropas + i));
+        __m128i ok = _mm_and_si128(_mm_cmpeq_epi32(donos, alvo), _mm_cmpgt_epi32(qtd, minimo));
+        total += __builtin_popcount((unsigned)_mm_movemask_ps(_mm_castsi128_ps(ok)));
+    }
+    return total + contarAcimaEscalar(dono, tropas, i, tamanho, cor, limiar);
+}
+
+#endif
+
+/**
+ * @brief Conta os territórios cujo dono é 'cor'.
+ */
+int contarTerritoriosDaCor(const Mapa* mapa, CorId cor) {
+#if WAR_SIMD_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return contarDaCorAVX2(mapa->dono, mapa->tamanho, cor);
+    }
+    return contarDaCorSSE2(mapa->dono, mapa->tamanho, cor);
+#else
+    return contarDaCorEscalar(mapa->dono, 0, mapa->tamanho, cor);
+#endif
+}
+
+/**
+ * @brief Conta os territórios de 'cor' com mais de 'limiar' tropas.
+ */
+int contarTerritoriosComMaisTropas(const Mapa* mapa, CorId cor, int limiar) {
+#if WAR_SIMD_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return contarAcimaAVX2(mapa->dono, mapa->tropas, mapa->tamanho, cor, limiar);
+    }
+    return contarAcimaSSE2(mapa->dono, mapa->tropas, mapa->tamanho, cor, limiar);
+#else
+    return contarAcimaEscalar(mapa->dono, mapa->tropas, 0, mapa->tamanho, cor, limiar);
+#endif
+}
+
+// ============================================================================
+// --- Implementação do Mapa Binário (.wmap) e do Conversor CSV ---
+// ============================================================================
+
+_Static_assert(sizeof(int) == sizeof(int32_t), "tropas[] e gravado como int32");
+
+static uint64_t alinharSecao(uint64_t deslocamento) {
+    return (deslocamento + ALINHAMENTO_SECAO - 1) & ~(uint64_t)(ALINHAMENTO_SECAO - 1);
+}
+
+static int gravarSecao(FILE* arquivo, uint64_t deslocamento, const void* dados, size_t tamanho) {
+    static const char zeros[ALINHAMENTO_SECAO] = { 0 };
+    long atual = ftell(arquivo);
+    if (atual < 0 || (uint64_t)atual > deslocamento) return 0;
+    if (fwrite(zeros, 1, (size_t)(deslocamento - (uint64_t)atual), arquivo) != deslocamento - (uint64_t)atual) {
+        return 0;
+    }
+    return tamanho == 0 || fwrite(dados, 1, tamanho, arquivo) == tamanho;
+}
+
+/**
+ * @brief Grava o mapa (cores, donos, tropas, nomes com o seu pool e fronteiras) no formato .wmap.
+ * @note Cada seção começa alinhada a ALINHAMENTO_SECAO bytes, para que o arquivo
+ *       possa ser usado diretamente depois de mapeado com mmap.
+ * @return 1 em caso de sucesso, 0 em caso de erro de escrita.
+ */
+int salvarMapaBinario(const Mapa* mapa, const TabelaCores* cores, const char* caminho) {
+    const GrafoFronteiras* grafo = mapa->fronteiras;
+    uint64_t n = (uint64_t)mapa->tamanho;
+    CabecalhoMapaBinario cab;
+
+    memset(&cab, 0, sizeof(cab));
+    memcpy(cab.magica, MAGICA_MAPA, sizeof(cab.magica));
+    cab.versao = VERSAO_MAPA;
+    cab.marca_ordem = MARCA_ORDEM_BYTES;
+    cab.num_cores = (uint32_t)cores->quantidade;
+    cab.tamanho = n;
+    cab.num_vizinhos = grafo ? (uint64_t)grafo->inicio[mapa->tamanho] : 0;
+
+    cab.secao_cores = alinharSecao(sizeof(cab));
+    cab.secao_dono = alinharSecao(cab.secao_cores + (uint64_t)cab.num_cores * MAX_COR);
+    cab.secao_tropas = alinharSecao(cab.secao_dono + n);
+    cab.secao_nomes = alinharSecao(cab.secao_tropas + n * sizeof(int32_t));
+    cab.secao_texto_nomes = alinharSecao(cab.secao_nomes + n * sizeof(NomeTerritorio));
+    cab.tamanho_texto_nomes = mapa->pool_nomes->usado;
+    uint64_t fim = cab.secao_texto_nomes + cab.tamanho_texto_nomes;
+    if (grafo != NULL) {
+        cab.secao_inicio = alinharSecao(fim);
+        cab.secao_vizinhos = alinharSecao(cab.secao_inicio + (n + 1) * sizeof(int32_t));
+        fim = cab.secao_vizinhos + cab.num_vizinhos * sizeof(int32_t);
+    }
+    cab.tamanho_arquivo = fim;
+
+    FILE* arquivo = fopen(caminho, "wb");
+    if (arquivo == NULL) return 0;
+
+    int ok = fwrite(&cab, sizeof(cab), 1, arquivo) == 1 &&
+             gravarSecao(arquivo, cab.secao_cores, cores->nomes, (size_t)cab.num_cores * MAX_COR) &&
+             gravarSecao(arquivo, cab.secao_dono, mapa->dono, (size_t)n) &&
+             gravarSecao(arquivo, cab.secao_tropas, mapa->tropas, (size_t)n * sizeof(int32_t)) &&
+             gravarSecao(arquivo, cab.secao_nomes, mapa->nomes, (size_t)n * sizeof(NomeTerritorio)) &&
+             gravarSecao(arquivo, cab.secao_texto_nomes, mapa->pool_nomes->texto, (size_t)cab.tamanho_texto_nomes);
+    if (ok && grafo != NULL) {
+        ok = gravarSecao(arquivo, cab.secao_inicio, grafo->inicio, (size_t)(n + 1) * sizeof(int32_t)) &&
+             gravarSecao(arquivo, cab.secao_vizinhos, grafo->vizinhos, (size_t)cab.num_vizinhos * sizeof(int32_t));
+    }
+    if (fclose(arquivo) != 0) ok = 0;
+    return ok;
+}
+
+/**
+ * @brief Confere se a seção [deslocamento, deslocamento + tamanho) cabe no arquivo.
+ */
+static int secaoValida(uint64_t deslocamento, uint64_t tamanho, uint64_t tamanho_arquivo) {
+    return deslocamento % ALINHAMENTO_SECAO == 0 && deslocamento <= tamanho_arquivo &&
+           tamanho <= tamanho_arquivo - deslocamento;
+}
+
+/**
+ * @brief Carrega um mapa .wmap com mmap, usando os vetores diretamente do arquivo.
+ * @note O mapeamento é privado: as batalhas alteram a memória do processo, nunca
+ *       o arquivo. As cores do arquivo são registradas em 'cores', que deve estar
+ *       vazia, para que os CorId gravados continuem válidos. O pool de nomes
+ *       também fica no arquivo; arquivos de outra VERSAO_MAPA são recusados.
+ * @param sessao Arena da sessão (NULL: heap), preparada como em alocarMapa().
+ * @return O mapa carregado, ou NULL se o arquivo não existe ou é inválido.
+ */
+Mapa* carregarMapaBinario(const char* caminho, TabelaCores* cores, Arena* sessao) {
+    int fd = open(caminho, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (uint64_t)info.st_size < sizeof(CabecalhoMapaBinario)) {
+        close(fd);
+        return NULL;
+    }
+    size_t tamanho_arquivo = (size_t)info.st_size;
+    unsigned char* base = (unsigned char*)mmap(NULL, tamanho_arquivo, PROT_READ | PROT_WRITE,
+                                               MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+
+    const CabecalhoMapaBinario* cab = (const CabecalhoMapaBinario*)base;
+    uint64_t n = cab->tamanho;
+    int valido = memcmp(cab->magica, MAGICA_MAPA, sizeof(cab->magica)) == 0 &&
+                 cab->versao == VERSAO_MAPA && cab->marca_ordem == MARCA_ORDEM_BYTES &&
+                 cab->tamanho_arquivo <= tamanho_arquivo && n > 0 && n < INT32_MAX &&
+                 cab->num_cores <= (uint32_t)(MAX_CORES - cores->quantidade) &&
+                 secaoValida(cab->secao_cores, (uint64_t)cab->num_cores * MAX_COR, tamanho_arquivo) &&
+                 secaoValida(cab->secao_dono, n, tamanho_arquivo) &&
+                 secaoValida(cab->secao_tropas, n * sizeof(int32_t), tamanho_arquivo) &&
+                 secaoValida(cab->secao_nomes, n * sizeof(NomeTerritorio), tamanho_arquivo) &&
+                 cab->tamanho_texto_nomes > 0 && cab->tamanho_texto_nomes < NOME_INVALIDO &&
+                 secaoValida(cab->secao_texto_nomes, cab->tamanho_texto_nomes, tamanho_arquivo);
+    if (valido && cab->num_vizinhos > 0) {
+        valido = secaoValida(cab->secao_inicio, (n + 1) * sizeof(int32_t), tamanho_arquivo) &&
+                 secaoValida(cab->secao_vizinhos, cab->num_vizinhos * sizeof(int32_t), tamanho_arquivo);
+    }
+
+    Mapa* mapa = NULL;
+    if (valido && sessao != NULL) {
+        // Sem vizinhos no arquivo, a partida cria as fronteiras em grade na arena
+        mapa = prepararSessao(sessao, (int)n, 0, cab->num_vizinhos == 0) ? (Mapa*)alocarNaArena(sessao, sizeof(Mapa)) : NULL;
+    } else if (valido) {
+        mapa = (Mapa*)calloc(1, sizeof(Mapa));
+    }
+    if (mapa == NULL) {
+        munmap(base, tamanho_arquivo);
+        return NULL;
+    }
+
+    mapa->arena = sessao;
+    mapa->tamanho = (int)n;
+    mapa->dono = (CorId*)(base + cab->secao_dono);
+    mapa->tropas = (int*)(base + cab->secao_tropas);
+    mapa->nomes = (NomeTerritorio*)(base + cab->secao_nomes);
+    mapa->mapeamento = base;
+    mapa->tamanho_mapeamento = tamanho_arquivo;
+
+    // O pool aponta para o texto do arquivo: somente leitura, sem tabela de espalhamento
+    PoolNomes* pool = (PoolNomes*)alocarNoMapa(mapa, sizeof(PoolNomes));
+    mapa->pool_nomes = pool;
+    if (pool != NULL) {
+        pool->texto = (char*)(base + cab->secao_texto_nomes);
+        pool->usado = pool->capacidade = (uint32_t)cab->tamanho_texto_nomes;
+        pool->externo = 1;
+    }
+
+    // Uma passada sequencial garante que os índices do arquivo não saiam dos vetores
+    unsigned char maior_dono = 0;
+    NomeTerritorio maior_nome = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        if (mapa->dono[i] > maior_dono) maior_dono = mapa->dono[i];
+        if (mapa->nomes[i] > maior_nome) maior_nome = mapa->nomes[i];
+    }
+    valido = pool != NULL && maior_dono < cab->num_cores && maior_nome < pool->usado &&
+             pool->texto[0] == '\0' && pool->texto[pool->usado - 1] == '\0';
+
+    if (valido && cab->num_vizinhos > 0) {
+        GrafoFronteiras* grafo = (GrafoFronteiras*)alocarNoMapa(mapa, sizeof(GrafoFronteiras));
+        mapa->fronteiras = grafo;
+        if (grafo == NULL) {
+            valido = 0;
+        } else {
+            grafo->inicio = (int*)(base + cab->secao_inicio);
+            grafo->vizinhos = (int*)(base + cab->secao_vizinhos);
+            grafo->externo = 1;
+            valido = grafo->inicio[0] == 0 && (uint64_t)grafo->inicio[n] == cab->num_vizinhos;
+            for (uint64_t i = 0; valido && i < n; i++) {
+                valido = grafo->inicio[i] <= grafo->inicio[i + 1];
+            }
+            for (uint64_t k = 0; valido && k < cab->num_vizinhos; k++) {
+                valido = grafo->vizinhos[k] >= 0 && (uint64_t)grafo->vizinhos[k] < n;
+            }
+        }
+    }
+    if (!valido) {
+        liberarMemoria(mapa);
+        return NULL;
+    }
+
+    const char (*nomes_cores)[MAX_COR] = (const char (*)[MAX_COR])(base + cab->secao_cores);
+    for (uint32_t c = 0; c < cab->num_cores; c++) {
+        memcpy(cores->nomes[cores->quantidade], nomes_cores[c], MAX_COR);
+        cores->nomes[cores->quantidade][MAX_COR - 1] = '\0';
+        cores->quantidade++;
+    }
+    return mapa;
+}
+
+/**
+ * @brief Pedaço do arquivo CSV interpretado por uma thread.
+ */
+typedef struct {
+    const char* inicio;
+    const char* fim;
+    TabelaCores cores;    // Cores locais; os CorId são traduzidos na junção
+    PoolNomes pool_nomes; // Nomes locais; entram no pool do mapa na junção
+    NomeTerritorio* nomes;
+    CorId* dono;
+    int* tropas;
+    int quantidade, capacidade;
+    int (*arestas)[2];    // {índice local, vizinho base 0 global}
+    int num_arestas, capacidade_arestas;
+    int linhas;           // Linhas lidas (inclusive vazias e comentários)
+    int linha_erro;       // Linha local (base 1) com erro, ou 0
+} PedacoCsv;
+
+static int crescerPedaco(PedacoCsv* pedaco) {
+    int nova = pedaco->capacidade ? pedaco->capacidade * 2 : 1024;
+    NomeTerritorio* nomes = (NomeTerritorio*)realloc(pedaco->nomes, (size_t)nova * sizeof(NomeTerritorio));
+    if (nomes) pedaco->nomes = nomes;
+    CorId* dono = (CorId*)realloc(pedaco->dono, (size_t)nova * sizeof(CorId));
+    if (dono) pedaco->dono = dono;
+    int* tropas = (int*)realloc(pedaco->tropas, (size_t)nova * sizeof(int));
+    if (tropas) pedaco->tropas = tropas;
+    if (nomes == NULL || dono == NULL || tropas == NULL) return 0;
+    pedaco->capacidade = nova;
+    return 1;
+}
+
+/**
+ * @brief Copia o campo [inicio, fim) sem espaços nas pontas, truncando em 'limite'.
+ */
+static void copiarCampo(char* destino, size_t limite, const char* inicio, const char* fim) {
+    while (inicio < fim && (*inicio == ' ' || *inicio == '\t')) inicio++;
+    while (fim > inicio && (fim[-1] == ' ' || fim[-1] == '\t' || fim[-1] == '\r')) fim--;
+    size_t n = (size_t)(fim - inicio);
+    if (n >= limite) n = limite - 1;
+    memcpy(destino, inicio, n);
+    memset(destino + n, 0, limite - n); // Sem lixo após o terminador: o arquivo é gravado byte a byte
+}
+
+/**
+ * @brief Lê um inteiro decimal em [*p, fim), avançando *p. Sem scanf.
+ * @return 1 se leu pelo menos um dígito.
+ */
+static int lerInteiro(const char** p, const char* fim, long* valor) {
+    const char* s = *p;
+    while (s < fim && (*s == ' ' || *s == '\t' || *s == '\r')) s++;
+    int negativo = (s < fim && *s == '-');
+    if (negativo) s++;
+    if (s >= fim || *s < '0' || *s > '9') return 0;
+
+    long v = 0;
+    while (s < fim && *s >= '0' && *s <= '9') {
+        if (v < 100000000000L) v = v * 10 + (*s - '0');
+        s++;
+    }
+    *valor = negativo ? -v : v;
+    *p = s;
+    return 1;
+}
+
+/**
+ * @brief Interpreta as linhas de um pedaço: "nome,cor,tropas[,vizinhos separados por espaço]".
+ */
+static void* interpretarPedacoCsv(void* argumento) {
+    PedacoCsv* pedaco = (PedacoCsv*)argumento;
+    const char* p = pedaco->inicio;
+
+    while (p < pedaco->fim && pedaco->linha_erro == 0) {
+        const char* fim_linha = memchr(p, '\n', (size_t)(pedaco->fim - p));
+        if (fim_linha == NULL) fim_linha = pedaco->fim;
+        pedaco->linhas++;
+
+        const char* s = p;
+        while (s < fim_linha && (*s == ' ' || *s == '\t' || *s == '\r')) s++;
+        if (s == fim_linha || *s == '#') {
+            p = fim_linha + 1;
+            continue;
+        }
+
+        // Separa até 4 campos; o último (vizinhos) vai até o fim da linha
+        const char* campos[4];
+        const char* fins[4];
+        int num_campos = 0;
+        const char* c = p;
+        while (num_campos < 4) {
+            const char* virgula = (num_campos < 3) ? memchr(c, ',', (size_t)(fim_linha - c)) : NULL;
+            campos[num_campos] = c;
+            fins[num_campos] = virgula ? virgula : fim_linha;
+            num_campos++;
+            if (virgula == NULL) break;
+            c = virgula + 1;
+        }
+
+        char cor[MAX_COR];
+        long tropas;
+        const char* cursor = (num_campos >= 3) ? campos[2] : NULL;
+        if (num_campos < 3) {
+            pedaco->linha_erro = pedaco->linhas;
+            break;
+        }
+        copiarCampo(cor, sizeof(cor), campos[1], fins[1]);
+        if (cor[0] == '\0' || !lerInteiro(&cursor, fins[2], &tropas) || tropas <= 0 || tropas > INT32_MAX ||
+            (pedaco->quantidade == pedaco->capacidade && !crescerPedaco(pedaco))) {
+            pedaco->linha_erro = pedaco->linhas;
+            break;
+        }
+
+        int i = pedaco->quantidade;
+        char nome[MAX_STRING];
+        copiarCampo(nome, sizeof(nome), campos[0], fins[0]);
+        pedaco->nomes[i] = adicionarNome(&pedaco->pool_nomes, nome, strlen(nome));
+        pedaco->dono[i] = registrarCor(&pedaco->cores, cor);
+        pedaco->tropas[i] = (int)tropas;
+        if (pedaco->nomes[i] == NOME_INVALIDO || pedaco->dono[i] == COR_INVALIDA) {
+            pedaco->linha_erro = pedaco->linhas;
+            break;
+        }
+
+        // Quarto campo (opcional): IDs (base 1) dos vizinhos
+        if (num_campos == 4) {
+            const char* v = campos[3];
+            long vizinho;
+            while (lerInteiro(&v, fim_linha, &vizinho)) {
+                if (pedaco->num_arestas == pedaco->capacidade_arestas) {
+                    int nova = pedaco->capacidade_arestas ? pedaco->capacidade_arestas * 2 : 4096;
+                    int (*arestas)[2] = (int (*)[2])realloc(pedaco->arestas, (size_t)nova * sizeof(*arestas));
+                    if (arestas == NULL) {
+                        pedaco->linha_erro = pedaco->linhas;
+                        break;
+                    }
+                    pedaco->arestas = arestas;
+                    pedaco->capacidade_arestas = nova;
+                }
+                pedaco->arestas[pedaco->num_arestas][0] = i;
+                pedaco->arestas[pedaco->num_arestas++][1] =
+                    (vizinho > 0 && vizinho <= INT32_MAX) ? (int)(vizinho - 1) : -1;
+            }
+        }
+        pedaco->quantidade++;
+        p = fim_linha + 1;
+    }
+    return NULL;
+}
+
+static int compararArestas(const void* a, const void* b) {
+    const int* x = (const int*)a;
+    const int* y = (const int*)b;
+    if (x[0] != y[0]) return (x[0] > y[0]) - (x[0] < y[0]);
+    return (x[1] > y[1]) - (x[1] < y[1]);
+}
+
+/**
+ * @brief Converte um mapa em texto (CSV) para o formato binário .wmap.
+ * @note Cada linha tem "nome,cor,tropas[,vizinhos]", com os vizinhos como IDs base 1
+ *       separados por espaço; linhas vazias e iniciadas por '#' são ignoradas. Uma
+ *       fronteira pode aparecer em um dos lados ou nos dois. O arquivo é dividido
+ *       em pedaços (em fins de linha), interpretados em paralelo, um por thread.
+ * @return 1 em caso de sucesso, 0 em caso de erro (com mensagem).
+ */
+int converterCsvParaBinario(const char* entrada, const char* saida) {
+    int fd = open(entrada, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0) {
+        printf("ERRO: Nao foi possivel ler '%s'.\n", entrada);
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+    size_t tamanho = (size_t)info.st_size;
+    const char* texto = (const char*)mmap(NULL, tamanho, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (texto == MAP_FAILED) {
+        printf("ERRO: Nao foi possivel mapear '%s'.\n", entrada);
+        return 0;
+    }
+
+    int num_pedacos = numeroDeThreads();
+    PedacoCsv* pedacos = (PedacoCsv*)calloc((size_t)num_pedacos, sizeof(PedacoCsv));
+    pthread_t threads[MAX_THREADS];
+    int ok = (pedacos != NULL);
+
+    // Divide o arquivo em pedaços que terminam logo após um '\n'
+    const char* fim_texto = texto + tamanho;
+    const char* cursor = texto;
+    for (int t = 0; ok && t < num_pedacos; t++) {
+        const char* fim = (t == num_pedacos - 1) ? fim_texto : texto + tamanho / (size_t)num_pedacos * (size_t)(t + 1);
+        if (fim < cursor) fim = cursor;
+        if (fim < fim_texto) {
+            const char* quebra = memchr(fim, '\n', (size_t)(fim_texto - fim));
+            fim = quebra ? quebra + 1 : fim_texto;
+        }
+        pedacos[t].inicio = cursor;
+        pedacos[t].fim = fim;
+        cursor = fim;
+        if (!iniciarPoolNomes(&pedacos[t].pool_nomes)) {
+            printf("ERRO: Falha ao alocar memoria.\n");
+            ok = 0;
+        }
+    }
+
+    int criadas = 0;
+    for (int t = 1; ok && t < num_pedacos; t++) {
+        if (pthread_create(&threads[t], NULL, interpretarPedacoCsv, &pedacos[t]) != 0) break;
+        criadas = t;
+    }
+    if (ok) {
+        interpretarPedacoCsv(&pedacos[0]);
+        for (int t = criadas + 1; t < num_pedacos; t++) {
+            interpretarPedacoCsv(&pedacos[t]); // Threads que não puderam ser criadas
+        }
+    }
+    for (int t = 1; t <= criadas; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    // Junção: deslocamentos, tradução das cores locais e erros com número de linha global
+    int total = 0, total_arestas = 0, linha_base = 0;
+    for (int t = 0; ok && t < num_pedacos; t++) {
+        if (pedacos[t].linha_erro != 0) {
+            printf("ERRO: Linha %d invalida em '%s'.\n", linha_base + pedacos[t].linha_erro, entrada);
+            ok = 0;
+        }
+        linha_base += pedacos[t].linhas;
+        total += pedacos[t].quantidade;
+        total_arestas += pedacos[t].num_arestas;
+    }
+    if (ok && total == 0) {
+        printf("ERRO: '%s' nao contem territorios.\n", entrada);
+        ok = 0;
+    }
+
+    TabelaCores cores = { .quantidade = 0 };
+    Mapa* mapa = ok ? alocarMapa(NULL, total) : NULL;
+    int (*arestas)[2] = ok ? (int (*)[2])malloc((size_t)(total_arestas > 0 ? total_arestas : 1) * sizeof(*arestas)) : NULL;
+    if (ok && (mapa == NULL || arestas == NULL)) {
+        printf("ERRO: Falha ao alocar memoria.\n");
+        ok = 0;
+    }
+
+    int deslocamento = 0, m = 0;
+    for (int t = 0; ok && t < num_pedacos; t++) {
+        PedacoCsv* pedaco = &pedacos[t];
+        CorId traducao[MAX_CORES];
+        for (int c = 0; c < pedaco->cores.quantidade; c++) {
+            traducao[c] = registrarCor(&cores, pedaco->cores.nomes[c]);
+            if (traducao[c] == COR_INVALIDA) {
+                printf("ERRO: '%s' tem mais de %d cores.\n", entrada, MAX_CORES);
+                ok = 0;
+            }
+        }
+        for (int i = 0; ok && i < pedaco->quantidade; i++) {
+            const char* nome = pedaco->pool_nomes.texto + pedaco->nomes[i];
+            mapa->nomes[deslocamento + i] = adicionarNome(mapa->pool_nomes, nome, strlen(nome));
+            if (mapa->nomes[deslocamento + i] == NOME_INVALIDO) {
+                printf("ERRO: Falha ao alocar memoria.\n");
+                ok = 0;
+            }
+            mapa->dono[deslocamento + i] = traducao[pedaco->dono[i]];
+            mapa->tropas[deslocamento + i] = pedaco->tropas[i];
+        }
+        for (int e = 0; ok && e < pedaco->num_arestas; e++) {
+            int a = deslocamento + pedaco->arestas[e][0];
+            int b = pedaco->arestas[e][1];
+            if (b < 0 || b >= total) {
+                printf("ERRO: Territorio %d tem um vizinho inexistente.\n", a + 1);
+                ok = 0;
+                break;
+            }
+            if (a == b) continue;
+            arestas[m][0] = a < b ? a : b;
+            arestas[m++][1] = a < b ? b : a;
+        }
+        deslocamento += pedaco->quantidade;
+    }
+
+    if (ok && m > 0) {
+        // Remove fronteiras repetidas (listadas nos dois lados)
+        qsort(arestas, (size_t)m, sizeof(*arestas), compararArestas);
+        int unicas = 0;
+        for (int e = 0; e < m; e++) {
+            if (unicas == 0 || compararArestas(arestas[e], arestas[unicas - 1]) != 0) {
+                arestas[unicas][0] = arestas[e][0];
+                arestas[unicas++][1] = arestas[e][1];
+            }
+        }
+        mapa->fronteiras = criarFronteiras(NULL, total, (const int (*)[2])arestas, unicas);
+        if (mapa->fronteiras == NULL) {
+            printf("ERRO: Falha ao alocar memoria.\n");
+            ok = 0;
+        }
+    }
+    if (ok && !salvarMapaBinario(mapa, &cores, saida)) {
+        printf("ERRO: Nao foi possivel gravar '%s'.\n", saida);
+        ok = 0;
+    }
+    if (ok) {
+        printf("Mapa convertido: %d territorios, %d cores, %d fronteiras -> %s\n",
+               total, cores.quantidade, mapa->fronteiras ? mapa->fronteiras->inicio[total] / 2 : 0, saida);
+    }
+
+    for (int t = 0; pedacos != NULL && t < num_pedacos; t++) {
+        liberarPoolNomes(&pedacos[t].pool_nomes);
+        free(pedacos[t].nomes);
+        free(pedacos[t].dono);
+        free(pedacos[t].tropas);
+        free(pedacos[t].arestas);
+    }
+    free(pedacos);
+    free(arestas);
+    liberarMemoria(mapa);
+    munmap((void*)texto, tamanho);
+    return ok;
+}
+
+// ============================================================================
+// --- Implementação dos Territórios Alterados e do Buffer de Saída ---
+// ============================================================================
+
+/**
+ * @brief Passa a rastrear os territórios alterados (conjunto inicialmente vazio).
+ * @return 1 em caso de sucesso, 0 se faltou memória.
+ */
+int inicializarAlterados(Mapa* mapa) {
+    ConjuntoAlterados* alt = (ConjuntoAlterados*)alocarNoMapa(mapa, sizeof(ConjuntoAlterados));
+    if (alt == NULL) return 0;
+
+    alt->itens = (int*)alocarNoMapa(mapa, (size_t)mapa->tamanho * sizeof(int));
+    alt->marcado = (unsigned char*)alocarNoMapa(mapa, (size_t)mapa->tamanho);
+    mapa->alterados = alt;
+    if (alt->itens == NULL || alt->marcado == NULL) {
+        liberarAlterados(mapa);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Esvazia o conjunto em O(alterados), desmarcando apenas o que foi marcado.
+ */
+void limparAlterados(Mapa* mapa) {
+    ConjuntoAlterados* alt = mapa->alterados;
+    if (alt == NULL) return;
+
+    for (int k = 0; k < alt->quantidade; k++) {
+        alt->marcado[alt->itens[k]] = 0;
+    }
+    alt->quantidade = 0;
+}
+
+/**
+ * @brief Desmarca os territórios registrados depois que o conjunto tinha 'quantidade' itens.
+ * @note Os marcados antes continuam no conjunto, mesmo que tenham sido alterados de novo.
+ */
+static void voltarAlterados(Mapa* mapa, int quantidade) {
+    ConjuntoAlterados* alt = mapa->alterados;
+    if (alt == NULL) return;
+
+    for (int k = quantidade; k < alt->quantidade; k++) {
+        alt->marcado[alt->itens[k]] = 0;
+    }
+    alt->quantidade = quantidade;
+}
+
+void liberarAlterados(Mapa* mapa) {
+    if (mapa->alterados != NULL) {
+        liberarNoMapa(mapa, mapa->alterados->itens);
+        liberarNoMapa(mapa, mapa->alterados->marcado);
+        liberarNoMapa(mapa, mapa->alterados);
+        mapa->alterados = NULL;
+    }
+}
+
+/**
+ * @brief Anexa texto formatado ao buffer, dobrando a capacidade quando preciso.
+ * @note Se faltar memória, o texto é descartado; a exibição sai incompleta, mas o jogo segue.
+ */
+void anexarSaida(BufferSaida* saida, const char* formato, ...) {
+    va_list args;
+    size_t livre = saida->capacidade - saida->usado;
+
+    va_start(args, formato);
+    int n = vsnprintf(saida->dados ? saida->dados + saida->usado : NULL, livre, formato, args);
+    va_end(args);
+    if (n < 0 || (size_t)n < livre) {
+        if (n > 0) saida->usado += (size_t)n;
+        return;
+    }
+
+    size_t nova = saida->capacidade ? saida->capacidade : 4096;
+    while (nova - saida->usado <= (size_t)n) nova *= 2;
+    char* dados = (char*)realloc(saida->dados, nova);
+    if (dados == NULL) return;
+    saida->dados = dados;
+    saida->capacidade = nova;
+
+    va_start(args, formato);
+    vsnprintf(saida->dados + saida->usado, nova - saida->usado, formato, args);
+    va_end(args);
+    saida->usado += (size_t)n;
+}
+
+/**
+ * @brief Envia o buffer com uma única chamada write() (repetida só em escritas parciais).
+ * @note O stdout é descarregado antes, para manter a ordem com os printf anteriores.
+ */
+void descarregarSaida(BufferSaida* saida) {
+    MEDIR_ESCOPO(FASE_ESCRITA);
+    size_t enviado = 0;
+
+    fflush(stdout);
+    while (enviado < saida->usado) {
+        ssize_t n = write(STDOUT_FILENO, saida->dados + enviado, saida->usado - enviado);
+        if (n <= 0) break;
+        enviado += (size_t)n;
+    }
+    CONTAR(CONTADOR_BYTES_ESCRITOS, enviado);
+    saida->usado = 0;
+}
+
+void liberarSaida(BufferSaida* saida) {
+    free(saida->dados);
+    saida->dados = NULL;
+    saida->usado = saida->capacidade = 0;
+}
+
+// ============================================================================
+// --- Implementação dos Retratos do Mapa (Cópia na Escrita) e do Histórico ---
+// ============================================================================
+
+static void soltarBlocoRetrato(BlocoRetrato* bloco) {
+    if (bloco != NULL && --bloco->referencias == 0) free(bloco);
+}
+
+static void soltarNoRetrato(NoRetrato* no, int nivel) {
+    if (no == NULL || --no->referencias > 0) return;
+    for (int k = 0; k < RAMOS_POR_NO; k++) {
+        if (nivel == 0) soltarBlocoRetrato(no->filhos[k].bloco);
+        else soltarNoRetrato(no->filhos[k].no, nivel - 1);
+    }
+    free(no);
+}
+
+void liberarRetrato(RetratoMapa* retrato) {
+    if (retrato == NULL || --retrato->referencias > 0) return;
+    soltarNoRetrato(retrato->raiz, retrato->altura - 1);
+    free(retrato);
+}
+
+/**
+ * @brief Copia do mapa vivo o bloco 'b' para um bloco novo, com uma referência.
+ */
+static BlocoRetrato* copiarBlocoDoMapa(const Mapa* mapa, int b) {
+    BlocoRetrato* bloco = (BlocoRetrato*)calloc(1, sizeof(BlocoRetrato));
+    if (bloco == NULL) return NULL;
+
+    int inicio = b * TERRITORIOS_POR_BLOCO;
+    int quantidade = mapa->tamanho - inicio < TERRITORIOS_POR_BLOCO ? mapa->tamanho - inicio : TERRITORIOS_POR_BLOCO;
+    bloco->referencias = 1;
+    memcpy(bloco->dono, mapa->dono + inicio, (size_t)quantidade * sizeof(CorId));
+    memcpy(bloco->tropas, mapa->tropas + inicio, (size_t)quantidade * sizeof(int));
+    return bloco;
+}
+
+/**
+ * @brief Monta a subárvore de nível 'nivel' que começa no bloco 'primeiro', com os
+ *        blocos copiados do mapa vivo.
+ * @return O nó, com uma referência, ou NULL se faltou memória (nada fica alocado).
+ */
+static NoRetrato* montarNoRetrato(const Mapa* mapa, int nivel, int primeiro, int num_blocos) {
+    NoRetrato* no = (NoRetrato*)calloc(1, sizeof(NoRetrato));
+    if (no == NULL) return NULL;
+    no->referencias = 1;
+
+    int passo = 1 << (BITS_POR_NO * nivel); // Blocos cobertos por cada filho
+    for (int k = 0; k < RAMOS_POR_NO && primeiro + k * passo < num_blocos; k++) {
+        int b = primeiro + k * passo;
+        int falhou;
+        if (nivel == 0) {
+            no->filhos[k].bloco = copiarBlocoDoMapa(mapa, b);
+            falhou = (no->filhos[k].bloco == NULL);
+        } else {
+            no->filhos[k].no = montarNoRetrato(mapa, nivel - 1, b, num_blocos);
+            falhou = (no->filhos[k].no == NULL);
+        }
+        if (falhou) {
+            soltarNoRetrato(no, nivel);
+            return NULL;
+        }
+    }
+    return no;
+}
+
+/**
+ * @brief Passa a acompanhar o mapa com retratos e captura o primeiro passo do histórico.
+ * @note A árvore viva começa com uma cópia completa de dono e tropas; depois disso,
+ *       só os caminhos até os blocos alterados são copiados.
+ * @return 1 em caso de sucesso, 0 se faltou memória (o mapa segue sem histórico).
+ */
+int iniciarHistorico(Mapa* mapa) {
+    int num_blocos = (mapa->tamanho + TERRITORIOS_POR_BLOCO - 1) / TERRITORIOS_POR_BLOCO;
+    int altura = 1;
+    while (altura < 6 && (1 << (BITS_POR_NO * altura)) < num_blocos) altura++;
+
+    HistoricoMapa* historico = (HistoricoMapa*)calloc(1, sizeof(HistoricoMapa));
+    RetratoMapa* retrato = (RetratoMapa*)malloc(sizeof(RetratoMapa));
+    NoRetrato* vivo = (historico != NULL && retrato != NULL) ? montarNoRetrato(mapa, altura - 1, 0, num_blocos) : NULL;
+    if (vivo == NULL) {
+        free(historico);
+        free(retrato);
+        return 0;
+    }
+
+    historico->vivo = vivo;
+    historico->altura = altura;
+    retrato->referencias = 2; // O passo 0 e o último retrato
+    retrato->tamanho = mapa->tamanho;
+    retrato->altura = altura;
+    retrato->raiz = vivo;
+    vivo->referencias++;
+    historico->ultimo = retrato;
+    historico->passos[0] = retrato;
+    historico->num_passos = 1;
+    mapa->historico = historico;
+    return 1;
+}
+
+void encerrarHistorico(Mapa* mapa) {
+    HistoricoMapa* historico = mapa->historico;
+    if (historico == NULL) return;
+
+    for (int i = 0; i < historico->num_passos; i++) liberarRetrato(historico->passos[i]);
+    liberarRetrato(historico->ultimo);
+    soltarNoRetrato(historico->vivo, historico->altura - 1);
+    free(historico);
+    mapa->historico = NULL;
+}
+
+/**
+ * @brief Captura o estado atual do mapa em O(1).
+ * @note Sem alterações desde a última captura, devolve o mesmo retrato. Senão, o
+ *       retrato passa a compartilhar a raiz viva, e a próxima escrita no mapa copia
+ *       o caminho até o bloco que ela alterar (ver espelharNoHistorico()).
+ * @return O retrato, com uma referência para o chamador (liberarRetrato()), ou NULL
+ *         se o mapa não tem histórico ou faltou memória.
+ */
+RetratoMapa* capturarRetrato(Mapa* mapa) {
+    HistoricoMapa* historico = mapa->historico;
+    if (historico == NULL) return NULL;
+
+    if (historico->ultimo == NULL) {
+        RetratoMapa* retrato = (RetratoMapa*)malloc(sizeof(RetratoMapa));
+        if (retrato == NULL) return NULL;
+        retrato->referencias = 1;
+        retrato->tamanho = mapa->tamanho;
+        retrato->altura = historico->altura;
+        retrato->raiz = historico->vivo;
+        historico->vivo->referencias++;
+        historico->ultimo = retrato;
+    }
+    historico->ultimo->referencias++;
+    return historico->ultimo;
+}
+
+/**
+ * @brief Cópia de um nó compartilhado, com uma referência a mais em cada filho.
+ */
+static NoRetrato* copiarNoRetrato(const NoRetrato* no, int nivel) {
+    NoRetrato* copia = (NoRetrato*)malloc(sizeof(NoRetrato));
+    if (copia == NULL) return NULL;
+    *copia = *no;
+    copia->referencias = 1;
+    for (int k = 0; k < RAMOS_POR_NO; k++) {
+        if (nivel == 0 && copia->filhos[k].bloco != NULL) copia->filhos[k].bloco->referencias++;
+        if (nivel > 0 && copia->filhos[k].no != NULL) copia->filhos[k].no->referencias++;
+    }
+    return copia;
+}
+
+/**
+ * @brief Leva à árvore viva o novo dono e as tropas do território.
+ * @note Nós e bloco ainda compartilhados com algum retrato são copiados no caminho
+ *       (cópia na escrita): O(altura) na primeira escrita do bloco após a captura e
+ *       sem cópias nas seguintes. Sem memória, o histórico é encerrado com aviso.
+ */
+static void espelharNoHistorico(Mapa* mapa, int territorio) {
+    HistoricoMapa* historico = mapa->historico;
+    int b = territorio / TERRITORIOS_POR_BLOCO;
+    liberarRetrato(historico->ultimo);
+    historico->ultimo = NULL;
+
+    NoRetrato** no = &historico->vivo;
+    for (int nivel = historico->altura - 1;; nivel--) {
+        if ((*no)->referencias > 1) {
+            NoRetrato* copia = copiarNoRetrato(*no, nivel);
+            if (copia == NULL) break;
+            (*no)->referencias--;
+            *no = copia;
+        }
+        int k = (b >> (BITS_POR_NO * nivel)) & (RAMOS_POR_NO - 1);
+        if (nivel > 0) {
+            no = &(*no)->filhos[k].no;
+            continue;
+        }
+
+        BlocoRetrato** bloco = &(*no)->filhos[k].bloco;
+        if ((*bloco)->referencias > 1) {
+            BlocoRetrato* copia = (BlocoRetrato*)malloc(sizeof(BlocoRetrato));
+            if (copia == NULL) break;
+            *copia = **bloco;
+            copia->referencias = 1;
+            (*bloco)->referencias--;
+            *bloco = copia;
+        }
+        (*bloco)->dono[territorio % TERRITORIOS_POR_BLOCO] = mapa->dono[territorio];
+        (*bloco)->tropas[territorio % TERRITORIOS_POR_BLOCO] = mapa->tropas[territorio];
+        return;
+    }
+
+    printf("AVISO: Memoria insuficiente para o historico. Desfazer e hipoteses ficam indisponiveis.\n");
+    encerrarHistorico(mapa);
+}
+
+/**
+ * @brief Aplica ao mapa vivo o conteúdo de um bloco do retrato, território a território.
+ * @note Passa por transferirTerritorio()/definirTropas(), então agregados, regiões
+ *       e alterados continuam corretos.
+ */
+static void aplicarBlocoRetrato(Mapa* mapa, int b, const BlocoRetrato* bloco) {
+    int inicio = b * TERRITORIOS_POR_BLOCO;
+    int quantidade = mapa->tamanho - inicio < TERRITORIOS_POR_BLOCO ? mapa->tamanho - inicio : TERRITORIOS_POR_BLOCO;
+    for (int k = 0; k < quantidade; k++) {
+        int t = inicio + k;
+        if (mapa->dono[t] != bloco->dono[k]) transferirTerritorio(mapa, t, bloco->dono[k]);
+        if (mapa->tropas[t] != bloco->tropas[k]) definirTropas(mapa, t, bloco->tropas[k]);
+    }
+}
+
+/**
+ * @brief Aplica ao mapa os blocos em que a subárvore 'para' difere de 'de'.
+ * @note Subárvores compartilhadas são puladas inteiras; 'de' NULL aplica todos os blocos.
+ */
+static void aplicarDiferencas(Mapa* mapa, const NoRetrato* de, const NoRetrato* para, int nivel, int primeiro) {
+    if (de == para) return;
+    int passo = 1 << (BITS_POR_NO * nivel);
+    for (int k = 0; k < RAMOS_POR_NO; k++) {
+        int b = primeiro + k * passo;
+        if (nivel == 0) {
+            if (para->filhos[k].bloco == NULL) break;
+            if (de == NULL || de->filhos[k].bloco != para->filhos[k].bloco) {
+                aplicarBlocoRetrato(mapa, b, para->filhos[k].bloco);
+            }
+        } else {
+            if (para->filhos[k].no == NULL) break;
+            aplicarDiferencas(mapa, de != NULL ? de->filhos[k].no : NULL, para->filhos[k].no, nivel - 1, b);
+        }
+    }
+}
+
+/**
+ * @brief Devolve o mapa vivo ao estado de um retrato.
+ * @note Compara a árvore viva com a do retrato e só visita os caminhos que diferem;
+ *       ao final, a árvore viva passa a ser a do retrato. Se o histórico foi
+ *       encerrado (ex.: sem memória durante uma hipótese), aplica o retrato inteiro.
+ * @return 1 em caso de sucesso, 0 se o retrato não é deste mapa.
+ */
+int restaurarRetrato(Mapa* mapa, RetratoMapa* retrato) {
+    HistoricoMapa* historico = mapa->historico;
+    if (retrato == NULL || retrato->tamanho != mapa->tamanho) return 0;
+
+    // As escritas da restauração não passam pela árvore viva, que é trocada ao final
+    mapa->historico = NULL;
+    aplicarDiferencas(mapa, historico != NULL ? historico->vivo : NULL, retrato->raiz, retrato->altura - 1, 0);
+    mapa->historico = historico;
+    if (historico == NULL) return 1;
+
+    retrato->raiz->referencias++;
+    soltarNoRetrato(historico->vivo, historico->altura - 1);
+    historico->vivo = retrato->raiz;
+    retrato->referencias++;
+    liberarRetrato(historico->ultimo);
+    historico->ultimo = retrato;
+    return 1;
+}
+
+/**
+ * @brief Registra o estado atual como um novo passo do histórico, após uma jogada.
+ * @note Descarta os passos que poderiam ser refeitos; com o histórico cheio, o
+ *       passo mais antigo é esquecido.
+ * @return 1 em caso de sucesso, 0 sem histórico ou sem memória.
+ */
+int registrarPasso(Mapa* mapa) {
+    HistoricoMapa* historico = mapa->historico;
+    if (historico == NULL) return 0;
+
+    RetratoMapa* retrato = capturarRetrato(mapa);
+    if (retrato == NULL) return 0;
+    if (retrato == historico->passos[historico->cursor]) {
+        liberarRetrato(retrato); // Nada mudou desde o último passo
+        return 1;
+    }
+
+    for (int i = historico->cursor + 1; i < historico->num_passos; i++) liberarRetrato(historico->passos[i]);
+    historico->num_passos = historico->cursor + 1;
+    if (historico->num_passos == PASSOS_HISTORICO) {
+        liberarRetrato(historico->passos[0]);
+        memmove(historico->passos, historico->passos + 1, (PASSOS_HISTORICO - 1) * sizeof(RetratoMapa*));
+        historico->num_passos--;
+    }
+    historico->passos[historico->num_passos++] = retrato;
+    historico->cursor = historico->num_passos - 1;
+    return 1;
+}
+
+/**
+ * @brief Volta o mapa ao passo anterior do histórico.
+ * @return 1 se voltou, 0 se não há o que desfazer.
+ */
+int desfazerPasso(Mapa* mapa) {
+    HistoricoMapa* historico = mapa->historico;
+    if (historico == NULL || historico->cursor == 0) return 0;
+    historico->cursor--;
+    return restaurarRetrato(mapa, historico->passos[historico->cursor]);
+}
+
+/**
+ * @brief Reaplica o passo desfeito mais recente.
+ * @return 1 se avançou, 0 se não há o que refazer.
+ */
+int refazerPasso(Mapa* mapa) {
+    HistoricoMapa* historico = mapa->historico;
+    if (historico == NULL || historico->cursor + 1 >= historico->num_passos) return 0;
+    historico->cursor++;
+    return restaurarRetrato(mapa, historico->passos[historico->cursor]);
+}
+
+// ============================================================================
+// --- Implementação das Funções de Setup e Exibição ---
+// ============================================================================
+
+/**
+ * @brief Converte todos os caracteres de uma string para maiúsculas.
+ * @param str Ponteiro para a string a ser modificada.
+ */
+void toUpperString(char* str) {
+    for (int i = 0; str[i] != '\0'; i++) {
+        str[i] = (char)toupper((unsigned char)str[i]);
+    }
+}
+
+/**
+ * @brief Procura uma cor já registrada (a comparação ignora maiúsculas/minúsculas).
+ * @return O CorId da cor, ou COR_INVALIDA se ela não foi registrada.
+ */
+CorId buscarCor(const TabelaCores* cores, const char* texto) {
+    char normalizada[MAX_COR];
+
+    strncpy(normalizada, texto, MAX_COR - 1);
+    normalizada[MAX_COR - 1] = '\0';
+    toUpperString(normalizada);
+
+    for (int i = 0; i < cores->quantidade; i++) {
+        if (strcmp(cores->nomes[i], normalizada) == 0) {
+            return (CorId)i;
+        }
+    }
+    return COR_INVALIDA;
+}
+
+/**
+ * @brief Registra uma cor (em MAIÚSCULAS) e retorna o seu CorId.
+ * @note Se a cor já existe, retorna o CorId existente.
+ * @return O CorId da cor, ou COR_INVALIDA se a tabela estiver cheia.
+ */
+CorId registrarCor(TabelaCores* cores, const char* texto) {
+    CorId existente = buscarCor(cores, texto);
+    if (existente != COR_INVALIDA) return existente;
+    if (cores->quantidade >= MAX_CORES) return COR_INVALIDA;
+
+    char* destino = cores->nomes[cores->quantidade];
+    strncpy(destino, texto, MAX_COR - 1);
+    destino[MAX_COR - 1] = '\0';
+    toUpperString(destino);
+
+    return (CorId)cores->quantidade++;
+}
+
+/**
+ * @brief Retorna o texto de uma cor, usado apenas na exibição.
+ */
+const char* nomeDaCor(const TabelaCores* cores, CorId cor) {
+    return (cor < cores->quantidade) ? cores->nomes[cor] : "?";
+}
+
+/**
+ * @brief Solicita e armazena os dados de cada território.
+ */
+void cadastrarTerritorios(Mapa* mapa, TabelaCores* cores) {
+    char nome[MAX_STRING];
+    char cor[MAX_COR];
+    int tamanho = mapa->tamanho;
+
+    for (int i = 0; i < tamanho; i++) {
+        printf("\n--- Cadastro do Territorio %d de %d ---\n", i + 1, tamanho);
+
+        printf("Nome do Territorio: ");
+        if (!lerLinhaDoTeclado(nome, MAX_STRING)) return;
+        mapa->nomes[i] = adicionarNome(mapa->pool_nomes, nome, strlen(nome));
+        if (mapa->nomes[i] == NOME_INVALIDO) {
+            printf("AVISO: Falha ao guardar o nome. O territorio fica sem nome.\n");
+            mapa->nomes[i] = 0;
+        }
+
+        printf("Cor do Exercito Dominante (Ex: Vermelho, Azul, Verde): ");
+        if (!lerLinhaDoTeclado(cor, MAX_COR)) return;
+        
+        // A conversão para MAIÚSCULAS acontece aqui, uma única vez por cor digitada
+        mapa->dono[i] = registrarCor(cores, cor);
+        if (mapa->dono[i] == COR_INVALIDA) {
+            printf("Limite de %d cores atingido. Usando a cor %s.\n", MAX_CORES, nomeDaCor(cores, 0));
+            mapa->dono[i] = 0;
+        }
+        
+        printf("Numero de Tropas: ");
+        if (!lerInteiroDoTeclado(&mapa->tropas[i]) || mapa->tropas[i] <= 0) {
+             printf("Tropas invalidas. Definindo para 1.\n");
+             mapa->tropas[i] = 1;
+        }
+        limparBufferEntrada(); 
+    }
+}
+
+static int passaNoFiltro(const Mapa* mapa, const FiltroMapa* filtro, int territorio) {
+    return (filtro->cor == COR_INVALIDA || mapa->dono[territorio] == filtro->cor) &&
+           mapa->tropas[territorio] > filtro->tropas_acima;
+}
+
+static void anexarLinhaTerritorio(BufferSaida* saida, const Mapa* mapa, const TabelaCores* cores,
+                                  int territorio) {
+    anexarSaida(saida, "| %-3d | %-20s | %-10s | %-10d |\n",
+                territorio + 1,
+                nomeDoTerritorio(mapa, territorio),
+                nomeDaCor(cores, mapa->dono[territorio]),
+                mapa->tropas[territorio]);
+}
+
+static int compararInteiros(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Monta a tabela do mapa no buffer e a envia com um único write().
+ * @note Em VISAO_ALTERADOS o custo é proporcional ao número de territórios
+ *       alterados; em VISAO_COMPLETA, ao tamanho da página. Toda exibição
+ *       esvazia o conjunto de alterados.
+ */
+void exibirMapa(Mapa* mapa, const TabelaCores* cores, const FiltroMapa* filtro, BufferSaida* saida) {
+    MEDIR_ESCOPO(FASE_EXIBICAO);
+    const ConjuntoAlterados* alt = mapa->alterados;
+    int alterados = (filtro->modo == VISAO_ALTERADOS && alt != NULL);
+
+    anexarSaida(saida, "\n\n=======================================================\n");
+    if (alterados) {
+        anexarSaida(saida, "               TERRITORIOS ALTERADOS\n");
+    } else {
+        anexarSaida(saida, "               ESTADO ATUAL DO MAPA\n");
+    }
+    anexarSaida(saida, "=======================================================\n");
+
+    anexarSaida(saida, "| %-3s | %-20s | %-10s | %-10s |\n", "ID", "Territorio", "Exercito", "Tropas");
+    anexarSaida(saida, "|-----|----------------------|------------|------------|\n");
+
+    if (alterados) {
+        // Em ordem de ID; o vetor é reordenado, mas será esvaziado logo abaixo
+        qsort(alt->itens, (size_t)alt->quantidade, sizeof(int), compararInteiros);
+        int exibidos = 0;
+        for (int k = 0; k < alt->quantidade; k++) {
+            if (passaNoFiltro(mapa, filtro, alt->itens[k])) {
+                anexarLinhaTerritorio(saida, mapa, cores, alt->itens[k]);
+                exibidos++;
+            }
+        }
+        CONTAR(CONTADOR_LINHAS_EXIBIDAS, exibidos);
+        anexarSaida(saida, "|-----|----------------------|------------|------------|\n");
+        anexarSaida(saida, "%d de %d territorios alterados exibidos. Opcao 4 do menu exibe o mapa completo.\n",
+                    exibidos, alt->quantidade);
+    } else {
+        int limite = (filtro->linhas > 0) ? filtro->linhas : mapa->tamanho;
+        int pular = (filtro->linhas > 0) ? filtro->pagina * filtro->linhas : 0;
+        int filtrado = (filtro->cor != COR_INVALIDA || filtro->tropas_acima > 0);
+        int total = 0, exibidos = 0;
+
+        // Sem filtros, a página começa direto na posição; com filtros, conta os que passam
+        for (int i = filtrado ? 0 : pular; i < mapa->tamanho; i++) {
+            if (!passaNoFiltro(mapa, filtro, i)) continue;
+            if (filtrado && total++ < pular) continue;
+            if (exibidos == limite) {
+                if (!filtrado) break;
+                continue;
+            }
+            anexarLinhaTerritorio(saida, mapa, cores, i);
+            exibidos++;
+        }
+        if (!filtrado) total = mapa->tamanho;
+        CONTAR(CONTADOR_LINHAS_EXIBIDAS, exibidos);
+        anexarSaida(saida, "|-----|----------------------|------------|------------|\n");
+        if (filtro->linhas > 0 || filtrado) {
+            int paginas = (filtro->linhas > 0) ? (total + filtro->linhas - 1) / filtro->linhas : 1;
+            anexarSaida(saida, "Pagina %d de %d (%d territorios). Opcao 4 do menu muda a pagina e os filtros.\n",
+                        filtro->pagina + 1, paginas > 0 ? paginas : 1, total);
+        }
+    }
+
+    limparAlterados(mapa);
+    descarregarSaida(saida);
+}
+
+/**
+ * @brief Pergunta ao jogador os filtros e a página da próxima exibição do mapa.
+ */
+void escolherVisao(const TabelaCores* cores, FiltroMapa* filtro) {
+    char texto[MAX_STRING];
+    int valor;
+
+    printf("\n--- EXIBIR MAPA ---\n");
+    printf("Filtrar pela cor do exercito (ENTER para todas): ");
+    filtro->cor = COR_INVALIDA;
+    if (lerLinhaDoTeclado(texto, sizeof(texto))) {
+        if (texto[0] != '\0') {
+            filtro->cor = buscarCor(cores, texto);
+            if (filtro->cor == COR_INVALIDA) {
+                printf("Cor desconhecida. Exibindo todas as cores.\n");
+            }
+        }
+    }
+
+    printf("Exibir apenas territorios com mais de N tropas (0 para todos): ");
+    filtro->tropas_acima = (lerInteiroDoTeclado(&valor) && valor > 0) ? valor : 0;
+    limparBufferEntrada();
+
+    filtro->pagina = 0;
+    if (filtro->linhas > 0) {
+        printf("Pagina (a partir de 1, com %d territorios cada): ", filtro->linhas);
+        if (lerInteiroDoTeclado(&valor) && valor > 1) {
+            filtro->pagina = valor - 1;
+        }
+        limparBufferEntrada();
+    }
+    filtro->modo = VISAO_COMPLETA;
+}
+
+// ============================================================================
+// --- Implementação das Funções de Lógica do Jogo (Ataque) ---
+// ============================================================================
+
+/**
+ * @brief Gerencia a interface de ataque e valida as escolhas do jogador.
+ * @note As cores são comparadas pelo CorId, sem strcmp.
+ */
+void faseDeAtaque(Mapa* mapa, CorId cor_jogador, const TabelaCores* cores, GeradorAleatorio* gerador, int blitz) {
+    MEDIR_ESCOPO(FASE_ENTRADA_ATAQUE);
+    int id_atacante, id_defensor;
+    int tamanho = mapa->tamanho;
+    
+    printf(blitz ? "\n--- ATAQUE RELAMPAGO ---\n" : "\n--- FASE DE ATAQUE ---\n");
+    printf("Digite o ID do Territorio Atacante (1 a %d): ", tamanho);
+    if (!lerInteiroDoTeclado(&id_atacante) || id_atacante < 1 || id_atacante > tamanho) {
+        printf("Erro: ID de atacante invalido.\n");
+        limparBufferEntrada();
+        return;
+    }
+
+    printf("Digite o ID do Territorio Defensor (1 a %d): ", tamanho);
+    if (!lerInteiroDoTeclado(&id_defensor) || id_defensor < 1 || id_defensor > tamanho) {
+        printf("Erro: ID de defensor invalido.\n");
+        limparBufferEntrada();
+        return;
+    }
+    limparBufferEntrada();
+
+    int i_atacante = id_atacante - 1;
+    int i_defensor = id_defensor - 1;
+
+    switch (validarAtaque(mapa, cor_jogador, i_atacante, i_defensor)) {
+        case ATAQUE_VALIDO:
+            if (blitz) {
+                atacarBlitz(mapa, i_atacante, i_defensor, cores, gerador);
+            } else {
+                atacar(mapa, i_atacante, i_defensor, cores, gerador);
+            }
+            break;
+        case ATAQUE_PROPRIO_TERRITORIO:
+            printf("Ataque cancelado: Nao e possivel atacar o proprio territorio.\n");
+            break;
+        case ATAQUE_TERRITORIO_ALHEIO:
+            printf("Ataque cancelado: Voce so pode atacar de seus proprios territorios (%s).\n",
+                   nomeDaCor(cores, cor_jogador));
+            break;
+        case ATAQUE_SEM_TROPAS:
+            printf("Ataque cancelado: O atacante precisa de no minimo 2 tropas.\n");
+            break;
+        case ATAQUE_MESMO_EXERCITO:
+            printf("Ataque cancelado: Nao e possivel atacar um territorio do mesmo exercito.\n");
+            break;
+        case ATAQUE_SEM_FRONTEIRA:
+            printf("Ataque cancelado: %s nao faz fronteira com %s. Vizinhos:",
+                   nomeDoTerritorio(mapa, i_atacante), nomeDoTerritorio(mapa, i_defensor));
+            for (int k = mapa->fronteiras->inicio[i_atacante]; k < mapa->fronteiras->inicio[i_atacante + 1]; k++) {
+                printf(" %d", mapa->fronteiras->vizinhos[k] + 1);
+            }
+            printf("\n");
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Confere se o jogador pode atacar 'defensor' a partir de 'atacante' (índices base 0, válidos).
+ * @return ATAQUE_VALIDO ou o primeiro motivo de recusa, na ordem em que faseDeAtaque() os explica.
+ */
+ErroAtaque validarAtaque(const Mapa* mapa, CorId cor_jogador, int atacante, int defensor) {
+    if (atacante == defensor) return ATAQUE_PROPRIO_TERRITORIO;
+    if (mapa->dono[atacante] != cor_jogador) return ATAQUE_TERRITORIO_ALHEIO;
+    if (mapa->tropas[atacante] <= 1) return ATAQUE_SEM_TROPAS;
+    if (mapa->dono[atacante] == mapa->dono[defensor]) return ATAQUE_MESMO_EXERCITO;
+    if (!saoVizinhos(mapa, atacante, defensor)) return ATAQUE_SEM_FRONTEIRA;
+    return ATAQUE_VALIDO;
+}
+
+/**
+ * @brief Apresenta uma rodada de batalha no terminal.
+ * @note Toda a regra fica em resolverBatalha(); aqui ficam apenas as mensagens.
+ */
+void atacar(Mapa* mapa, int atacante, int defensor, const TabelaCores* cores, GeradorAleatorio* gerador) {
+    MEDIR_ESCOPO(FASE_ATAQUE);
+    ResultadoBatalha resultado;
+    const char* nome_atacante = nomeDoTerritorio(mapa, atacante);
+    const char* nome_defensor = nomeDoTerritorio(mapa, defensor);
+
+    printf("\n--- RESULTADO DA BATALHA ---\n");
+    printf("Batalha: %s (%s) vs %s (%s)\n", nome_atacante, nomeDaCor(cores, mapa->dono[atacante]),
+           nome_defensor, nomeDaCor(cores, mapa->dono[defensor]));
+
+    resolverBatalha(mapa, atacante, defensor, &resultado, gerador);
+
+    printf("Dados Sorteados: Atacante (%d) contra Defensor (%d)\n", resultado.dado_ataque, resultado.dado_defesa);
+
+    if (resultado.perdas_atacante == 0) {
+        printf("O Atacante %s VENCEU a rodada.\n", nome_atacante);
+
+        if (resultado.perdas_defensor > 0) {
+            printf("Defensor perde %d tropas. Tropas restantes: %d\n", resultado.perdas_defensor,
+                   resultado.conquista ? 0 : mapa->tropas[defensor]);
+        }
+
+        if (resultado.conquista) {
+            printf("\nTERRITORIO CONQUISTADO! %s agora pertence ao exercito %s.\n",
+                   nome_defensor, nomeDaCor(cores, mapa->dono[atacante]));
+            printf("Uma tropa de %s move-se para %s.\n", nome_atacante, nome_defensor);
+        }
+
+    } else {
+        int perdas = resultado.perdas_atacante;
+        if (resultado.perdas_defensor > 0) {
+            // Regras com vários dados: os dois lados podem perder tropas na mesma rodada
+            printf("Rodada dividida: o Defensor %s perde %d tropa%s. Tropas restantes: %d\n", nome_defensor,
+                   resultado.perdas_defensor, resultado.perdas_defensor > 1 ? "s" : "", mapa->tropas[defensor]);
+        } else {
+            printf("O Defensor %s RESISTIU. Atacante perde %d tropa%s.\n", nome_defensor, perdas, perdas > 1 ? "s" : "");
+        }
+        printf("Atacante perde %d tropa%s. Tropas restantes em %s: %d\n", perdas, perdas > 1 ? "s" : "", nome_atacante,
+               mapa->tropas[atacante]);
+    }
+
+    printf("\nPressione ENTER para continuar...");
+    limparBufferEntrada();
+}
+
+/**
+ * @brief Apresenta um ataque relâmpago: o cerco inteiro de uma vez, com um único ENTER.
+ */
+void atacarBlitz(Mapa* mapa, int atacante, int defensor, const TabelaCores* cores, GeradorAleatorio* gerador) {
+    MEDIR_ESCOPO(FASE_ATAQUE);
+    ResultadoBlitz resultado;
+    const char* nome_atacante = nomeDoTerritorio(mapa, atacante);
+    const char* nome_defensor = nomeDoTerritorio(mapa, defensor);
+
+    printf("\n--- RESULTADO DO ATAQUE RELAMPAGO ---\n");
+    printf("Cerco: %s (%s, %d tropas) vs %s (%s, %d tropas)\n", nome_atacante,
+           nomeDaCor(cores, mapa->dono[atacante]), mapa->tropas[atacante], nome_defensor,
+           nomeDaCor(cores, mapa->dono[defensor]), mapa->tropas[defensor]);
+
+    resolverBlitz(mapa, atacante, defensor, &resultado, gerador);
+
+    printf("Rodadas: %d (%d vencidas pelo atacante, %d pelo defensor)\n", resultado.rodadas,
+           resultado.vitorias, resultado.rodadas - resultado.vitorias);
+    printf("Perdas: atacante %d, defensor %d\n", resultado.perdas_atacante, resultado.perdas_defensor);
+    if (resultado.conquista) {
+        printf("\nTERRITORIO CONQUISTADO! %s agora pertence ao exercito %s.\n",
+               nome_defensor, nomeDaCor(cores, mapa->dono[atacante]));
+        printf("Uma tropa de %s move-se para %s. Tropas restantes em %s: %d\n", nome_atacante, nome_defensor,
+               nome_atacante, mapa->tropas[atacante]);
+    } else {
+        printf("O Defensor %s RESISTIU ao cerco com %d tropas; %s ficou com 1 tropa.\n", nome_defensor,
+               mapa->tropas[defensor], nome_atacante);
+    }
+
+    printf("\nPressione ENTER para continuar...");
+    limparBufferEntrada();
+}
+
+// ============================================================================
+// --- Implementação do Modo Script ---
+// ============================================================================
+
+/**
+ * @brief Abre o script ("-" lê da entrada padrão).
+ * @return 1 em caso de sucesso, 0 se o arquivo não abriu ou faltou memória.
+ */
+int abrirLeitor(LeitorLinhas* leitor, const char* caminho) {
+    memset(leitor, 0, sizeof(*leitor));
+    leitor->fd = (strcmp(caminho, "-") == 0) ? STDIN_FILENO : open(caminho, O_RDONLY);
+    if (leitor->fd < 0) return 0;
+
+    leitor->capacidade = TAMANHO_BLOCO_SCRIPT;
+    leitor->dados = (char*)malloc(leitor->capacidade + 1); // +1: terminador da última linha
+    if (leitor->dados == NULL) {
+        fecharLeitor(leitor);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Próxima linha, sem o '\n' (e sem '\r'), terminada em '\0' dentro do buffer.
+ * @note Válida até a chamada seguinte. Lê um bloco inteiro por read() quando o
+ *       buffer se esgota, em vez de um caractere por vez.
+ * @return A linha, ou NULL no fim do arquivo (ou em erro de leitura).
+ */
+char* proximaLinha(LeitorLinhas* leitor, size_t* tamanho) {
+    for (;;) {
+        char* inicio = leitor->dados + leitor->inicio;
+        size_t disponivel = leitor->fim - leitor->inicio;
+        char* quebra = (char*)memchr(inicio, '\n', disponivel);
+
+        if (quebra != NULL || (leitor->fim_arquivo && disponivel > 0)) {
+            size_t n = (quebra != NULL) ? (size_t)(quebra - inicio) : disponivel;
+            leitor->inicio += (quebra != NULL) ? n + 1 : n;
+            if (n > 0 && inicio[n - 1] == '\r') n--;
+            inicio[n] = '\0';
+            *tamanho = n;
+            return inicio;
+        }
+        if (leitor->fim_arquivo) return NULL;
+
+        // Move a linha incompleta para o começo e, se ela ocupa o buffer todo, dobra o buffer
+        memmove(leitor->dados, inicio, disponivel);
+        leitor->inicio = 0;
+        leitor->fim = disponivel;
+        if (leitor->fim == leitor->capacidade) {
+            char* maior = (char*)realloc(leitor->dados, 2 * leitor->capacidade + 1);
+            if (maior == NULL) return NULL;
+            leitor->dados = maior;
+            leitor->capacidade *= 2;
+        }
+
+        ssize_t lidos = read(leitor->fd, leitor->dados + leitor->fim, leitor->capacidade - leitor->fim);
+        if (lidos < 0) return NULL;
+        if (lidos == 0) leitor->fim_arquivo = 1;
+        leitor->fim += (size_t)lidos;
+    }
+}
+
+void fecharLeitor(LeitorLinhas* leitor) {
+    if (leitor->fd > STDIN_FILENO) close(leitor->fd);
+    free(leitor->dados);
+    leitor->dados = NULL;
+    leitor->fd = -1;
+}
+
+/**
+ * @brief Separa a próxima palavra da linha (delimitada por espaços ou tabs), terminando-a em '\0'.
+ * @return A palavra, ou NULL se a linha acabou.
+ */
+static char* proximaPalavra(char** cursor) {
+    char* p = *cursor;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == '\0') return NULL;
+
+    char* palavra = p;
+    while (*p != '\0' && *p != ' ' && *p != '\t') p++;
+    if (*p != '\0') *p++ = '\0';
+    *cursor = p;
+    return palavra;
+}
+
+/**
+ * @brief Converte uma palavra inteira em int, com o mesmo leitor do conversor CSV.
+ * @return 1 em caso de sucesso, 0 se sobrar algum caractere ou o valor não couber em int.
+ */
+static int lerPalavraInteira(const char* palavra, int* valor) {
+    const char* fim = palavra + strlen(palavra);
+    long lido;
+    if (!lerInteiro(&palavra, fim, &lido) || palavra != fim || lido > INT_MAX || lido < INT_MIN) return 0;
+    *valor = (int)lido;
+    return 1;
+}
+
+/**
+ * @brief Compara o comando com o nome em português e com o sinônimo em inglês.
+ */
+static int comandoE(const char* palavra, const char* nome, const char* sinonimo) {
+    return strcmp(palavra, nome) == 0 || strcmp(palavra, sinonimo) == 0;
+}
+
+static const char* const motivosAtaqueRecusado[] = {
+    [ATAQUE_PROPRIO_TERRITORIO] = "atacante e defensor sao o mesmo territorio",
+    [ATAQUE_TERRITORIO_ALHEIO] = "o atacante nao e seu",
+    [ATAQUE_SEM_TROPAS] = "o atacante precisa de no minimo 2 tropas",
+    [ATAQUE_MESMO_EXERCITO] = "o defensor e do mesmo exercito",
+    [ATAQUE_SEM_FRONTEIRA] = "os territorios nao fazem fronteira",
+};
+
+/**
+ * @brief Interpreta "exibir" (ou "show") e as suas opções chave=valor no filtro.
+ * @return NULL se tudo foi entendido, ou a opção inválida.
+ */
+static const char* lerOpcoesExibicao(char* cursor, const TabelaCores* cores, FiltroMapa* filtro) {
+    char* opcao;
+    while ((opcao = proximaPalavra(&cursor)) != NULL) {
+        char* valor = strchr(opcao, '=');
+        int numero = 0;
+        if (strcmp(opcao, "alterados") == 0 || strcmp(opcao, "changed") == 0) {
+            filtro->modo = VISAO_ALTERADOS;
+            continue;
+        }
+        if (valor == NULL) return opcao;
+        *valor++ = '\0';
+
+        if (comandoE(opcao, "cor", "color")) {
+            filtro->cor = buscarCor(cores, valor);
+            if (filtro->cor == COR_INVALIDA) return valor;
+        } else if (comandoE(opcao, "tropas", "troops") && lerPalavraInteira(valor, &numero) && numero >= 0) {
+            filtro->tropas_acima = numero;
+        } else if (comandoE(opcao, "pagina", "page") && lerPalavraInteira(valor, &numero) && numero >= 1) {
+            filtro->pagina = numero - 1;
+        } else if (comandoE(opcao, "linhas", "lines") && lerPalavraInteira(valor, &numero) && numero >= 0) {
+            filtro->linhas = numero;
+        } else {
+            return opcao;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief "hipotese A D [A D ...]": joga a sequência de ataques num ramo e desfaz tudo ao final.
+ * @note O ramo é um retrato do mapa (capturarRetrato()): só os blocos tocados pelos
+ *       ataques são copiados. Os dados vêm de um fluxo próprio (FLUXO_HIPOTESE),
+ *       semeado pelo estado do gerador do jogo sem consumi-lo: a hipótese não
+ *       antecipa nem altera os dados reais. Nada vai para o diário, e os territórios
+ *       tocados só pelo ramo saem dos alterados.
+ * @return NULL em caso de sucesso, ou a mensagem de erro.
+ */
+static const char* executarHipotese(Mapa* mapa, CorId cor_jogador, const Missao* missao,
+                                    const GeradorAleatorio* gerador, char* cursor, BufferSaida* saida) {
+    RetratoMapa* retrato = capturarRetrato(mapa);
+    if (retrato == NULL) return "hipoteses exigem o historico do mapa";
+
+    DiarioBatalhas* diario = mapa->diario;
+    int alterados_antes = mapa->alterados != NULL ? mapa->alterados->quantidade : 0;
+    const uint64_t* s = gerador->s;
+    GeradorAleatorio ramo;
+    semearGerador(&ramo, s[0] ^ s[1] * 0x9E3779B97F4A7C15ULL ^ s[2] * 0xBF58476D1CE4E5B9ULL ^ s[3] * 0x94D049BB133111EBULL,
+                  FLUXO_HIPOTESE);
+    mapa->diario = NULL;
+
+    const char* erro = NULL;
+    anexarSaida(saida, "hipotese:");
+    for (char* palavra_a; (palavra_a = proximaPalavra(&cursor)) != NULL;) {
+        char* palavra_d = proximaPalavra(&cursor);
+        int id_a, id_d;
+        if (palavra_d == NULL || !lerPalavraInteira(palavra_a, &id_a) || !lerPalavraInteira(palavra_d, &id_d) ||
+            id_a < 1 || id_a > mapa->tamanho || id_d < 1 || id_d > mapa->tamanho) {
+            erro = "use 'hipotese A D [A D ...]' com IDs validos";
+            break;
+        }
+        ErroAtaque motivo = validarAtaque(mapa, cor_jogador, id_a - 1, id_d - 1);
+        if (motivo != ATAQUE_VALIDO) {
+            anexarSaida(saida, " %d>%d recusado (%s);", id_a, id_d, motivosAtaqueRecusado[motivo]);
+            break;
+        }
+        ResultadoBatalha resultado;
+        resolverBatalha(mapa, id_a - 1, id_d - 1, &resultado, &ramo);
+        anexarSaida(saida, " %d>%d dados %d x %d, tropas %d/%d%s;", id_a, id_d, resultado.dado_ataque,
+                    resultado.dado_defesa, mapa->tropas[id_a - 1], mapa->tropas[id_d - 1],
+                    resultado.conquista ? ", CONQUISTA" : "");
+    }
+    if (erro == NULL) {
+        anexarSaida(saida, " missao %s (desfeito)\n", verificarMissao(missao, mapa, cor_jogador) ? "cumprida" : "pendente");
+    } else {
+        anexarSaida(saida, "\n");
+    }
+
+    restaurarRetrato(mapa, retrato);
+    liberarRetrato(retrato);
+    voltarAlterados(mapa, alterados_antes);
+    mapa->diario = diario;
+    return erro;
+}
+
+/**
+ * @brief "lote A D [A D ...]": ordens simultâneas resolvidas por resolverLoteParalelo().
+ * @note Só se confere de antemão que os atacantes são do jogador; o restante é
+ *       conferido na resolução, e ordens que deixaram de valer (ex.: atacante já
+ *       sem tropas por uma ordem anterior) saem como "sem efeito".
+ * @return NULL em caso de sucesso, ou a mensagem de erro.
+ */
+static const char* executarLote(Mapa* mapa, CorId cor_jogador, GeradorAleatorio* gerador, char* cursor,
+                                BufferSaida* saida) {
+    int capacidade = 16, quantidade = 0;
+    PedidoAtaque* pedidos = (PedidoAtaque*)malloc((size_t)capacidade * sizeof(PedidoAtaque));
+    const char* erro = (pedidos == NULL) ? "memoria insuficiente" : NULL;
+
+    for (char* palavra_a; erro == NULL && (palavra_a = proximaPalavra(&cursor)) != NULL;) {
+        char* palavra_d = proximaPalavra(&cursor);
+        int id_a, id_d;
+        if (palavra_d == NULL || !lerPalavraInteira(palavra_a, &id_a) || !lerPalavraInteira(palavra_d, &id_d) ||
+            id_a < 1 || id_a > mapa->tamanho || id_d < 1 || id_d > mapa->tamanho) {
+            erro = "use 'lote A D [A D ...]' com IDs validos";
+        } else if (mapa->dono[id_a - 1] != cor_jogador) {
+            erro = "o lote so pode atacar a partir de territorios do jogador";
+        } else if (quantidade == capacidade) {
+            PedidoAtaque* maior = (PedidoAtaque*)realloc(pedidos, (size_t)capacidade * 2 * sizeof(PedidoAtaque));
+            if (maior == NULL) {
+                erro = "memoria insuficiente";
+            } else {
+                pedidos = maior;
+                capacidade *= 2;
+            }
+        }
+        if (erro == NULL) pedidos[quantidade++] = (PedidoAtaque){ id_a - 1, id_d - 1 };
+    }
+    if (erro == NULL && quantidade == 0) erro = "use 'lote A D [A D ...]' com IDs validos";
+
+    ResultadoBatalha* resultados = NULL;
+    if (erro == NULL) {
+        resultados = (ResultadoBatalha*)malloc((size_t)quantidade * sizeof(ResultadoBatalha));
+        if (resultados == NULL || resolverLoteParalelo(mapa, pedidos, quantidade, resultados, gerador, 0) < 0) {
+            erro = "memoria insuficiente";
+        }
+    }
+    if (erro == NULL) {
+        anexarSaida(saida, "lote:");
+        for (int i = 0; i < quantidade; i++) {
+            const ResultadoBatalha* r = &resultados[i];
+            if (r->dado_ataque == 0) {
+                anexarSaida(saida, " %d>%d sem efeito;", pedidos[i].atacante + 1, pedidos[i].defensor + 1);
+            } else {
+                anexarSaida(saida, " %d>%d dados %d x %d%s;", pedidos[i].atacante + 1, pedidos[i].defensor + 1,
+                            r->dado_ataque, r->dado_defesa, r->conquista ? ", CONQUISTA" : "");
+            }
+        }
+        anexarSaida(saida, "\n");
+        registrarPasso(mapa);
+    }
+    free(pedidos);
+    free(resultados);
+    return erro;
+}
+
+/**
+ * @brief Executa um script de comandos, um por linha, sem prompts:
+ *        "atacar A D" (attack), "verificar" (check), "exibir [cor=X] [tropas=N]
+ *        [pagina=N] [linhas=N] [alterados]" (show), "adversarios" (ai) e "sair" (quit).
+ *        Linhas vazias e iniciadas por '#' são ignoradas.
+ * @note Cada comando responde com uma linha no buffer de saída, descarregado com
+ *       um único write() a cada TAMANHO_BLOCO_SCRIPT bytes. Erros de um comando
+ *       são relatados ("ERRO linha N: ...") e o script continua.
+ * @param ia Adversário para o comando "adversarios" (NULL: sem adversários).
+ * @return 1 se todos os comandos foram aceitos, 0 se houve erro.
+ */
+int executarScript(Mapa* mapa, const TabelaCores* cores, const Missao* missao, CorId cor_jogador,
+                   GeradorAleatorio* gerador, AdversarioMcts* ia, const char* caminho) {
+    LeitorLinhas leitor;
+    if (!abrirLeitor(&leitor, caminho)) {
+        printf("ERRO: Nao foi possivel abrir o script '%s'.\n", caminho);
+        return 0;
+    }
+
+    BufferSaida saida = { 0 };
+    char texto_missao[MAX_MISSAO_LEN];
+    long long linha = 0, comandos = 0, erros = 0;
+    struct timespec inicio, fim;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+
+    char* texto;
+    size_t tamanho;
+    while ((texto = proximaLinha(&leitor, &tamanho)) != NULL) {
+        linha++;
+        char* cursor = texto;
+        char* comando = proximaPalavra(&cursor);
+        if (comando == NULL || comando[0] == '#') continue;
+        comandos++;
+
+        int blitz = comandoE(comando, "blitz", "blitz");
+        if (blitz || comandoE(comando, "atacar", "attack")) {
+            char* palavra_a = proximaPalavra(&cursor);
+            char* palavra_d = proximaPalavra(&cursor);
+            int id_a, id_d;
+            if (palavra_a == NULL || palavra_d == NULL || proximaPalavra(&cursor) != NULL ||
+                !lerPalavraInteira(palavra_a, &id_a) || !lerPalavraInteira(palavra_d, &id_d) ||
+                id_a < 1 || id_a > mapa->tamanho || id_d < 1 || id_d > mapa->tamanho) {
+                anexarSaida(&saida, "ERRO linha %lld: use '%s A D' com IDs de 1 a %d\n", linha,
+                            blitz ? "blitz" : "atacar", mapa->tamanho);
+                erros++;
+                continue;
+            }
+            ErroAtaque motivo = validarAtaque(mapa, cor_jogador, id_a - 1, id_d - 1);
+            if (motivo != ATAQUE_VALIDO) {
+                anexarSaida(&saida, "ERRO linha %lld: ataque %d %d recusado: %s\n", linha, id_a, id_d,
+                            motivosAtaqueRecusado[motivo]);
+                erros++;
+                continue;
+            }
+            if (blitz) {
+                ResultadoBlitz cerco;
+                resolverBlitz(mapa, id_a - 1, id_d - 1, &cerco, gerador);
+                anexarSaida(&saida, "blitz %d %d: %d rodadas (%d vencidas), perdas %d/%d, tropas %d/%d%s\n", id_a,
+                            id_d, cerco.rodadas, cerco.vitorias, cerco.perdas_atacante, cerco.perdas_defensor,
+                            mapa->tropas[id_a - 1], mapa->tropas[id_d - 1], cerco.conquista ? ", CONQUISTA" : "");
+            } else {
+                ResultadoBatalha resultado;
+                resolverBatalha(mapa, id_a - 1, id_d - 1, &resultado, gerador);
+                anexarSaida(&saida, "atacar %d %d: dados %d x %d, perdas %d/%d, tropas %d/%d%s\n", id_a, id_d,
+                            resultado.dado_ataque, resultado.dado_defesa, resultado.perdas_atacante,
+                            resultado.perdas_defensor, mapa->tropas[id_a - 1], mapa->tropas[id_d - 1],
+                            resultado.conquista ? ", CONQUISTA" : "");
+            }
+            registrarPasso(mapa);
+        } else if (comandoE(comando, "hipotese", "whatif")) {
+            const char* erro = executarHipotese(mapa, cor_jogador, missao, gerador, cursor, &saida);
+            if (erro != NULL) {
+                anexarSaida(&saida, "ERRO linha %lld: %s\n", linha, erro);
+                erros++;
+            }
+        } else if (comandoE(comando, "lote", "batch")) {
+            const char* erro = executarLote(mapa, cor_jogador, gerador, cursor, &saida);
+            if (erro != NULL) {
+                anexarSaida(&saida, "ERRO linha %lld: %s\n", linha, erro);
+                erros++;
+            }
+        } else if (comandoE(comando, "desfazer", "undo") || comandoE(comando, "refazer", "redo")) {
+            int desfazer = comandoE(comando, "desfazer", "undo");
+            if (mapa->diario != NULL || mapa->historico == NULL) {
+                anexarSaida(&saida, "ERRO linha %lld: desfazer indisponivel%s\n", linha,
+                            mapa->diario != NULL ? " com --diario" : "");
+                erros++;
+            } else if (desfazer ? desfazerPasso(mapa) : refazerPasso(mapa)) {
+                anexarSaida(&saida, "%s: passo %d de %d\n", desfazer ? "desfeito" : "refeito", mapa->historico->cursor,
+                            mapa->historico->num_passos - 1);
+            } else {
+                anexarSaida(&saida, "ERRO linha %lld: nada para %s\n", linha, desfazer ? "desfazer" : "refazer");
+                erros++;
+            }
+        } else if (comandoE(comando, "verificar", "check")) {
+            anexarSaida(&saida, "missao %s: %s\n", verificarMissao(missao, mapa, cor_jogador) ? "cumprida" : "pendente",
+                        descreverMissao(missao, cores, texto_missao, sizeof(texto_missao)));
+        } else if (comandoE(comando, "exibir", "show")) {
+            FiltroMapa filtro = { VISAO_COMPLETA, 0, 0, COR_INVALIDA, 0 };
+            const char* invalida = lerOpcoesExibicao(cursor, cores, &filtro);
+            if (invalida != NULL) {
+                anexarSaida(&saida, "ERRO linha %lld: opcao de exibicao invalida '%s'\n", linha, invalida);
+                erros++;
+                continue;
+            }
+            exibirMapa(mapa, cores, &filtro, &saida);
+        } else if (comandoE(comando, "adversarios", "ai")) {
+            if (ia == NULL) {
+                anexarSaida(&saida, "ERRO linha %lld: adversarios desativados (use --ia)\n", linha);
+                erros++;
+                continue;
+            }
+            descarregarSaida(&saida); // O turno imprime com printf()
+            turnoDosAdversarios(mapa, cor_jogador, cores, ia, gerador);
+            registrarPasso(mapa);
+            fflush(stdout);
+        } else if (comandoE(comando, "sair", "quit")) {
+            break;
+        } else {
+            anexarSaida(&saida, "ERRO linha %lld: comando desconhecido '%s'\n", linha, comando);
+            erros++;
+        }
+
+        if (saida.usado >= TAMANHO_BLOCO_SCRIPT) descarregarSaida(&saida);
+    }
+    descarregarSaida(&saida);
+    liberarSaida(&saida);
+    fecharLeitor(&leitor);
+
+    clock_gettime(CLOCK_MONOTONIC, &fim);
+    double segundos = (double)(fim.tv_sec - inicio.tv_sec) + (double)(fim.tv_nsec - inicio.tv_nsec) * 1e-9;
+    fprintf(stderr, "[SCRIPT] %lld comandos, %lld erros em %.3f s (%.0f comandos/s).\n", comandos, erros,
+            segundos, segundos > 0.0 ? (double)comandos / segundos : 0.0);
+    return erros == 0;
+}
+
+// ============================================================================
+// --- Implementação do Diário de Batalhas ---
+// ============================================================================
+
+/**
+ * @brief Grava todo o bloco em um descritor, repetindo em escritas parciais.
+ * @return 1 em caso de sucesso, 0 em caso de erro.
+ */
+static int gravarTudo(int fd, const void* dados, size_t tamanho) {
+    const unsigned char* p = (const unsigned char*)dados;
+    while (tamanho > 0) {
+        ssize_t n = write(fd, p, tamanho);
+        if (n <= 0) return 0;
+        p += n;
+        tamanho -= (size_t)n;
+    }
+    return 1;
+}
+
+static inline uint64_t zigzag(int64_t valor) {
+    return ((uint64_t)valor << 1) ^ (uint64_t)(valor >> 63);
+}
+
+static inline int64_t desfazerZigzag(uint64_t valor) {
+    return (int64_t)(valor >> 1) ^ -(int64_t)(valor & 1);
+}
+
+/**
+ * @brief Codifica um inteiro sem sinal em LEB128 (7 bits por byte).
+ * @return Bytes escritos (no máximo 10).
+ */
+static inline size_t escreverVarint(unsigned char* destino, uint64_t valor) {
+    size_t n = 0;
+    while (valor >= 0x80) {
+        destino[n++] = (unsigned char)(valor | 0x80);
+        valor >>= 7;
+    }
+    destino[n++] = (unsigned char)valor;
+    return n;
+}
+
+/**
+ * @brief Decodifica um LEB128 sem passar de 'fim'.
+ * @return 1 em caso de sucesso, 0 se o valor está truncado ou longo demais.
+ */
+static inline int lerVarint(const unsigned char** p, const unsigned char* fim, uint64_t* valor) {
+    uint64_t v = 0;
+    for (int deslocamento = 0; *p < fim && deslocamento < 64; deslocamento += 7) {
+        unsigned char byte = *(*p)++;
+        v |= (uint64_t)(byte & 0x7F) << deslocamento;
+        if (byte < 0x80) {
+            *valor = v;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Bytes de um instantâneo no .idx: entrada, dono, tropas e alinhamento a 8 bytes.
+ */
+static size_t tamanhoEntradaIndice(int tamanho) {
+    size_t bytes = sizeof(EntradaIndiceDiario) + (size_t)tamanho * (sizeof(CorId) + sizeof(int));
+    return (bytes + 7) & ~(size_t)7;
+}
+
+static int descarregarDiario(DiarioBatalhas* diario) {
+    if (!diario->falhou && !gravarTudo(diario->fd_log, diario->buffer, diario->usado)) {
+        diario->falhou = 1;
+    }
+    diario->usado = 0;
+    return !diario->falhou;
+}
+
+/**
+ * @brief Acrescenta ao .idx um instantâneo do mapa depois do evento atual.
+ */
+static void gravarInstantaneo(DiarioBatalhas* diario, const Mapa* mapa) {
+    EntradaIndiceDiario entrada = {
+        .evento = diario->eventos,
+        .deslocamento = diario->deslocamento,
+        .posicao_gerador = diario->posicao_anterior,
+        .atacante_anterior = (uint32_t)diario->atacante_anterior
+    };
+    static const unsigned char zeros[8] = { 0 };
+    size_t preenchimento = tamanhoEntradaIndice(mapa->tamanho) - sizeof(entrada) -
+                           (size_t)mapa->tamanho * (sizeof(CorId) + sizeof(int));
+    if (!gravarTudo(diario->fd_indice, &entrada, sizeof(entrada)) ||
+        !gravarTudo(diario->fd_indice, mapa->dono, (size_t)mapa->tamanho * sizeof(CorId)) ||
+        !gravarTudo(diario->fd_indice, mapa->tropas, (size_t)mapa->tamanho * sizeof(int)) ||
+        !gravarTudo(diario->fd_indice, zeros, preenchimento)) {
+        diario->falhou = 1;
+    }
+}
+
+/**
+ * @brief Começa a gravar as batalhas do mapa em 'caminho'.
+ * @note Grava o mapa inicial em caminho.wmap e os instantâneos em caminho.idx.
+ *       A partir daqui, cada rodada resolvida por resolverBatalha() vira um evento.
+ * @return 1 em caso de sucesso, 0 se algum arquivo não pôde ser criado.
+ */
+int abrirDiario(Mapa* mapa, const TabelaCores* cores, const char* caminho, uint64_t semente) {
+    char caminho_aux[PATH_MAX];
+    DiarioBatalhas* diario = (DiarioBatalhas*)calloc(1, sizeof(DiarioBatalhas));
+    if (diario == NULL) return 0;
+
+    diario->fd_log = diario->fd_indice = -1;
+    snprintf(caminho_aux, sizeof(caminho_aux), "%s.wmap", caminho);
+    int ok = salvarMapaBinario(mapa, cores, caminho_aux);
+    if (ok) {
+        diario->fd_log = open(caminho, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        snprintf(caminho_aux, sizeof(caminho_aux), "%s.idx", caminho);
+        diario->fd_indice = open(caminho_aux, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ok = diario->fd_log >= 0 && diario->fd_indice >= 0;
+    }
+
+    CabecalhoDiario cabecalho = {
+        .magica = MAGICA_DIARIO,
+        .versao = VERSAO_DIARIO,
+        .tamanho = (uint32_t)mapa->tamanho,
+        .intervalo_instantaneos = INTERVALO_INSTANTANEO,
+        .semente = semente
+    };
+    ok = ok && gravarTudo(diario->fd_log, &cabecalho, sizeof(cabecalho)) &&
+         gravarTudo(diario->fd_indice, &cabecalho, sizeof(cabecalho));
+    if (!ok) {
+        if (diario->fd_log >= 0) close(diario->fd_log);
+        if (diario->fd_indice >= 0) close(diario->fd_indice);
+        free(diario);
+        return 0;
+    }
+
+    diario->deslocamento = sizeof(cabecalho);
+    mapa->diario = diario;
+    return 1;
+}
+
+/**
+ * @brief Acrescenta uma rodada ao buffer do diário (tipicamente 6 bytes).
+ * @note Formato: 1 byte com os dados (6 * (ataque - 1) + defesa - 1) e a conquista
+ *       no bit 6, seguido de varints: atacante (zigzag da diferença para o
+ *       atacante anterior), defensor (zigzag da diferença para o atacante), perdas
+ *       do atacante, perdas do defensor e valores sorteados desde o evento anterior.
+ */
+void registrarBatalha(Mapa* mapa, int atacante, int defensor, const ResultadoBatalha* resultado,
+                      uint64_t posicao_gerador) {
+    DiarioBatalhas* diario = mapa->diario;
+    if (diario->falhou) return;
+    if (diario->usado + MAX_BYTES_EVENTO > sizeof(diario->buffer) && !descarregarDiario(diario)) return;
+
+    unsigned char* p = diario->buffer + diario->usado;
+    size_t n = 0;
+    p[n++] = (unsigned char)((6 * (resultado->dado_ataque - 1) + resultado->dado_defesa - 1) |
+                             (resultado->conquista ? BIT_CONQUISTA : 0));
+    n += escreverVarint(p + n, zigzag((int64_t)atacante - diario->atacante_anterior));
+    n += escreverVarint(p + n, zigzag((int64_t)defensor - atacante));
+    n += escreverVarint(p + n, (uint64_t)resultado->perdas_atacante);
+    n += escreverVarint(p + n, (uint64_t)resultado->perdas_defensor);
+    n += escreverVarint(p + n, posicao_gerador - diario->posicao_anterior);
+
+    diario->usado += n;
+    diario->deslocamento += n;
+    diario->atacante_anterior = atacante;
+    diario->posicao_anterior = posicao_gerador;
+    if (++diario->eventos % INTERVALO_INSTANTANEO == 0) {
+        gravarInstantaneo(diario, mapa);
+    }
+}
+
+/**
+ * @brief Descarrega o buffer e fecha os arquivos do diário.
+ * @return 1 se tudo foi gravado, 0 se houve erro de escrita em algum momento.
+ */
+int fecharDiario(Mapa* mapa) {
+    DiarioBatalhas* diario = mapa->diario;
+    if (diario == NULL) return 1;
+
+    int ok = descarregarDiario(diario);
+    ok = (close(diario->fd_log) == 0) && ok;
+    ok = (close(diario->fd_indice) == 0) && ok;
+    free(diario);
+    mapa->diario = NULL;
+    return ok;
+}
+
+/**
+ * @brief Aplica ao mapa uma rodada já resolvida (usada também pela reprodução).
+ */
+void aplicarBatalha(Mapa* mapa, int atacante, int defensor, const ResultadoBatalha* resultado) {
+    // Toda alteração passa por definirTropas()/transferirTerritorio(), que mantêm os agregados
+    if (resultado->conquista) {
+        // Altera o dono: a cor é um CorId, então a troca é uma única atribuição
+        definirTropas(mapa, defensor, 0);
+        transferirTerritorio(mapa, defensor, mapa->dono[atacante]);
+        definirTropas(mapa, atacante, mapa->tropas[atacante] - 1);
+        definirTropas(mapa, defensor, 1);
+    } else {
+        if (resultado->perdas_defensor > 0) {
+            definirTropas(mapa, defensor, mapa->tropas[defensor] - resultado->perdas_defensor);
+        }
+        if (resultado->perdas_atacante > 0) {
+            definirTropas(mapa, atacante, mapa->tropas[atacante] - resultado->perdas_atacante);
+        }
+    }
+}
+
+/**
+ * @brief Mapeia um arquivo inteiro para leitura.
+ * @return O endereço, ou NULL se não existe, está vazio ou não pôde ser mapeado.
+ */
+static const unsigned char* mapearArquivo(const char* caminho, size_t* tamanho) {
+    int fd = open(caminho, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat info;
+    void* base = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        base = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+
+    *tamanho = (size_t)info.st_size;
+    return (const unsigned char*)base;
+}
+
+/**
+ * @brief Reconstrói o mapa de um diário até o evento 'ate' (ou até o fim, se ate < 0).
+ * @note Parte do instantâneo mais próximo antes de 'ate' e decodifica só o restante.
+ *       As cores do diário são registradas em 'cores', que deve estar vazia.
+ * @param sessao Arena da sessão que recebe o mapa (ver carregarMapaBinario()).
+ * @param resumo Recebe o evento alcançado, o instantâneo de partida e o tempo gasto.
+ * @return O mapa reconstruído, ou NULL se os arquivos estão ausentes ou corrompidos.
+ */
+Mapa* reconstruirDiario(const char* caminho, long long ate, TabelaCores* cores, Arena* sessao,
+                        ResumoReproducao* resumo) {
+    char caminho_aux[PATH_MAX];
+    size_t tamanho_log = 0, tamanho_indice = 0;
+
+    memset(resumo, 0, sizeof(*resumo));
+    snprintf(caminho_aux, sizeof(caminho_aux), "%s.wmap", caminho);
+    Mapa* mapa = carregarMapaBinario(caminho_aux, cores, sessao);
+    const unsigned char* log = mapearArquivo(caminho, &tamanho_log);
+    snprintf(caminho_aux, sizeof(caminho_aux), "%s.idx", caminho);
+    const unsigned char* indice = mapearArquivo(caminho_aux, &tamanho_indice);
+
+    const CabecalhoDiario* cabecalho = (const CabecalhoDiario*)log;
+    int ok = mapa != NULL && log != NULL && tamanho_log >= sizeof(CabecalhoDiario) &&
+             memcmp(cabecalho->magica, MAGICA_DIARIO, sizeof(MAGICA_DIARIO)) == 0 &&
+             cabecalho->versao == VERSAO_DIARIO && cabecalho->tamanho == (uint32_t)mapa->tamanho &&
+             cabecalho->intervalo_instantaneos > 0;
+
+    // Instantâneo mais próximo antes do evento pedido
+    uint64_t evento = 0, deslocamento = sizeof(CabecalhoDiario), posicao = 0;
+    int64_t atacante_anterior = 0;
+    size_t tamanho_entrada = tamanhoEntradaIndice(ok ? mapa->tamanho : 0);
+    if (ok && indice != NULL && tamanho_indice >= sizeof(CabecalhoDiario) && ate != 0) {
+        uint64_t disponiveis = (tamanho_indice - sizeof(CabecalhoDiario)) / tamanho_entrada;
+        uint64_t desejado = (ate < 0) ? disponiveis : (uint64_t)ate / cabecalho->intervalo_instantaneos;
+        if (desejado > disponiveis) desejado = disponiveis;
+        if (desejado > 0) {
+            const unsigned char* p = indice + sizeof(CabecalhoDiario) + (desejado - 1) * tamanho_entrada;
+            const EntradaIndiceDiario* entrada = (const EntradaIndiceDiario*)p;
+            if (entrada->deslocamento <= tamanho_log && entrada->atacante_anterior < (uint32_t)mapa->tamanho) {
+                evento = entrada->evento;
+                deslocamento = entrada->deslocamento;
+                posicao = entrada->posicao_gerador;
+                atacante_anterior = entrada->atacante_anterior;
+                memcpy(mapa->dono, p + sizeof(EntradaIndiceDiario), (size_t)mapa->tamanho * sizeof(CorId));
+                memcpy(mapa->tropas, p + sizeof(EntradaIndiceDiario) + (size_t)mapa->tamanho * sizeof(CorId),
+                       (size_t)mapa->tamanho * sizeof(int));
+            }
+        }
+    }
+
+    struct timespec inicio, fim_tempo;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    resumo->partida = evento;
+    const unsigned char* p = log + deslocamento;
+    const unsigned char* fim = log + (ok ? tamanho_log : deslocamento);
+    int n = ok ? mapa->tamanho : 0;
+    while (ok && p < fim && (ate < 0 || evento < (uint64_t)ate)) {
+        uint64_t dif_atacante, dif_defensor, perdas_a, perdas_d, sorteados;
+        unsigned char dados = *p++;
+        ResultadoBatalha resultado;
+
+        ok = (dados & ~BIT_CONQUISTA) < 36 &&
+             lerVarint(&p, fim, &dif_atacante) && lerVarint(&p, fim, &dif_defensor) &&
+             lerVarint(&p, fim, &perdas_a) && lerVarint(&p, fim, &perdas_d) && lerVarint(&p, fim, &sorteados);
+        int64_t atacante = atacante_anterior + desfazerZigzag(dif_atacante);
+        int64_t defensor = atacante + desfazerZigzag(dif_defensor);
+        ok = ok && atacante >= 0 && atacante < n && defensor >= 0 && defensor < n &&
+             perdas_a <= INT32_MAX && perdas_d <= INT32_MAX;
+        if (!ok) break;
+
+        resultado.dado_ataque = (dados & ~BIT_CONQUISTA) / 6 + 1;
+        resultado.dado_defesa = (dados & ~BIT_CONQUISTA) % 6 + 1;
+        resultado.conquista = (dados & BIT_CONQUISTA) != 0;
+        resultado.perdas_atacante = (int)perdas_a;
+        resultado.perdas_defensor = (int)perdas_d;
+        aplicarBatalha(mapa, (int)atacante, (int)defensor, &resultado);
+
+        atacante_anterior = atacante;
+        posicao += sorteados;
+        evento++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &fim_tempo);
+
+    resumo->evento = evento;
+    resumo->posicao_gerador = posicao;
+    resumo->semente = ok ? cabecalho->semente : 0;
+    resumo->segundos = (double)(fim_tempo.tv_sec - inicio.tv_sec) + (fim_tempo.tv_nsec - inicio.tv_nsec) / 1e9;
+    if (log != NULL) munmap((void*)log, tamanho_log);
+    if (indice != NULL) munmap((void*)indice, tamanho_indice);
+    if (!ok) {
+        liberarMemoria(mapa);
+        return NULL;
+    }
+    return mapa;
+}
+
+/**
+ * @brief Modo --reproduzir: reconstrói o mapa e exibe o resumo por cor e a taxa de eventos.
+ * @return 1 em caso de sucesso, 0 se o diário é inválido.
+ */
+int reproduzirDiario(const char* caminho, long long ate) {
+    TabelaCores cores = { .quantidade = 0 };
+    Arena sessao = { 0 };
+    ResumoReproducao resumo;
+
+    Mapa* mapa = reconstruirDiario(caminho, ate, &cores, &sessao, &resumo);
+    if (mapa == NULL) {
+        printf("ERRO: Diario '%s' inexistente ou corrompido (evento %llu).\n", caminho,
+               (unsigned long long)resumo.evento + 1);
+        destruirArena(&sessao);
+        return 0;
+    }
+
+    uint64_t reproduzidos = resumo.evento - resumo.partida;
+    printf("Diario '%s' (semente %llu): estado apos o evento %llu.\n", caminho,
+           (unsigned long long)resumo.semente, (unsigned long long)resumo.evento);
+    printf("Instantaneo inicial: evento %llu. Reproduzidos %llu eventos em %.3f ms",
+           (unsigned long long)resumo.partida, (unsigned long long)reproduzidos, resumo.segundos * 1e3);
+    if (resumo.segundos > 0 && reproduzidos > 0) {
+        printf(" (%.1f milhoes de eventos/s)", reproduzidos / resumo.segundos / 1e6);
+    }
+    printf(".\nPosicao do gerador: %llu valores sorteados.\n", (unsigned long long)resumo.posicao_gerador);
+
+    for (int c = 0; c < cores.quantidade; c++) {
+        printf("  %-10s %d territorios\n", cores.nomes[c], contarTerritoriosDaCor(mapa, (CorId)c));
+    }
+    FiltroMapa visao = { VISAO_COMPLETA, 0, mapa->tamanho > LIMITE_TABELA_COMPLETA ? LINHAS_POR_PAGINA : 0,
+                         COR_INVALIDA, 0 };
+    BufferSaida saida = { 0 };
+    exibirMapa(mapa, &cores, &visao, &saida);
+    liberarSaida(&saida);
+
+    liberarMemoria(mapa);
+    destruirArena(&sessao);
+    return 1;
+}
+
+// ============================================================================
+// --- Implementação do Motor de Batalha (sem E/S) ---
+// ============================================================================
+
+/**
+ * @brief Ordena até 3 dados em ordem decrescente (rede de comparação e troca).
+ */
+static inline void ordenarDados(int* dados, int quantidade) {
+    int t;
+#define TROCAR_SE_MENOR(i, j) \
+    if (dados[i] < dados[j]) { t = dados[i]; dados[i] = dados[j]; dados[j] = t; }
+    if (quantidade > 1) TROCAR_SE_MENOR(0, 1);
+    if (quantidade > 2) {
+        TROCAR_SE_MENOR(1, 2);
+        TROCAR_SE_MENOR(0, 1);
+    }
+#undef TROCAR_SE_MENOR
+}
+
+/**
+ * @brief Núcleo genérico de uma rodada de batalha, sem tocar no mapa.
+ * @note Só é chamado pelas instâncias de DEFINIR_REGRA_BATALHA, com as quatro
+ *       regras como constantes: o compilador desenrola os laços e elimina os
+ *       ramos que a regra não usa. Os dados do atacante são sorteados antes
+ *       dos do defensor (na regra duelo, a mesma sequência de sempre).
+ */
+static inline __attribute__((always_inline)) void sortearRodada(int max_ataque, int max_defesa, int perde_metade,
+                                                                int empate_atacante, int tropas_atacante,
+                                                                int tropas_defensor, ResultadoBatalha* resultado,
+                                                                GeradorAleatorio* gerador) {
+    int ataque[3], defesa[3];
+    int num_ataque = (tropas_atacante - 1 < max_ataque) ? tropas_atacante - 1 : max_ataque;
+    int num_defesa = (tropas_defensor < max_defesa) ? tropas_defensor : max_defesa;
+    if (num_ataque < 1) num_ataque = 1;
+    if (num_defesa < 1) num_defesa = 1;
+
+    for (int i = 0; i < num_ataque; i++) ataque[i] = rolarDado(gerador);
+    for (int i = 0; i < num_defesa; i++) defesa[i] = rolarDado(gerador);
+    ordenarDados(ataque, num_ataque);
+    ordenarDados(defesa, num_defesa);
+
+    resultado->dado_ataque = ataque[0];
+    resultado->dado_defesa = defesa[0];
+    resultado->perdas_atacante = 0;
+    resultado->perdas_defensor = 0;
+
+    int vitorias = 0;
+    int pares = (num_ataque < num_defesa) ? num_ataque : num_defesa;
+    for (int i = 0; i < pares; i++) {
+        if (empate_atacante ? ataque[i] >= defesa[i] : ataque[i] > defesa[i]) {
+            vitorias++;
+        } else {
+            resultado->perdas_atacante++;
+        }
+    }
+    if (perde_metade) {
+        // Na regra duelo, cada vitória custa ao defensor a metade (arredondada para cima)
+        resultado->perdas_defensor = (vitorias > 0 && tropas_defensor > 0) ? (tropas_defensor + 1) / 2 : 0;
+    } else {
+        resultado->perdas_defensor = vitorias;
+    }
+    resultado->conquista = (vitorias > 0 && tropas_defensor - resultado->perdas_defensor <= 0);
+}
+
+/**
+ * @brief Sorteia quantas rodadas o atacante perde antes da próxima vitória.
+ * @note Cada rodada é vencida com probabilidade p = 15/36, então a espera é
+ *       geométrica: floor(ln U / ln(1 - p)), com U uniforme em (0, 1].
+ */
+static int sortearDerrotasAteVitoria(GeradorAleatorio* gerador) {
+    double u = (double)((proximoAleatorio(gerador) >> 11) + 1) * 0x1.0p-53;
+    double derrotas = floor(log(u) / log1p(-PROB_VITORIA_ATAQUE));
+    return derrotas < (double)INT_MAX ? (int)derrotas : INT_MAX;
+}
+
+/**
+ * @brief Cerco da regra duelo sem rolar cada rodada.
+ * @note Cada vitória do atacante reduz o defensor à metade (arredondada para baixo),
+ *       então o cerco termina em no máximo log2(D) + 1 vitórias. Em vez de rolar cada
+ *       rodada, sorteia-se a sequência de derrotas entre vitórias consecutivas
+ *       (binomial negativa), e o custo não depende do número de rodadas.
+ */
+static void sitiarPorEsperas(int tropas_atacante, int tropas_defensor, ResultadoBlitz* resultado,
+                             GeradorAleatorio* gerador) {
+    int derrotas_possiveis = tropas_atacante - 1;
+
+    for (;;) {
+        int derrotas = sortearDerrotasAteVitoria(gerador);
+        if (derrotas >= derrotas_possiveis - resultado->perdas_atacante) {
+            // O atacante chega a 1 tropa antes da próxima vitória
+            resultado->rodadas += derrotas_possiveis - resultado->perdas_atacante;
+            resultado->perdas_atacante = derrotas_possiveis;
+            break;
+        }
+        resultado->perdas_atacante += derrotas;
+        resultado->rodadas += derrotas + 1;
+        resultado->vitorias++;
+
+        int perdas = (tropas_defensor + 1) / 2;
+        resultado->perdas_defensor += perdas;
+        tropas_defensor -= perdas;
+        if (tropas_defensor <= 0) {
+            resultado->conquista = 1;
+            break;
+        }
+    }
+}
+
+/**
+ * @brief ln(k!), exato até 15 e pela série de Stirling acima disso.
+ * @note Não usa lgamma(), que altera a global signgam e seria uma corrida de dados
+ *       entre as threads de resolverLoteParalelo().
+ */
+static double logFatorial(int k) {
+    static const double exatos[16] = {
+        0.0, 0.0, 0.69314718055994531, 1.79175946922805500, 3.17805383034794562, 4.78749174278204599,
+        6.57925121201010100, 8.52516136106541430, 10.60460290274525023, 12.80182748008146961,
+        15.10441257307551530, 17.50230784587388584, 19.98721449566188615, 22.55216385312342289,
+        25.19122118273868150, 27.89927138384089157,
+    };
+    if (k < 16) return exatos[k];
+    double x = (double)k + 1.0, inverso = 1.0 / x, inverso2 = inverso * inverso;
+    return (x - 0.5) * log(x) - x + 0.91893853320467274 +
+           inverso * (1.0 / 12.0 - inverso2 * (1.0 / 360.0 - inverso2 * (1.0 / 1260.0 - inverso2 / 1680.0)));
+}
+
+/**
+ * @brief Sorteia uma binomial (n ensaios com probabilidade p) em tempo esperado constante.
+ * @note Com n*p pequeno, inverte a distribuição somando os termos; acima disso, usa a
+ *       rejeição transformada BTRS de Hörmann (1993), que aceita ~90% das propostas.
+ */
+static int sortearBinomial(GeradorAleatorio* gerador, int n, double p) {
+    if (n <= 0 || p <= 0.0) return 0;
+    if (p >= 1.0) return n;
+    if (p > 0.5) return n - sortearBinomial(gerador, n, 1.0 - p);
+
+    double q = 1.0 - p;
+    if ((double)n * p < 10.0) {
+        double u = (double)(proximoAleatorio(gerador) >> 11) * 0x1.0p-53;
+        double termo = exp((double)n * log1p(-p)), razao = p / q;
+        int k = 0;
+        while (u > termo && k < n) {
+            u -= termo;
+            termo *= razao * (double)(n - k) / (double)(k + 1);
+            k++;
+        }
+        return k;
+    }
+
+    double spq = sqrt((double)n * p * q);
+    double b = 1.15 + 2.53 * spq;
+    double a = -0.0873 + 0.0248 * b + 0.01 * p;
+    double c = (double)n * p + 0.5;
+    double v_r = 0.92 - 4.2 / b;
+    double alfa = (2.83 + 5.1 / b) * spq;
+    double lpq = log(p / q);
+    int m = (int)floor((double)(n + 1) * p);
+    double h = logFatorial(m) + logFatorial(n - m);
+    for (;;) {
+        double u = (double)(proximoAleatorio(gerador) >> 11) * 0x1.0p-53 - 0.5;
+        double v = (double)((proximoAleatorio(gerador) >> 11) + 1) * 0x1.0p-53;
+        double us = 0.5 - fabs(u);
+        double k = floor((2.0 * a / us + b) * u + c);
+        if (k < 0.0 || k > (double)n) continue;
+        if (us >= 0.07 && v <= v_r) return (int)k;
+        v = log(v * alfa / (a / (us * us) + b));
+        if (v <= h - logFatorial((int)k) - logFatorial(n - (int)k) + (k - m) * lpq) return (int)k;
+    }
+}
+
+/**
+ * @brief Avança em blocos as rodadas de um cerco de vários dados em que nenhum lado
+ *        muda de número de dados; as demais ficam para o laço rodada a rodada.
+ * @note Com 4+ tropas no atacante e max_defesa ou mais no defensor, toda rodada é 3
+ *       dados contra max_defesa, custa exatamente max_defesa tropas e tem a mesma
+ *       distribuição de pares vencidos (contagens exatas sobre as 6^(3+max_defesa)
+ *       combinações de dados). Um bloco de rodadas que não pode sair dessa faixa é
+ *       então uma multinomial, sorteada com binomiais encadeadas. Cada bloco consome
+ *       uma fração da margem até a borda da faixa, então o custo cresce com o log das
+ *       tropas, e não com o número de rodadas.
+ */
+static inline __attribute__((always_inline)) void sitiarEmBlocos(int max_defesa, int empate_atacante,
+                                                                 int tropas_atacante, int tropas_defensor,
+                                                                 ResultadoBlitz* resultado,
+                                                                 GeradorAleatorio* gerador) {
+    // Rodadas com 0, 1, 2 (e 3) pares vencidos pelo atacante
+    static const uint32_t contagens_3x2[] = { 2275, 2611, 2890 };
+    static const uint32_t contagens_3x3[] = { 17871, 12348, 10017, 6420 };
+    static const uint32_t contagens_empate[] = { 979, 1981, 4816 };
+    const uint32_t* contagens = empate_atacante ? contagens_empate : (max_defesa == 3 ? contagens_3x3 : contagens_3x2);
+    const uint32_t combinacoes = (max_defesa == 3) ? 46656 : 7776;
+
+    for (;;) {
+        int margem_atacante = tropas_atacante - resultado->perdas_atacante - 4;
+        int margem_defensor = tropas_defensor - resultado->perdas_defensor - max_defesa;
+        int margem = (margem_atacante < margem_defensor) ? margem_atacante : margem_defensor;
+        // Após o bloco, os dois lados ainda estão na faixa: nenhum bloco encerra o cerco
+        int rodadas = margem / max_defesa;
+        if (rodadas < RODADAS_MINIMAS_BLOCO) return;
+
+        int restantes = rodadas, perdas_defensor = 0;
+        uint32_t restante = combinacoes;
+        for (int k = 0; k < max_defesa && restantes > 0; k++) {
+            int sorteadas = sortearBinomial(gerador, restantes, (double)contagens[k] / (double)restante);
+            restante -= contagens[k];
+            restantes -= sorteadas;
+            perdas_defensor += k * sorteadas;
+        }
+        perdas_defensor += max_defesa * restantes;
+
+        resultado->rodadas += rodadas;
+        resultado->vitorias += restantes; // Rodadas em que o atacante venceu todos os pares
+        resultado->perdas_defensor += perdas_defensor;
+        resultado->perdas_atacante += rodadas * max_defesa - perdas_defensor;
+    }
+}
+
+/**
+ * @brief Gera os núcleos de uma regra de batalha: sortearBatalha<Regra>() para uma
+ *        rodada e sitiar<Regra>() para um cerco inteiro (até conquistar ou o
+ *        atacante ficar com 1 tropa), com o núcleo da rodada embutido no laço.
+ * @note A regra duelo (1 x 1, metade, empate da defesa) tem vitória com
+ *       probabilidade fixa por rodada e usa sitiarPorEsperas(); as de 3 dados passam
+ *       antes por sitiarEmBlocos(). A escolha é feita pelo compilador, pois as
+ *       condições são constantes.
+ */
+#define DEFINIR_REGRA_BATALHA(Regra, NOME, DESCRICAO, MAX_ATAQUE, MAX_DEFESA, PERDE_METADE, EMPATE_ATACANTE)       \
+    static void sortearBatalha##Regra(int tropas_atacante, int tropas_defensor, ResultadoBatalha* resultado,     \
+                                      GeradorAleatorio* gerador) {                                             \
+        sortearRodada(MAX_ATAQUE, MAX_DEFESA, PERDE_METADE, EMPATE_ATACANTE, tropas_atacante, tropas_defensor, \
+                      resultado, gerador);                                                                     \
+    }                                                                                                          \
+    static void sitiar##Regra(int tropas_atacante, int tropas_defensor, ResultadoBlitz* resultado,              \
+                              GeradorAleatorio* gerador) {                                                     \
+        memset(resultado, 0, sizeof(*resultado));                                                              \
+        if (MAX_ATAQUE == 1 && MAX_DEFESA == 1 && PERDE_METADE && !EMPATE_ATACANTE) {                          \
+            sitiarPorEsperas(tropas_atacante, tropas_defensor, resultado, gerador);                            \
+            return;                                                                                            \
+        }                                                                                                      \
+        if (MAX_ATAQUE == 3) {                                                                                 \
+            sitiarEmBlocos(MAX_DEFESA, EMPATE_ATACANTE, tropas_atacante, tropas_defensor, resultado, gerador); \
+        }                                                                                                      \
+        ResultadoBatalha rodada;                                                                               \
+        while (tropas_atacante - resultado->perdas_atacante > 1) {                                             \
+            sortearRodada(MAX_ATAQUE, MAX_DEFESA, PERDE_METADE, EMPATE_ATACANTE,                               \
+                          tropas_atacante - resultado->perdas_atacante,                                        \
+                          tropas_defensor - resultado->perdas_defensor, &rodada, gerador);                     \
+            resultado->rodadas++;                                                                              \
+            resultado->vitorias += (rodada.perdas_atacante == 0);                                              \
+            resultado->perdas_atacante += rodada.perdas_atacante;                                              \
+            resultado->perdas_defensor += rodada.perdas_defensor;                                              \
+            if (rodada.conquista) {                                                                            \
+                resultado->conquista = 1;                                                                      \
+                break;                                                                                         \
+            }                                                                                                  \
+        }                                                                                                      \
+    }                                                                                                          \
+    static const RegraBatalhaInfo regraBatalha##Regra = { NOME, DESCRICAO, MAX_ATAQUE, MAX_DEFESA,            \
+                                                          PERDE_METADE, EMPATE_ATACANTE,                       \
+                                                          sortearBatalha##Regra, sitiar##Regra };
+
+DEFINIR_REGRA_BATALHA(Duelo, "duelo", "1 dado contra 1; vitoria custa ao defensor metade das tropas", 1, 1, 1, 0)
+DEFINIR_REGRA_BATALHA(Classica, "classica", "ate 3 dados contra 2; cada par comparado custa 1 tropa", 3, 2, 0, 0)
+DEFINIR_REGRA_BATALHA(Brasileira, "brasileira", "ate 3 dados contra 3; cada par comparado custa 1 tropa", 3, 3, 0, 0)
+DEFINIR_REGRA_BATALHA(EmpateAtacante, "empate-atacante", "como a classica, mas o empate favorece o atacante", 3, 2,
+                      0, 1)
+
+static const RegraBatalhaInfo* const regras_batalha[TOTAL_REGRAS_BATALHA] = {
+    [REGRA_DUELO] = &regraBatalhaDuelo,
+    [REGRA_CLASSICA] = &regraBatalhaClassica,
+    [REGRA_BRASILEIRA] = &regraBatalhaBrasileira,
+    [REGRA_EMPATE_ATACANTE] = &regraBatalhaEmpateAtacante,
+};
+
+/**
+ * @brief Procura uma regra de batalha pelo nome (ex.: "classica").
+ * @return A regra, ou -1 se o nome não existe.
+ */
+int buscarRegraBatalha(const char* nome) {
+    for (int r = 0; r < TOTAL_REGRAS_BATALHA; r++) {
+        if (strcmp(regras_batalha[r]->nome, nome) == 0) return r;
+    }
+    return -1;
+}
+
+const char* descreverRegraBatalha(RegraBatalha regra) {
+    return regras_batalha[regra]->descricao;
+}
+
+/**
+ * @brief Lista as regras de batalha, uma por linha.
+ */
+void listarRegrasBatalha(void) {
+    for (int r = 0; r < TOTAL_REGRAS_BATALHA; r++) {
+        printf("  %-16s %s\n", regras_batalha[r]->nome, regras_batalha[r]->descricao);
+    }
+}
+
+/**
+ * @brief Núcleo escalar de compararDadosEmLote(), também usado para as rodadas
+ *        que sobram depois dos blocos vetoriais.
+ */
+static void compararDadosEscalar(unsigned char* const ataque[3], unsigned char* const defesa[3], int empate_atacante,
+                                 int inicio, int rodadas, unsigned char* perdas_atacante,
+                                 unsigned char* perdas_defensor) {
+    for (int i = inicio; i < rodadas; i++) {
+        int a[3] = { ataque[0][i], ataque[1][i], ataque[2][i] };
+        int d[3] = { defesa[0][i], defesa[1][i], defesa[2][i] };
+        ordenarDados(a, 3);
+        ordenarDados(d, 3);
+
+        int pa = 0, pd = 0;
+        for (int j = 0; j < 3; j++) {
+            int valido = (a[j] != 0) & (d[j] != 0);
+            int vence = empate_atacante ? a[j] >= d[j] : a[j] > d[j];
+            pd += valido & vence;
+            pa += valido & !vence;
+        }
+        for (int j = 0; j < 3; j++) {
+            ataque[j][i] = (unsigned char)a[j];
+            defesa[j][i] = (unsigned char)d[j];
+        }
+        perdas_atacante[i] = (unsigned char)pa;
+        perdas_defensor[i] = (unsigned char)pd;
+    }
+}
+
+#if WAR_SIMD_X86
+
+// Comparador da rede de ordenação: 'a' fica com o maior e 'b' com o menor, byte a byte
+#define ORDENAR_BYTES_AVX2(a, b)             \
+    do {                                     \
+        __m256i maior = _mm256_max_epu8(a, b); \
+        b = _mm256_min_epu8(a, b);           \
+        a = maior;                           \
+    } while (0)
+
+/**
+ * @brief compararDadosEmLote() com AVX2: 32 rodadas por iteração, uma por byte.
+ * @return Quantas rodadas foram resolvidas (múltiplo de 32).
+ */
+__attribute__((target("avx2")))
+static int compararDadosAVX2(unsigned char* const ataque[3], unsigned char* const defesa[3], int empate_atacante,
+                             int rodadas, unsigned char* perdas_atacante, unsigned char* perdas_defensor) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i um = _mm256_set1_epi8(1);
+    int i = 0;
+
+    for (; i + 32 <= rodadas; i += 32) {
+        __m256i a[3], d[3];
+        for (int j = 0; j < 3; j++) {
+            a[j] = _mm256_loadu_si256((const __m256i*)(ataque[j] + i));
+            d[j] = _mm256_loadu_si256((const __m256i*)(defesa[j] + i));
+        }
+        // Rede de 3 comparadores: (0,1), (1,2), (0,1)
+        ORDENAR_BYTES_AVX2(a[0], a[1]);
+        ORDENAR_BYTES_AVX2(a[1], a[2]);
+        ORDENAR_BYTES_AVX2(a[0], a[1]);
+        ORDENAR_BYTES_AVX2(d[0], d[1]);
+        ORDENAR_BYTES_AVX2(d[1], d[2]);
+        ORDENAR_BYTES_AVX2(d[0], d[1]);
+
+        __m256i pa = zero, pd = zero;
+        for (int j = 0; j < 3; j++) {
+            // Par válido: os dois dados existem (dado ausente vale 0); 1 por byte válido
+            __m256i valido = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(a[j], d[j]), zero), um);
+            __m256i vence = empate_atacante ? _mm256_cmpeq_epi8(_mm256_max_epu8(a[j], d[j]), a[j])
+                                            : _mm256_cmpgt_epi8(a[j], d[j]);
+            pd = _mm256_add_epi8(pd, _mm256_and_si256(vence, valido));
+            pa = _mm256_add_epi8(pa, _mm256_andnot_si256(vence, valido));
+        }
+        for (int j = 0; j < 3; j++) {
+            _mm256_storeu_si256((__m256i*)(ataque[j] + i), a[j]);
+            _mm256_storeu_si256((__m256i*)(defesa[j] + i), d[j]);
+        }
+        _mm256_storeu_si256((__m256i*)(perdas_atacante + i), pa);
+        _mm256_storeu_si256((__m256i*)(perdas_defensor + i), pd);
+    }
+    return i;
+}
+
+#define ORDENAR_BYTES_SSE2(a, b)          \
+    do {                                  \
+        __m128i maior = _mm_max_epu8(a, b); \
+        b = _mm_min_epu8(a, b);           \
+        a = maior;                        \
+    } while (0)
+
+/**
+ * @brief compararDadosEmLote() com SSE2: 16 rodadas por iteração.
+ * @return Quantas rodadas foram resolvidas (múltiplo de 16).
+ */
+static int compararDadosSSE2(unsigned char* const ataque[3], unsigned char* const defesa[3], int empate_atacante,
+                             int rodadas, unsigned char* perdas_atacante, unsigned char* perdas_defensor) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i um = _mm_set1_epi8(1);
+    int i = 0;
+
+    for (; i + 16 <= rodadas; i += 16) {
+        __m128i a[3], d[3];
+        for (int j = 0; j < 3; j++) {
+            a[j] = _mm_loadu_si128((const __m128i*)(ataque[j] + i));
+            d[j] = _mm_loadu_si128((const __m128i*)(defesa[j] + i));
+        }
+        ORDENAR_BYTES_SSE2(a[0], a[1]);
+        ORDENAR_BYTES_SSE2(a[1], a[2]);
+        ORDENAR_BYTES_SSE2(a[0], a[1]);
+        ORDENAR_BYTES_SSE2(d[0], d[1]);
+        ORDENAR_BYTES_SSE2(d[1], d[2]);
+        ORDENAR_BYTES_SSE2(d[0], d[1]);
+
+        __m128i pa = zero, pd = zero;
+        for (int j = 0; j < 3; j++) {
+            __m128i valido = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_min_epu8(a[j], d[j]), zero), um);
+            __m128i vence = empate_atacante ? _mm_cmpeq_epi8(_mm_max_epu8(a[j], d[j]), a[j])
+                                            : _mm_cmpgt_epi8(a[j], d[j]);
+            pd = _mm_add_epi8(pd, _mm_and_si128(vence, valido));
+            pa = _mm_add_epi8(pa, _mm_andnot_si128(vence, valido));
+        }
+        for (int j = 0; j < 3; j++) {
+            _mm_storeu_si128((__m128i*)(ataque[j] + i), a[j]);
+            _mm_storeu_si128((__m128i*)(defesa[j] + i), d[j]);
+        }
+        _mm_storeu_si128((__m128i*)(perdas_atacante + i), pa);
+        _mm_storeu_si128((__m128i*)(perdas_defensor + i), pd);
+    }
+    return i;
+}
+
+#undef ORDENAR_BYTES_AVX2
+#undef ORDENAR_BYTES_SSE2
+
+#endif
+
+/**
+ * @brief Ordena e compara os dados de várias rodadas independentes de uma vez.
+ * @note Os dados ficam em planos (ataque[j][i] é o j-ésimo dado da rodada i), com
+ *       0 para dado ausente: até 3 contra 3 cobre todas as regras de vários dados.
+ *       Ao final, cada plano está em ordem decrescente (ataque[0][i] é o maior dado)
+ *       e as perdas são as de sortearRodada() sem perda da metade. Sem desvios por
+ *       rodada: AVX2 resolve 32 rodadas por iteração e SSE2, 16.
+ */
+void compararDadosEmLote(unsigned char* const ataque[3], unsigned char* const defesa[3], int empate_atacante,
+                         int rodadas, unsigned char* perdas_atacante, unsigned char* perdas_defensor) {
+    int feitas = 0;
+#if WAR_SIMD_X86
+    if (__builtin_cpu_supports("avx2")) {
+        feitas = compararDadosAVX2(ataque, defesa, empate_atacante, rodadas, perdas_atacante, perdas_defensor);
+    } else {
+        feitas = compararDadosSSE2(ataque, defesa, empate_atacante, rodadas, perdas_atacante, perdas_defensor);
+    }
+#endif
+    compararDadosEscalar(ataque, defesa, empate_atacante, feitas, rodadas, perdas_atacante, perdas_defensor);
+}
+
+/**
+ * @brief Quantos dados cada lado rola numa rodada da regra (o mesmo cálculo de sortearRodada()).
+ */
+static inline void contarDadosDaRodada(const RegraBatalhaInfo* regra, int tropas_atacante, int tropas_defensor,
+                                       int* num_ataque, int* num_defesa) {
+    *num_ataque = (tropas_atacante - 1 < regra->max_ataque) ? tropas_atacante - 1 : regra->max_ataque;
+    *num_defesa = (tropas_defensor < regra->max_defesa) ? tropas_defensor : regra->max_defesa;
+    if (*num_ataque < 1) *num_ataque = 1;
+    if (*num_defesa < 1) *num_defesa = 1;
+}
+
+/**
+ * @brief Resolve 'rodadas' rodadas em planos contíguos (3 de ataque, 3 de defesa e
+ *        as duas perdas, 'rodadas' bytes cada) por um dos núcleos de compararDadosEmLote().
+ * @param caminho 0 = escalar, 1 = SSE2, 2 = AVX2 (as sobras vão sempre para o escalar).
+ */
+static void compararDadosPorCaminho(unsigned char* planos, int rodadas, int caminho, int empate_atacante) {
+    size_t n = (size_t)rodadas;
+    unsigned char* const ataque[3] = { planos, planos + n, planos + 2 * n };
+    unsigned char* const defesa[3] = { planos + 3 * n, planos + 4 * n, planos + 5 * n };
+    unsigned char* perdas_atacante = planos + 6 * n;
+    unsigned char* perdas_defensor = planos + 7 * n;
+    int feitas = 0;
+#if WAR_SIMD_X86
+    if (caminho == 2) {
+        feitas = compararDadosAVX2(ataque, defesa, empate_atacante, rodadas, perdas_atacante, perdas_defensor);
+    } else if (caminho == 1) {
+        feitas = compararDadosSSE2(ataque, defesa, empate_atacante, rodadas, perdas_atacante, perdas_defensor);
+    }
+#else
+    (void)caminho;
+#endif
+    compararDadosEscalar(ataque, defesa, empate_atacante, feitas, rodadas, perdas_atacante, perdas_defensor);
+}
+
+/**
+ * @brief Confere os núcleos de compararDadosEmLote() (escalar, SSE2 e AVX2) entre si
+ *        e contra o sortear da regra, rodada a rodada, sobre os mesmos dados.
+ * @note Usada por Benchmark --verificar: numa máquina com AVX2 o caminho SSE2 nunca
+ *       roda nas partidas. Cobre as regras de vários dados, de 1 a 3 dados por lado;
+ *       'rodadas' que não seja múltiplo de 32 exercita também as sobras.
+ * @return 1 se tudo confere, 0 caso contrário (com mensagem em stderr).
+ */
+int conferirCompararDados(int rodadas, uint64_t semente) {
+    static const char* const nomes_caminhos[] = { "escalar", "SSE2", "AVX2" };
+    int caminhos = 1;
+#if WAR_SIMD_X86
+    caminhos = __builtin_cpu_supports("avx2") ? 3 : 2;
+#endif
+    size_t n = (size_t)rodadas;
+    unsigned char* planos = (unsigned char*)malloc(3 * 8 * n);
+    ResultadoBatalha* esperado = (ResultadoBatalha*)malloc(n * sizeof(ResultadoBatalha));
+    int ok = (planos != NULL && esperado != NULL && rodadas > 0);
+    if (!ok) fprintf(stderr, "ERRO: Falha ao alocar memoria para conferir os dados.\n");
+
+    for (int r = 0; ok && r < TOTAL_REGRAS_BATALHA; r++) {
+        const RegraBatalhaInfo* regra = regras_batalha[r];
+        if (regra->perde_metade) continue;
+
+        // Os dados de cada rodada são os que o sortear da regra rola com o mesmo gerador
+        GeradorAleatorio gerador;
+        semearGerador(&gerador, semente, (uint64_t)r);
+        memset(planos, 0, 8 * n);
+        for (int i = 0; i < rodadas; i++) {
+            int tropas_atacante = 2 + (int)(proximoAleatorio(&gerador) % 4);
+            int tropas_defensor = 1 + (int)(proximoAleatorio(&gerador) % 4);
+            GeradorAleatorio copia = gerador;
+            regra->sortear(tropas_atacante, tropas_defensor, &esperado[i], &copia);
+
+            int num_ataque, num_defesa;
+            contarDadosDaRodada(regra, tropas_atacante, tropas_defensor, &num_ataque, &num_defesa);
+            for (int j = 0; j < num_ataque; j++) planos[j * n + (size_t)i] = (unsigned char)rolarDado(&gerador);
+            for (int j = 0; j < num_defesa; j++) planos[(3 + j) * n + (size_t)i] = (unsigned char)rolarDado(&gerador);
+        }
+        for (int c = 1; c < caminhos; c++) memcpy(planos + (size_t)c * 8 * n, planos, 8 * n);
+        for (int c = 0; c < caminhos; c++) {
+            compararDadosPorCaminho(planos + (size_t)c * 8 * n, rodadas, c, regra->empate_atacante);
+        }
+
+        for (int c = 1; ok && c < caminhos; c++) {
+            if (memcmp(planos + (size_t)c * 8 * n, planos, 8 * n) != 0) {
+                fprintf(stderr, "ERRO: compararDadosEmLote (%s) diverge do escalar na regra %s.\n",
+                        nomes_caminhos[c], regra->nome);
+                ok = 0;
+            }
+        }
+        for (int i = 0; ok && i < rodadas; i++) {
+            if (planos[6 * n + (size_t)i] != esperado[i].perdas_atacante ||
+                planos[7 * n + (size_t)i] != esperado[i].perdas_defensor ||
+                planos[(size_t)i] != esperado[i].dado_ataque || planos[3 * n + (size_t)i] != esperado[i].dado_defesa) {
+                fprintf(stderr, "ERRO: compararDadosEmLote diverge de sortearRodada na regra %s, rodada %d.\n",
+                        regra->nome, i);
+                ok = 0;
+            }
+        }
+    }
+    free(planos);
+    free(esperado);
+    return ok;
+}
+
+/**
+ * @brief Acrescenta 'tamanho' bytes ao espalhamento FNV-1a de 64 bits 'h'.
+ */
+static uint64_t espalharBytes(uint64_t h, const void* dados, size_t tamanho) {
+    const unsigned char* p = (const unsigned char*)dados;
+    for (size_t i = 0; i < tamanho; i++) h = (h ^ p[i]) * 1099511628211ull;
+    return h;
+}
+
+/**
+ * @brief Monta um mapa em grade, resolve nele um lote de ataques com 'num_threads'
+ *        threads e resume mapa, resultados e gerador num espalhamento.
+ * @note Tropas baixas e 4 pedidos por território: há pedidos inválidos, conquistas
+ *       e territórios disputados por vários níveis de conflito.
+ * @return 1 em caso de sucesso, 0 se faltou memória.
+ */
+static int espalharLoteDeConferencia(int tamanho, RegraBatalha regra, int num_threads, uint64_t semente,
+                                     uint64_t* espalhamento) {
+    Arena sessao = { 0 };
+    Mapa* mapa = alocarMapa(&sessao, tamanho);
+    if (mapa == NULL) return 0;
+
+    int colunas, quantidade = 4 * tamanho;
+    PedidoAtaque* pedidos = (PedidoAtaque*)malloc((size_t)quantidade * sizeof(PedidoAtaque));
+    ResultadoBatalha* resultados = (ResultadoBatalha*)malloc((size_t)quantidade * sizeof(ResultadoBatalha));
+    GeradorAleatorio gerador;
+    semearGerador(&gerador, semente, (uint64_t)regra);
+    mapa->regra = regra;
+    mapa->fronteiras = criarFronteirasEmGrade(mapa->arena, tamanho, &colunas);
+    int ok = (mapa->fronteiras != NULL && pedidos != NULL && resultados != NULL);
+    for (int i = 0; ok && i < tamanho; i++) {
+        mapa->dono[i] = (CorId)(proximoAleatorio(&gerador) % 4);
+        mapa->tropas[i] = 1 + (int)(proximoAleatorio(&gerador) % 12);
+    }
+    for (int i = 0; ok && i < quantidade; i++) {
+        const GrafoFronteiras* grafo = mapa->fronteiras;
+        int a = (int)sortearLimitado(&gerador, (uint32_t)tamanho);
+        int vizinhos = grafo->inicio[a + 1] - grafo->inicio[a];
+        pedidos[i].atacante = a;
+        pedidos[i].defensor = grafo->vizinhos[grafo->inicio[a] + (int)sortearLimitado(&gerador, (uint32_t)vizinhos)];
+    }
+    ok = ok && inicializarAgregados(mapa) && inicializarRegioes(mapa) && inicializarAlterados(mapa) &&
+         resolverLoteParalelo(mapa, pedidos, quantidade, resultados, &gerador, num_threads) >= 0;
+
+    if (ok) {
+        uint64_t h = 14695981039346656037ull;
+        h = espalharBytes(h, mapa->dono, (size_t)tamanho * sizeof(CorId));
+        h = espalharBytes(h, mapa->tropas, (size_t)tamanho * sizeof(int));
+        h = espalharBytes(h, resultados, (size_t)quantidade * sizeof(ResultadoBatalha));
+        *espalhamento = espalharBytes(h, &gerador, sizeof(gerador));
+    }
+    free(pedidos);
+    free(resultados);
+    liberarMemoria(mapa);
+    destruirArena(&sessao);
+    return ok;
+}
+
+/**
+ * @brief Confere que resolverLoteParalelo() dá o mesmo mapa e os mesmos resultados
+ *        com 1, 2, 3, 4 e 8 threads, em todas as regras.
+ * @note Usada por Benchmark --verificar; as threads são criadas mesmo com menos
+ *       núcleos, então a repartição dos níveis é exercitada em qualquer máquina.
+ * @return 1 se tudo confere, 0 caso contrário (com mensagem em stderr).
+ */
+int conferirLoteParalelo(int tamanho, uint64_t semente) {
+    static const int threads[] = { 1, 2, 3, 4, 8 };
+    const int num_casos = (int)(sizeof(threads) / sizeof(threads[0]));
+
+    for (int r = 0; r < TOTAL_REGRAS_BATALHA; r++) {
+        uint64_t esperado = 0;
+        for (int t = 0; t < num_casos; t++) {
+            uint64_t obtido;
+            if (!espalharLoteDeConferencia(tamanho, (RegraBatalha)r, threads[t], semente, &obtido)) {
+                fprintf(stderr, "ERRO: Falha ao alocar memoria para conferir o lote paralelo.\n");
+                return 0;
+            }
+            if (t == 0) {
+                esperado = obtido;
+            } else if (obtido != esperado) {
+                fprintf(stderr, "ERRO: resolverLoteParalelo com %d threads diverge de 1 thread na regra %s.\n",
+                        threads[t], regras_batalha[r]->nome);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Resolve uma rodada de batalha e atualiza os territórios, sem imprimir nada.
+ * @note A rodada é sorteada pelo núcleo da regra do mapa (regras_batalha).
+ * @param resultado Destino dos dados sorteados e das perdas da rodada.
+ */
+void resolverBatalha(Mapa* mapa, int atacante, int defensor, ResultadoBatalha* resultado,
+                     GeradorAleatorio* gerador) {
+    MEDIR_ESCOPO(FASE_BATALHA);
+    regras_batalha[mapa->regra]->sortear(mapa->tropas[atacante], mapa->tropas[defensor], resultado, gerador);
+
+    CONTAR(CONTADOR_BATALHAS, 1);
+    CONTAR(CONTADOR_CONQUISTAS, resultado->conquista);
+    aplicarBatalha(mapa, atacante, defensor, resultado);
+    if (mapa->diario != NULL) {
+        registrarBatalha(mapa, atacante, defensor, resultado, gerador->posicao);
+    }
+}
+
+/**
+ * @brief Ataque relâmpago: repete o ataque até conquistar ou o atacante ficar com 1 tropa.
+ * @note O cerco é resolvido de uma vez pelo núcleo sitiar<Regra>() da regra do mapa,
+ *       que só devolve os totais (na regra duelo, sem rolar cada rodada).
+ *       Com diário ativo, o cerco é resolvido rodada a rodada por resolverBatalha(),
+ *       para que cada evento continue registrado e reproduzível.
+ *       O chamador valida o ataque (validarAtaque()) antes.
+ */
+void resolverBlitz(Mapa* mapa, int atacante, int defensor, ResultadoBlitz* resultado, GeradorAleatorio* gerador) {
+    memset(resultado, 0, sizeof(*resultado));
+
+    if (mapa->diario != NULL) {
+        ResultadoBatalha rodada = { 0 };
+        while (mapa->tropas[atacante] > 1 && !rodada.conquista) {
+            resolverBatalha(mapa, atacante, defensor, &rodada, gerador);
+            resultado->rodadas++;
+            resultado->vitorias += (rodada.perdas_atacante == 0);
+            resultado->perdas_atacante += rodada.perdas_atacante;
+            resultado->perdas_defensor += rodada.perdas_defensor;
+        }
+        resultado->conquista = rodada.conquista;
+        return;
+    }
+
+    MEDIR_ESCOPO(FASE_BATALHA);
+    regras_batalha[mapa->regra]->sitiar(mapa->tropas[atacante], mapa->tropas[defensor], resultado, gerador);
+
+    CONTAR(CONTADOR_BATALHAS, resultado->rodadas);
+    CONTAR(CONTADOR_CONQUISTAS, resultado->conquista);
+    definirTropas(mapa, atacante, mapa->tropas[atacante] - resultado->perdas_atacante);
+    if (resultado->conquista) {
+        // Mesma troca de dono de aplicarBatalha(): uma tropa do atacante ocupa o território
+        definirTropas(mapa, defensor, 0);
+        transferirTerritorio(mapa, defensor, mapa->dono[atacante]);
+        definirTropas(mapa, atacante, mapa->tropas[atacante] - 1);
+        definirTropas(mapa, defensor, 1);
+    } else {
+        definirTropas(mapa, defensor, mapa->tropas[defensor] - resultado->perdas_defensor);
+    }
+}
+
+/**
+ * @brief Confere um pedido de ataque contra o estado atual do mapa.
+ * @note Mesmo território, índice fora do mapa, atacante com menos de 2 tropas,
+ *       mesmo exército ou territórios sem fronteira tornam o pedido inválido.
+ */
+static int pedidoValido(const Mapa* mapa, const PedidoAtaque* pedido) {
+    int a = pedido->atacante, d = pedido->defensor;
+    return a >= 0 && a < mapa->tamanho && d >= 0 && d < mapa->tamanho && a != d && mapa->tropas[a] > 1 &&
+           mapa->dono[a] != mapa->dono[d] && saoVizinhos(mapa, a, d);
+}
+
+/**
+ * @brief Resolve uma sequência de ataques de uma só vez, sem E/S.
+ * @note Pedidos inválidos no momento da resolução (mesmo território, índice fora
+ *       do mapa, atacante com menos de 2 tropas, mesmo exército ou territórios sem
+ *       fronteira) não alteram o
+ *       mapa e recebem dado_ataque == 0 no resultado.
+ * @param resultados Vetor de saída com 'quantidade' posições, fornecido pelo chamador.
+ * @return O número de pedidos efetivamente resolvidos.
+ */
+int resolverBatalhasEmLote(Mapa* mapa, const PedidoAtaque* pedidos, int quantidade,
+                           ResultadoBatalha* resultados, GeradorAleatorio* gerador) {
+    int resolvidos = 0;
+
+    for (int i = 0; i < quantidade; i++) {
+        if (!pedidoValido(mapa, &pedidos[i])) {
+            memset(&resultados[i], 0, sizeof(ResultadoBatalha));
+            continue;
+        }
+
+        resolverBatalha(mapa, pedidos[i].atacante, pedidos[i].defensor, &resultados[i], gerador);
+        resolvidos++;
+    }
+    return resolvidos;
+}
+
+/**
+ * @brief Lote de ataques em resolução paralela (ver resolverLoteParalelo()).
+ * @note 'ordem' lista os pedidos por nível de conflito e, dentro do nível, por índice.
+ */
+typedef struct {
+    Mapa* mapa;
+    const PedidoAtaque* pedidos;
+    ResultadoBatalha* resultados;
+    const int* ordem;
+    const int* inicio_nivel;   // num_niveis + 1 entradas
+    int num_niveis;
+    int num_threads;
+    uint64_t semente;
+    pthread_mutex_t largada;   // Segura as threads até a barreira existir
+    pthread_barrier_t barreira;
+} LoteParalelo;
+
+typedef struct {
+    LoteParalelo* lote;
+    int indice;
+    pthread_t thread;
+} TrabalhadorLote;
+
+/**
+ * @brief resolverNivelDoLote() das regras de vários dados: os dados de até
+ *        RODADAS_POR_LOTE_DADOS pedidos vão para planos e são ordenados e
+ *        comparados de uma vez por compararDadosEmLote().
+ * @note Cada pedido rola os seus dados no seu fluxo e na ordem de sortearRodada(),
+ *       então o resultado é o mesmo da resolução rodada a rodada.
+ */
+static void resolverNivelEmPlanos(LoteParalelo* lote, int nivel, int indice, const RegraBatalhaInfo* regra) {
+    unsigned char planos[6][RODADAS_POR_LOTE_DADOS];
+    unsigned char perdas_a[RODADAS_POR_LOTE_DADOS], perdas_d[RODADAS_POR_LOTE_DADOS];
+    unsigned char* const ataque[3] = { planos[0], planos[1], planos[2] };
+    unsigned char* const defesa[3] = { planos[3], planos[4], planos[5] };
+    int juntados[RODADAS_POR_LOTE_DADOS];
+    const Mapa* mapa = lote->mapa;
+    int k = lote->inicio_nivel[nivel] + indice;
+    int fim = lote->inicio_nivel[nivel + 1];
+
+    while (k < fim) {
+        int n = 0;
+        for (; k < fim && n < RODADAS_POR_LOTE_DADOS; k += lote->num_threads) {
+            int i = lote->ordem[k];
+            const PedidoAtaque* pedido = &lote->pedidos[i];
+            if (!pedidoValido(mapa, pedido)) {
+                memset(&lote->resultados[i], 0, sizeof(ResultadoBatalha));
+                continue;
+            }
+            GeradorAleatorio gerador;
+            int num_ataque, num_defesa;
+            semearGerador(&gerador, lote->semente, (uint64_t)i + 1);
+            contarDadosDaRodada(regra, mapa->tropas[pedido->atacante], mapa->tropas[pedido->defensor], &num_ataque,
+                                &num_defesa);
+            for (int j = 0; j < 3; j++) ataque[j][n] = (j < num_ataque) ? (unsigned char)rolarDado(&gerador) : 0;
+            for (int j = 0; j < 3; j++) defesa[j][n] = (j < num_defesa) ? (unsigned char)rolarDado(&gerador) : 0;
+            juntados[n++] = i;
+        }
+
+        compararDadosEmLote(ataque, defesa, regra->empate_atacante, n, perdas_a, perdas_d);
+        for (int r = 0; r < n; r++) {
+            ResultadoBatalha* resultado = &lote->resultados[juntados[r]];
+            int tropas_defensor = mapa->tropas[lote->pedidos[juntados[r]].defensor];
+            resultado->dado_ataque = ataque[0][r];
+            resultado->dado_defesa = defesa[0][r];
+            resultado->perdas_atacante = perdas_a[r];
+            resultado->perdas_defensor = perdas_d[r];
+            resultado->conquista = (perdas_d[r] > 0 && tropas_defensor - perdas_d[r] <= 0);
+        }
+    }
+}
+
+/**
+ * @brief Resolve (sem aplicar) os pedidos do nível que cabem a esta thread, só lendo o mapa.
+ * @note O pedido i sempre usa o fluxo i + 1 da semente do lote, qualquer que seja a thread.
+ */
+static void resolverNivelDoLote(LoteParalelo* lote, int nivel, int indice) {
+    const RegraBatalhaInfo* regra = regras_batalha[lote->mapa->regra];
+    if (!regra->perde_metade) {
+        resolverNivelEmPlanos(lote, nivel, indice, regra);
+        return;
+    }
+    FuncaoRodadaBatalha sortear = regra->sortear;
+    for (int k = lote->inicio_nivel[nivel] + indice; k < lote->inicio_nivel[nivel + 1]; k += lote->num_threads) {
+        int i = lote->ordem[k];
+        const PedidoAtaque* pedido = &lote->pedidos[i];
+        if (!pedidoValido(lote->mapa, pedido)) {
+            memset(&lote->resultados[i], 0, sizeof(ResultadoBatalha));
+            continue;
+        }
+        GeradorAleatorio gerador;
+        semearGerador(&gerador, lote->semente, (uint64_t)i + 1);
+        sortear(lote->mapa->tropas[pedido->atacante], lote->mapa->tropas[pedido->defensor], &lote->resultados[i],
+                &gerador);
+    }
+}
+
+static void* executarTrabalhadorLote(void* argumento) {
+    TrabalhadorLote* trabalhador = (TrabalhadorLote*)argumento;
+    LoteParalelo* lote = trabalhador->lote;
+    pthread_mutex_lock(&lote->largada);
+    pthread_mutex_unlock(&lote->largada);
+    for (int nivel = 0; lote->num_threads > 1 && nivel < lote->num_niveis; nivel++) {
+        pthread_barrier_wait(&lote->barreira); // A thread principal aplicou o nível anterior
+        resolverNivelDoLote(lote, nivel, trabalhador->indice);
+        pthread_barrier_wait(&lote->barreira);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Calcula o nível de conflito de cada pedido: um a mais que o do último pedido
+ *        anterior que tocou o seu atacante ou o seu defensor.
+ * @note Tabela hash só com os territórios do lote, para não varrer o mapa inteiro.
+ * @return O número de níveis, ou -1 se faltou memória.
+ */
+static int calcularNiveisDoLote(const PedidoAtaque* pedidos, int quantidade, int* nivel) {
+    size_t capacidade = 16;
+    while (capacidade < 4 * (size_t)quantidade) capacidade *= 2;
+    int* chaves = (int*)malloc(capacidade * sizeof(int));
+    int* niveis = (int*)malloc(capacidade * sizeof(int));
+    if (chaves == NULL || niveis == NULL) {
+        free(chaves);
+        free(niveis);
+        return -1;
+    }
+    memset(chaves, 0xff, capacidade * sizeof(int)); // -1: posição livre
+
+    int num_niveis = 0;
+    for (int i = 0; i < quantidade; i++) {
+        int territorios[2] = { pedidos[i].atacante, pedidos[i].defensor };
+        size_t posicoes[2];
+        int n = 0;
+        for (int j = 0; j < 2; j++) {
+            if (territorios[j] < 0) continue; // Pedido inválido: não conflita com ninguém
+            size_t p = ((uint32_t)territorios[j] * 2654435761u) & (capacidade - 1);
+            while (chaves[p] != -1 && chaves[p] != territorios[j]) p = (p + 1) & (capacidade - 1);
+            if (chaves[p] == -1) {
+                chaves[p] = territorios[j];
+                niveis[p] = -1;
+            }
+            if (niveis[p] + 1 > n) n = niveis[p] + 1;
+            posicoes[j] = p;
+        }
+        nivel[i] = n;
+        for (int j = 0; j < 2; j++) {
+            if (territorios[j] >= 0) niveis[posicoes[j]] = n;
+        }
+        if (n + 1 > num_niveis) num_niveis = n + 1;
+    }
+    free(chaves);
+    free(niveis);
+    return num_niveis;
+}
+
+/**
+ * @brief Resolve um lote de ataques simultâneos em paralelo, com resultado idêntico ao serial.
+ * @note Os pedidos são agrupados em níveis de conflito: pedidos de um mesmo nível tocam
+ *       territórios disjuntos e são sorteados em paralelo; pedidos que dividem um
+ *       território ficam em níveis sucessivos, na ordem do lote. Cada nível é aplicado
+ *       pela thread chamadora (agregados, regiões e diário não são compartilhados entre
+ *       threads). O pedido i usa o fluxo i + 1 de uma semente tirada de 'gerador', então
+ *       mapa e resultados são os mesmos para qualquer número de threads, inclusive 1.
+ *       Pedidos inválidos no momento da resolução recebem dado_ataque == 0.
+ * @param num_threads 0 usa todos os núcleos.
+ * @return O número de pedidos efetivamente resolvidos, ou -1 se faltou memória.
+ */
+int resolverLoteParalelo(Mapa* mapa, const PedidoAtaque* pedidos, int quantidade, ResultadoBatalha* resultados,
+                         GeradorAleatorio* gerador, int num_threads) {
+    if (quantidade <= 0) return 0;
+    int* nivel = (int*)malloc((size_t)quantidade * sizeof(int));
+    int* ordem = (int*)malloc((size_t)quantidade * sizeof(int));
+    int num_niveis = (nivel != NULL && ordem != NULL) ? calcularNiveisDoLote(pedidos, quantidade, nivel) : -1;
+    int* inicio_nivel = (num_niveis > 0) ? (int*)calloc((size_t)num_niveis + 1, sizeof(int)) : NULL;
+    if (inicio_nivel == NULL) {
+        free(nivel);
+        free(ordem);
+        return -1;
+    }
+
+    // Ordenação por contagem: estável, então cada nível fica em ordem de índice
+    for (int i = 0; i < quantidade; i++) inicio_nivel[nivel[i] + 1]++;
+    for (int n = 0; n < num_niveis; n++) inicio_nivel[n + 1] += inicio_nivel[n];
+    for (int i = 0; i < quantidade; i++) ordem[inicio_nivel[nivel[i]]++] = i;
+    for (int n = num_niveis; n > 0; n--) inicio_nivel[n] = inicio_nivel[n - 1];
+    inicio_nivel[0] = 0;
+
+    LoteParalelo lote = {
+        .mapa = mapa, .pedidos = pedidos, .resultados = resultados, .ordem = ordem,
+        .inicio_nivel = inicio_nivel, .num_niveis = num_niveis, .semente = proximoAleatorio(gerador)
+    };
+    if (num_threads <= 0) num_threads = numeroDeThreads();
+    if (num_threads > MAX_THREADS) num_threads = MAX_THREADS;
+    if (num_threads > quantidade / PEDIDOS_MINIMOS_POR_THREAD) num_threads = quantidade / PEDIDOS_MINIMOS_POR_THREAD;
+
+    // A barreira só é criada depois das threads, com o número das que de fato subiram
+    TrabalhadorLote trabalhadores[MAX_THREADS];
+    int criadas = 0;
+    pthread_mutex_init(&lote.largada, NULL);
+    pthread_mutex_lock(&lote.largada);
+    for (int t = 1; t < num_threads; t++) {
+        trabalhadores[t].lote = &lote;
+        trabalhadores[t].indice = t;
+        if (pthread_create(&trabalhadores[t].thread, NULL, executarTrabalhadorLote, &trabalhadores[t]) != 0) break;
+        criadas = t;
+    }
+    lote.num_threads = criadas + 1;
+    if (criadas > 0 && pthread_barrier_init(&lote.barreira, NULL, (unsigned)lote.num_threads) != 0) {
+        lote.num_threads = 1; // As threads criadas saem sem trabalho
+    }
+    pthread_mutex_unlock(&lote.largada);
+
+    int resolvidos = 0;
+    for (int n = 0; n < num_niveis; n++) {
+        if (lote.num_threads > 1) pthread_barrier_wait(&lote.barreira);
+        resolverNivelDoLote(&lote, n, 0);
+        if (lote.num_threads > 1) pthread_barrier_wait(&lote.barreira);
+
+        for (int k = inicio_nivel[n]; k < inicio_nivel[n + 1]; k++) {
+            int i = ordem[k];
+            if (resultados[i].dado_ataque == 0) continue;
+            CONTAR(CONTADOR_BATALHAS, 1);
+            CONTAR(CONTADOR_CONQUISTAS, resultados[i].conquista);
+            aplicarBatalha(mapa, pedidos[i].atacante, pedidos[i].defensor, &resultados[i]);
+            if (mapa->diario != NULL) {
+                registrarBatalha(mapa, pedidos[i].atacante, pedidos[i].defensor, &resultados[i], gerador->posicao);
+            }
+            resolvidos++;
+        }
+    }
+
+    for (int t = 1; t <= criadas; t++) pthread_join(trabalhadores[t].thread, NULL);
+    if (lote.num_threads > 1) pthread_barrier_destroy(&lote.barreira);
+    pthread_mutex_destroy(&lote.largada);
+    free(nivel);
+    free(ordem);
+    free(inicio_nivel);
+    return resolvidos;
+}
+
+// ============================================================================
+// --- Implementação da Tabela Exata de Probabilidades ---
+// ============================================================================
+
+/**
+ * @brief Garante que a coluna 'defensor' esteja calculada até 'atacante' tropas.
+ * @note Uma vitória do atacante leva o defensor de d para d - (d + 1) / 2, então a
+ *       coluna d depende apenas da coluna seguinte nessa cadeia (no máximo log2(d)
+ *       colunas) e da própria linha anterior. Nada é recalculado duas vezes.
+ * @return 1 em caso de sucesso, 0 se faltou memória.
+ */
+static int garantirColuna(TabelaProbabilidades* tabela, int atacante, int defensor) {
+    if (defensor >= tabela->num_colunas) {
+        int nova_quantidade = tabela->num_colunas ? tabela->num_colunas : 16;
+        while (nova_quantidade <= defensor) nova_quantidade *= 2;
+
+        ColunaProbabilidade* colunas = (ColunaProbabilidade*)realloc(
+            tabela->colunas, (size_t)nova_quantidade * sizeof(ColunaProbabilidade));
+        if (colunas == NULL) return 0;
+        memset(colunas + tabela->num_colunas, 0,
+               (size_t)(nova_quantidade - tabela->num_colunas) * sizeof(ColunaProbabilidade));
+        tabela->colunas = colunas;
+        tabela->num_colunas = nova_quantidade;
+    }
+
+    ColunaProbabilidade* coluna = &tabela->colunas[defensor];
+    if (atacante < coluna->preenchidas) return 1;
+
+    int perdas = (defensor > 0) ? (defensor + 1) / 2 : 0;
+    int restante = defensor - perdas;
+    if (restante > 0 && !garantirColuna(tabela, atacante, restante)) return 0;
+
+    if (atacante >= coluna->capacidade) {
+        int nova_capacidade = coluna->capacidade ? coluna->capacidade : 16;
+        while (nova_capacidade <= atacante) nova_capacidade *= 2;
+
+        CelulaProbabilidade* celulas = (CelulaProbabilidade*)realloc(
+            coluna->celulas, (size_t)nova_capacidade * sizeof(CelulaProbabilidade));
+        if (celulas == NULL) return 0;
+        coluna->celulas = celulas;
+        coluna->capacidade = nova_capacidade;
+    }
+
+    // Lido só depois da chamada recursiva, que pode ter realocado a coluna seguinte
+    const CelulaProbabilidade* proxima = (restante > 0) ? tabela->colunas[restante].celulas : NULL;
+    const double p = PROB_VITORIA_ATAQUE;
+    const double q = 1.0 - PROB_VITORIA_ATAQUE;
+
+    for (int a = coluna->preenchidas; a <= atacante; a++) {
+        CelulaProbabilidade* c = &coluna->celulas[a];
+
+        if (a <= 1) {
+            // Com 1 tropa (ou menos) o atacante não pode mais atacar
+            c->prob_conquista = 0.0;
+            c->perdas_atacante = 0.0;
+            c->perdas_defensor = 0.0;
+            continue;
+        }
+
+        const CelulaProbabilidade* derrota = &coluna->celulas[a - 1];
+        if (proxima == NULL) {
+            c->prob_conquista = p + q * derrota->prob_conquista;
+            c->perdas_atacante = q * (1.0 + derrota->perdas_atacante);
+            c->perdas_defensor = p * perdas + q * derrota->perdas_defensor;
+        } else {
+            const CelulaProbabilidade* vitoria = &proxima[a];
+            c->prob_conquista = p * vitoria->prob_conquista + q * derrota->prob_conquista;
+            c->perdas_atacante = p * vitoria->perdas_atacante + q * (1.0 + derrota->perdas_atacante);
+            c->perdas_defensor = p * (perdas + vitoria->perdas_defensor) + q * derrota->perdas_defensor;
+        }
+    }
+    coluna->preenchidas = atacante + 1;
+    return 1;
+}
+
+/**
+ * @brief Consulta a célula (atacante, defensor), estendendo a tabela se necessário.
+ * @return Ponteiro para a célula, ou NULL se faltou memória.
+ */
+const CelulaProbabilidade* consultarTabela(TabelaProbabilidades* tabela, int tropas_atacante,
+                                           int tropas_defensor) {
+    if (tropas_atacante < 0) tropas_atacante = 0;
+    if (tropas_defensor < 0) tropas_defensor = 0;
+
+    if (tropas_defensor < tabela->num_colunas &&
+        tropas_atacante < tabela->colunas[tropas_defensor].preenchidas) {
+        return &tabela->colunas[tropas_defensor].celulas[tropas_atacante];
+    }
+    if (!garantirColuna(tabela, tropas_atacante, tropas_defensor)) return NULL;
+    return &tabela->colunas[tropas_defensor].celulas[tropas_atacante];
+}
+
+/**
+ * @brief Probabilidade exata de um cerco completo conquistar o defensor.
+ * @return A probabilidade em [0, 1], ou -1.0 se faltou memória.
+ */
+double consultarProbabilidadeConquista(TabelaProbabilidades* tabela, int tropas_atacante,
+                                       int tropas_defensor) {
+    const CelulaProbabilidade* c = consultarTabela(tabela, tropas_atacante, tropas_defensor);
+    return c ? c->prob_conquista : -1.0;
+}
+
+/**
+ * @brief Perdas esperadas de cada lado em um cerco completo.
+ * @return 1 em caso de sucesso, 0 se faltou memória.
+ */
+int consultarPerdasEsperadas(TabelaProbabilidades* tabela, int tropas_atacante, int tropas_defensor,
+                             double* perdas_atacante, double* perdas_defensor) {
+    const CelulaProbabilidade* c = consultarTabela(tabela, tropas_atacante, tropas_defensor);
+    if (c == NULL) return 0;
+    *perdas_atacante = c->perdas_atacante;
+    *perdas_defensor = c->perdas_defensor;
+    return 1;
+}
+
+/**
+ * @brief Libera todas as colunas calculadas da tabela.
+ */
+void liberarTabelaProbabilidades(TabelaProbabilidades* tabela) {
+    for (int d = 0; d < tabela->num_colunas; d++) {
+        free(tabela->colunas[d].celulas);
+    }
+    free(tabela->colunas);
+    tabela->colunas = NULL;
+    tabela->num_colunas = 0;
+}
+
+// ============================================================================
+// --- Implementação da Estimativa de Monte Carlo ---
+// ============================================================================
+
+/**
+ * @brief Estado compartilhado entre as threads de uma estimativa.
+ * @note As threads retiram blocos de ensaios de um contador atômico: quem termina
+ *       antes simplesmente pega o próximo bloco, sem fila fixa por thread.
+ */
+typedef struct {
+    int tropas_atacante;
+    int tropas_defensor;
+    const RegraBatalhaInfo* regra; // Escolhida uma vez para todos os ensaios
+    long long ensaios;
+    long long total_blocos;
+    uint64_t semente;
+    atomic_llong proximo_bloco;
+} TarefaEstimativa;
+
+/**
+ * @brief Acumuladores locais de uma thread, somados apenas ao final.
+ */
+typedef struct {
+    TarefaEstimativa* tarefa;
+    long long conquistas;
+    double soma_tropas;
+    double soma_quadrados;
+} ParcialEstimativa;
+
+/**
+ * @brief Simula 'ensaios' cercos das regras de vários dados em paralelo de dados:
+ *        a cada passo, todos os cercos ainda em curso rolam uma rodada, e as
+ *        rodadas são ordenadas e comparadas juntas por compararDadosEmLote().
+ * @note Os dados vêm de rolarVariosDados() (dois por valor do gerador); os que a
+ *       rodada não usa são zerados, o que vale como dado ausente.
+ */
+static void sitiarEmPlanos(const TarefaEstimativa* tarefa, int ensaios, GeradorAleatorio* gerador,
+                           ParcialEstimativa* parcial) {
+    const RegraBatalhaInfo* regra = tarefa->regra;
+    unsigned char planos[6][RODADAS_POR_LOTE_DADOS];
+    unsigned char sorteados[6 * RODADAS_POR_LOTE_DADOS];
+    unsigned char perdas_a[RODADAS_POR_LOTE_DADOS], perdas_d[RODADAS_POR_LOTE_DADOS];
+    unsigned char* const ataque[3] = { planos[0], planos[1], planos[2] };
+    unsigned char* const defesa[3] = { planos[3], planos[4], planos[5] };
+    int tropas_a[RODADAS_POR_LOTE_DADOS], tropas_d[RODADAS_POR_LOTE_DADOS];
+    int em_curso = 0;
+
+    for (int e = 0; e < ensaios; e++) {
+        if (tarefa->tropas_atacante > 1) {
+            tropas_a[em_curso] = tarefa->tropas_atacante;
+            tropas_d[em_curso] = tarefa->tropas_defensor;
+            em_curso++;
+        } else {
+            // Sem tropas para atacar: o cerco termina antes da primeira rodada
+            parcial->soma_tropas += tarefa->tropas_atacante;
+            parcial->soma_quadrados += (double)tarefa->tropas_atacante * tarefa->tropas_atacante;
+        }
+    }
+
+    while (em_curso > 0) {
+        rolarVariosDados(gerador, sorteados, (size_t)em_curso * 6);
+        for (int c = 0; c < em_curso; c++) {
+            int num_ataque, num_defesa;
+            contarDadosDaRodada(regra, tropas_a[c], tropas_d[c], &num_ataque, &num_defesa);
+            for (int j = 0; j < 3; j++) {
+                ataque[j][c] = (j < num_ataque) ? sorteados[6 * c + j] : 0;
+                defesa[j][c] = (j < num_defesa) ? sorteados[6 * c + 3 + j] : 0;
+            }
+        }
+        compararDadosEmLote(ataque, defesa, regra->empate_atacante, em_curso, perdas_a, perdas_d);
+
+        // Os cercos encerrados saem da lista; os demais são compactados no início
+        int restantes = 0;
+        for (int c = 0; c < em_curso; c++) {
+            int conquista = (perdas_d[c] > 0 && tropas_d[c] - perdas_d[c] <= 0);
+            int a = tropas_a[c] - perdas_a[c];
+            if (conquista || a <= 1) {
+                int finais = a - conquista; // Na conquista, uma tropa ocupa o território
+                parcial->conquistas += conquista;
+                parcial->soma_tropas += finais;
+                parcial->soma_quadrados += (double)finais * finais;
+            } else {
+                tropas_a[restantes] = a;
+                tropas_d[restantes] = tropas_d[c] - perdas_d[c];
+                restantes++;
+            }
+        }
+        em_curso = restantes;
+    }
+}
+
+static void* executarEstimativa(void* argumento) {
+    ParcialEstimativa* parcial = (ParcialEstimativa*)argumento;
+    TarefaEstimativa* tarefa = parcial->tarefa;
+    GeradorAleatorio gerador;
+
+    for (;;) {
+        long long bloco = atomic_fetch_add(&tarefa->proximo_bloco, 1);
+        if (bloco >= tarefa->total_blocos) break;
+
+        // Cada bloco tem o seu fluxo: o resultado não depende de qual thread o executou
+        semearGerador(&gerador, tarefa->semente, (uint64_t)bloco + 1);
+
+        long long inicio = bloco * ENSAIOS_POR_BLOCO;
+        long long fim = inicio + ENSAIOS_POR_BLOCO;
+        if (fim > tarefa->ensaios) fim = tarefa->ensaios;
+
+        if (!tarefa->regra->perde_metade) {
+            for (long long i = inicio; i < fim; i += RODADAS_POR_LOTE_DADOS) {
+                int n = (fim - i < RODADAS_POR_LOTE_DADOS) ? (int)(fim - i) : RODADAS_POR_LOTE_DADOS;
+                sitiarEmPlanos(tarefa, n, &gerador, parcial);
+            }
+            continue;
+        }
+        for (long long i = inicio; i < fim; i++) {
+            // Cerco completo: ataca até conquistar ou o atacante ficar com 1 tropa
+            ResultadoBlitz cerco;
+            tarefa->regra->sitiar(tarefa->tropas_atacante, tarefa->tropas_defensor, &cerco, &gerador);
+            int tropas_finais = tarefa->tropas_atacante - cerco.perdas_atacante - cerco.conquista;
+            parcial->conquistas += cerco.conquista;
+            parcial->soma_tropas += tropas_finais;
+            parcial->soma_quadrados += (double)tropas_finais * tropas_finais;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Retorna o número de núcleos disponíveis, limitado a MAX_THREADS.
+ */
+int numeroDeThreads(void) {
+    long nucleos = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nucleos < 1) nucleos = 1;
+    if (nucleos > MAX_THREADS) nucleos = MAX_THREADS;
+    return (int)nucleos;
+}
+
+/**
+ * @brief Estima por Monte Carlo a chance de um cerco completo conquistar o defensor.
+ * @note Os ensaios são divididos em blocos distribuídos entre as threads; cada bloco
+ *       usa um fluxo próprio do gerador, então a mesma semente dá o mesmo resultado
+ *       com qualquer número de threads.
+ * @param num_threads Número de threads (<= 0 usa todos os núcleos).
+ * @return Probabilidade de conquista, tropas restantes do atacante e IC de 95%.
+ */
+EstimativaConquista estimarConquista(int tropas_atacante, int tropas_defensor, RegraBatalha regra,
+                                     long long ensaios, int num_threads, uint64_t semente) {
+    MEDIR_ESCOPO(FASE_ESTIMATIVA);
+    EstimativaConquista estimativa = { 0 };
+    pthread_t threads[MAX_THREADS];
+    ParcialEstimativa parciais[MAX_THREADS];
+    TarefaEstimativa tarefa = {
+        .tropas_atacante = tropas_atacante,
+        .tropas_defensor = tropas_defensor,
+        .regra = regras_batalha[regra],
+        .ensaios = ensaios,
+        .total_blocos = (ensaios + ENSAIOS_POR_BLOCO - 1) / ENSAIOS_POR_BLOCO,
+        .semente = semente
+    };
+    atomic_init(&tarefa.proximo_bloco, 0);
+
+    if (ensaios <= 0) return estimativa;
+    if (num_threads <= 0) num_threads = numeroDeThreads();
+    if (num_threads > MAX_THREADS) num_threads = MAX_THREADS;
+    if (num_threads > tarefa.total_blocos) num_threads = (int)tarefa.total_blocos;
+
+    memset(parciais, 0, sizeof(parciais));
+    int criadas = 0;
+    parciais[0].tarefa = &tarefa; // A thread 0 é a própria chamadora
+    for (int t = 1; t < num_threads; t++) {
+        parciais[t].tarefa = &tarefa;
+        // Os blocos das threads que não puderam ser criadas ficam com as demais
+        if (pthread_create(&threads[t], NULL, executarEstimativa, &parciais[t]) != 0) break;
+        criadas = t;
+    }
+    executarEstimativa(&parciais[0]);
+    for (int t = 1; t <= criadas; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    long long conquistas = 0;
+    double soma = 0.0, soma_quadrados = 0.0;
+    for (int t = 0; t < num_threads; t++) {
+        conquistas += parciais[t].conquistas;
+        soma += parciais[t].soma_tropas;
+        soma_quadrados += parciais[t].soma_quadrados;
+    }
+
+    double n = (double)ensaios;
+    double p = conquistas / n;
+    double z = 1.96;
+
+    // Intervalo de Wilson para a proporção de conquistas
+    double denominador = 1.0 + z * z / n;
+    double centro = (p + z * z / (2.0 * n)) / denominador;
+    double margem = z * sqrt(p * (1.0 - p) / n + z * z / (4.0 * n * n)) / denominador;
+
+    double media = soma / n;
+    double variancia = (n > 1.0) ? (soma_quadrados - n * media * media) / (n - 1.0) : 0.0;
+    double erro = z * sqrt(variancia > 0.0 ? variancia / n : 0.0);
+
+    estimativa.ensaios = ensaios;
+    estimativa.prob_conquista = p;
+    estimativa.ic_conquista_inf = centro - margem;
+    estimativa.ic_conquista_sup = centro + margem;
+    estimativa.tropas_restantes = media;
+    estimativa.ic_tropas_inf = media - erro;
+    estimativa.ic_tropas_sup = media + erro;
+    return estimativa;
+}
+
+/**
+ * @brief Interface do menu: estima a chance de conquista entre dois territórios do mapa.
+ */
+void faseDeEstimativa(const Mapa* mapa, TabelaProbabilidades* tabela, GeradorAleatorio* gerador) {
+    int id_atacante, id_defensor;
+    int tamanho = mapa->tamanho;
+
+    printf("\n--- ESTIMATIVA DE CONQUISTA ---\n");
+    printf("Digite o ID do Territorio Atacante (1 a %d): ", tamanho);
+    if (!lerInteiroDoTeclado(&id_atacante) || id_atacante < 1 || id_atacante > tamanho) {
+        printf("Erro: ID de atacante invalido.\n");
+        limparBufferEntrada();
+        return;
+    }
+
+    printf("Digite o ID do Territorio Defensor (1 a %d): ", tamanho);
+    if (!lerInteiroDoTeclado(&id_defensor) || id_defensor < 1 || id_defensor > tamanho) {
+        printf("Erro: ID de defensor invalido.\n");
+        limparBufferEntrada();
+        return;
+    }
+    limparBufferEntrada();
+
+    int tropas_atacante = mapa->tropas[id_atacante - 1];
+    int tropas_defensor = mapa->tropas[id_defensor - 1];
+    int threads = numeroDeThreads();
+
+    EstimativaConquista e = estimarConquista(tropas_atacante, tropas_defensor, mapa->regra, ENSAIOS_PADRAO,
+                                             threads, proximoAleatorio(gerador));
+
+    printf("\n%s (%d tropas) atacando %s (%d tropas) ate conquistar ou restar 1 tropa:\n",
+           nomeDoTerritorio(mapa, id_atacante - 1), tropas_atacante,
+           nomeDoTerritorio(mapa, id_defensor - 1), tropas_defensor);
+    printf("Chance de conquista: %.2f%% (IC 95%%: %.2f%% a %.2f%%)\n",
+           100.0 * e.prob_conquista, 100.0 * e.ic_conquista_inf, 100.0 * e.ic_conquista_sup);
+    printf("Tropas restantes no atacante: %.2f (IC 95%%: %.2f a %.2f)\n",
+           e.tropas_restantes, e.ic_tropas_inf, e.ic_tropas_sup);
+    printf("(%lld simulacoes em %d threads)\n", e.ensaios, threads);
+
+    // A tabela exata modela a regra duelo; nas demais, fica só a estimativa
+    const CelulaProbabilidade* exato =
+        (mapa->regra == REGRA_DUELO) ? consultarTabela(tabela, tropas_atacante, tropas_defensor) : NULL;
+    if (exato != NULL) {
+        printf("Valor exato: %.2f%% de conquista; perdas esperadas: atacante %.2f, defensor %.2f\n",
+               100.0 * exato->prob_conquista, exato->perdas_atacante, exato->perdas_defensor);
+    }
+}
+
+// ============================================================================
+// --- Implementação do Adversário MCTS ---
+// ============================================================================
+
+/**
+ * @brief Estado compartilhado de uma busca: posição da raiz, ordem de jogo e prazo.
+ */
+typedef struct {
+    const Mapa* raiz;
+    CorId ordem[MAX_CORES];         // Cores em jogo, a partir da que decide o lance
+    int num_cores;
+    struct timespec prazo;
+    uint64_t semente;
+} BuscaMcts;
+
+/**
+ * @brief Árvore de uma thread (busca paralela pela raiz).
+ */
+typedef struct {
+    const BuscaMcts* busca;
+    Arena* arena;
+    NoMcts* nos;
+    int num_nos;
+    Mapa simulacao;                 // Cópia da raiz, refeita a cada iteração, sem alocação
+    uint64_t fluxo;
+    long long simulacoes;
+    pthread_t thread;
+} ArvoreMcts;
+
+static int prazoEsgotado(const struct timespec* prazo) {
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    return agora.tv_sec > prazo->tv_sec || (agora.tv_sec == prazo->tv_sec && agora.tv_nsec >= prazo->tv_nsec);
+}
+
+/**
+ * @brief Aplica o lance se ele for válido no estado sorteado; senão, é um "passar".
+ * @note A busca é de laço aberto: o mesmo nó pode ser alcançado por estados
+ *       diferentes, então um ataque da árvore pode não valer mais aqui.
+ */
+static void aplicarLanceMcts(Mapa* simulacao, CorId cor, int atacante, int defensor, GeradorAleatorio* gerador) {
+    ResultadoBatalha resultado;
+    if (atacante >= 0 && simulacao->dono[atacante] == cor && simulacao->tropas[atacante] > 1 &&
+        simulacao->dono[defensor] != cor) {
+        resolverBatalha(simulacao, atacante, defensor, &resultado, gerador);
+    }
+}
+
+/**
+ * @brief Política da simulação: sorteia territórios até achar um ataque válido.
+ * @return 1 se atacou, 0 se passou (nenhum ataque achado em poucas tentativas).
+ */
+static int lanceAleatorio(Mapa* simulacao, CorId cor, GeradorAleatorio* gerador) {
+    const GrafoFronteiras* grafo = simulacao->fronteiras;
+    int n = simulacao->tamanho;
+
+    for (int t = 0; t < TENTATIVAS_LANCE_ALEATORIO; t++) {
+        int a = (int)sortearLimitado(gerador, (uint32_t)n);
+        if (simulacao->dono[a] != cor || simulacao->tropas[a] < 2) continue;
+
+        int d;
+        if (grafo != NULL) {
+            int grau = grafo->inicio[a + 1] - grafo->inicio[a];
+            if (grau == 0) continue;
+            d = grafo->vizinhos[grafo->inicio[a] + (int)sortearLimitado(gerador, (uint32_t)grau)];
+        } else {
+            d = (int)sortearLimitado(gerador, (uint32_t)n);
+        }
+        if (simulacao->dono[d] == cor) continue;
+
+        ResultadoBatalha resultado;
+        resolverBatalha(simulacao, a, d, &resultado, gerador);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Cria os filhos de um nó: "passar" e cada ataque válido da cor no estado atual.
+ * @return 1 se o nó foi expandido, 0 se o conjunto de nós está cheio.
+ */
+static int expandirNo(ArvoreMcts* arvore, int indice, CorId cor) {
+    const Mapa* sim = &arvore->simulacao;
+    const GrafoFronteiras* grafo = sim->fronteiras;
+    int primeiro = arvore->num_nos;
+    int n = sim->tamanho;
+
+    if (primeiro >= NOS_MCTS_POR_THREAD) return 0;
+    arvore->nos[arvore->num_nos++] = (NoMcts){ -1, -1, -1, 0, 0, 0.0f };
+
+    for (int a = 0; a < n; a++) {
+        if (sim->dono[a] != cor || sim->tropas[a] < 2) continue;
+        int k_inicio = grafo ? grafo->inicio[a] : 0;
+        int k_fim = grafo ? grafo->inicio[a + 1] : n;
+        for (int k = k_inicio; k < k_fim; k++) {
+            int d = grafo ? grafo->vizinhos[k] : k;
+            if (sim->dono[d] == cor) continue;
+            if (arvore->num_nos >= NOS_MCTS_POR_THREAD) {
+                arvore->num_nos = primeiro; // Sem espaço para todos os filhos: não expande
+                return 0;
+            }
+            arvore->nos[arvore->num_nos++] = (NoMcts){ (int32_t)a, (int32_t)d, -1, 0, 0, 0.0f };
+        }
+    }
+
+    arvore->nos[indice].primeiro_filho = primeiro;
+    arvore->nos[indice].num_filhos = arvore->num_nos - primeiro;
+    return 1;
+}
+
+/**
+ * @brief Escolhe o filho pelo UCB1; filhos nunca visitados têm prioridade.
+ */
+static int selecionarFilho(const ArvoreMcts* arvore, const NoMcts* no) {
+    const NoMcts* filhos = &arvore->nos[no->primeiro_filho];
+    float log_pai = logf((float)no->visitas);
+    float melhor = -1.0f;
+    int escolhido = 0;
+
+    for (int i = 0; i < no->num_filhos; i++) {
+        if (filhos[i].visitas == 0) return no->primeiro_filho + i;
+        float ucb = filhos[i].soma / (float)filhos[i].visitas +
+                    UCT_EXPLORACAO * sqrtf(log_pai / (float)filhos[i].visitas);
+        if (ucb > melhor) {
+            melhor = ucb;
+            escolhido = i;
+        }
+    }
+    return no->primeiro_filho + escolhido;
+}
+
+/**
+ * @brief Recompensa de cada cor em jogo: média entre a fração dos territórios e a das tropas.
+ */
+static void avaliarSimulacao(const Mapa* sim, const BuscaMcts* busca, float* recompensa) {
+    int territorios[MAX_CORES] = { 0 };
+    long long tropas[MAX_CORES] = { 0 };
+    long long total_tropas = 0;
+
+    for (int i = 0; i < sim->tamanho; i++) {
+        territorios[sim->dono[i]]++;
+        tropas[sim->dono[i]] += sim->tropas[i];
+        total_tropas += sim->tropas[i];
+    }
+    for (int j = 0; j < busca->num_cores; j++) {
+        CorId c = busca->ordem[j];
+        recompensa[j] = 0.5f * (float)territorios[c] / (float)sim->tamanho +
+                        (total_tropas > 0 ? 0.5f * (float)tropas[c] / (float)total_tropas : 0.0f);
+    }
+}
+
+/**
+ * @brief Laço da busca de uma thread: seleção, expansão, simulação e retropropagação.
+ */
+static void* executarMcts(void* argumento) {
+    MEDIR_ESCOPO(FASE_BUSCA_MCTS);
+    ArvoreMcts* arvore = (ArvoreMcts*)argumento;
+    const BuscaMcts* busca = arvore->busca;
+    const Mapa* raiz = busca->raiz;
+    Mapa* sim = &arvore->simulacao;
+    GeradorAleatorio gerador;
+    int caminho[MAX_PROFUNDIDADE_MCTS + 1];
+    float recompensa[MAX_CORES];
+
+    semearGerador(&gerador, busca->semente, arvore->fluxo);
+    for (long long iteracao = 0;; iteracao++) {
+        if ((iteracao & 63) == 0 && prazoEsgotado(&busca->prazo)) break;
+
+        memcpy(sim->dono, raiz->dono, (size_t)raiz->tamanho * sizeof(CorId));
+        memcpy(sim->tropas, raiz->tropas, (size_t)raiz->tamanho * sizeof(int));
+
+        // Seleção e expansão: a cor da vez em cada profundidade é ordem[profundidade % num_cores]
+        int no = 0, profundidade = 0;
+        caminho[0] = 0;
+        while (profundidade < MAX_PROFUNDIDADE_MCTS) {
+            CorId cor = busca->ordem[profundidade % busca->num_cores];
+            if (arvore->nos[no].num_filhos == 0) {
+                if (arvore->nos[no].visitas == 0 && no != 0) break; // Folha nova: simula a partir dela
+                if (!expandirNo(arvore, no, cor)) break;
+            }
+            no = selecionarFilho(arvore, &arvore->nos[no]);
+            aplicarLanceMcts(sim, cor, arvore->nos[no].atacante, arvore->nos[no].defensor, &gerador);
+            caminho[++profundidade] = no;
+            if (arvore->nos[no].visitas == 0) break;
+        }
+
+        // Simulação: cada cor faz um lance aleatório, em ordem, até o fim do horizonte
+        for (int j = 0; j < JOGADAS_SIMULACAO; j++) {
+            lanceAleatorio(sim, busca->ordem[(profundidade + j) % busca->num_cores], &gerador);
+        }
+
+        // Retropropagação: cada nó acumula a recompensa da cor que fez o seu lance
+        avaliarSimulacao(sim, busca, recompensa);
+        arvore->nos[0].visitas++;
+        for (int p = 1; p <= profundidade; p++) {
+            NoMcts* atual = &arvore->nos[caminho[p]];
+            atual->visitas++;
+            atual->soma += recompensa[(p - 1) % busca->num_cores];
+        }
+        arvore->simulacoes++;
+    }
+    CONTAR(CONTADOR_SIMULACOES_MCTS, arvore->simulacoes);
+    return NULL;
+}
+
+/**
+ * @brief Reserva uma arena por thread para as árvores de busca e as cópias do mapa.
+ * @param tempo_ms Orçamento de tempo de cada lance.
+ * @return 1 em caso de sucesso, 0 se faltou memória.
+ */
+int criarAdversarioMcts(AdversarioMcts* ia, int tamanho_mapa, int tempo_ms) {
+    size_t capacidade = (size_t)NOS_MCTS_POR_THREAD * sizeof(NoMcts) +
+                        (size_t)tamanho_mapa * (sizeof(CorId) + sizeof(int)) + 4 * ALINHAMENTO_ARENA;
+    ia->num_threads = numeroDeThreads();
+    ia->tempo_ms = tempo_ms > 0 ? tempo_ms : 1;
+    return criarPoolArenas(&ia->arenas, ia->num_threads, capacidade);
+}
+
+void destruirAdversarioMcts(AdversarioMcts* ia) {
+    destruirPoolArenas(&ia->arenas);
+}
+
+/**
+ * @brief Escolhe o lance da cor por MCTS (UCT de laço aberto), paralelo pela raiz.
+ * @note Cada thread constrói a sua árvore a partir da mesma raiz, então os filhos
+ *       da raiz saem na mesma ordem e as visitas podem ser somadas por índice.
+ *       O lance mais visitado vence. Nenhuma alocação ocorre durante a busca.
+ */
+LanceIa escolherLanceMcts(AdversarioMcts* ia, const Mapa* mapa, CorId cor, uint64_t semente) {
+    BuscaMcts busca = { .raiz = mapa, .semente = semente };
+    ArvoreMcts arvores[MAX_THREADS];
+    LanceIa lance = { -1, -1, 0 };
+    int presente[MAX_CORES] = { 0 };
+
+    // Ordem de jogo: a cor que decide e, depois, as demais cores com territórios
+    for (int i = 0; i < mapa->tamanho; i++) presente[mapa->dono[i]] = 1;
+    for (int k = 0; k < MAX_CORES; k++) {
+        CorId c = (CorId)((cor + k) % MAX_CORES);
+        if (k == 0 || presente[c]) {
+            busca.ordem[busca.num_cores++] = c;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &busca.prazo);
+    busca.prazo.tv_sec += ia->tempo_ms / 1000;
+    busca.prazo.tv_nsec += (long)(ia->tempo_ms % 1000) * 1000000L;
+    if (busca.prazo.tv_nsec >= 1000000000L) {
+        busca.prazo.tv_sec++;
+        busca.prazo.tv_nsec -= 1000000000L;
+    }
+
+    int num_arvores = 0;
+    for (int t = 0; t < ia->num_threads; t++) {
+        ArvoreMcts* arvore = &arvores[num_arvores];
+        memset(arvore, 0, sizeof(*arvore));
+        arvore->arena = obterArena(&ia->arenas);
+        if (arvore->arena == NULL) break;
+
+        arvore->busca = &busca;
+        arvore->fluxo = (uint64_t)t + 1;
+        arvore->nos = (NoMcts*)alocarNaArena(arvore->arena, (size_t)NOS_MCTS_POR_THREAD * sizeof(NoMcts));
+        arvore->simulacao.tamanho = mapa->tamanho;
+        arvore->simulacao.regra = mapa->regra;
+        arvore->simulacao.dono = (CorId*)alocarNaArena(arvore->arena, (size_t)mapa->tamanho * sizeof(CorId));
+        arvore->simulacao.tropas = (int*)alocarNaArena(arvore->arena, (size_t)mapa->tamanho * sizeof(int));
+        arvore->simulacao.fronteiras = mapa->fronteiras;
+        if (arvore->nos == NULL || arvore->simulacao.dono == NULL || arvore->simulacao.tropas == NULL) {
+            devolverArena(&ia->arenas, arvore->arena);
+            break;
+        }
+
+        // A raiz já nasce expandida, a partir do estado real
+        memcpy(arvore->simulacao.dono, mapa->dono, (size_t)mapa->tamanho * sizeof(CorId));
+        memcpy(arvore->simulacao.tropas, mapa->tropas, (size_t)mapa->tamanho * sizeof(int));
+        arvore->nos[0] = (NoMcts){ -1, -1, -1, 0, 0, 0.0f };
+        arvore->num_nos = 1;
+        expandirNo(arvore, 0, cor);
+        num_arvores++;
+    }
+    if (num_arvores == 0) return lance;
+
+    // A thread principal também busca, na primeira árvore
+    for (int t = 1; t < num_arvores; t++) {
+        if (pthread_create(&arvores[t].thread, NULL, executarMcts, &arvores[t]) != 0) {
+            arvores[t].simulacoes = -1;
+        }
+    }
+    executarMcts(&arvores[0]);
+    for (int t = 1; t < num_arvores; t++) {
+        if (arvores[t].simulacoes >= 0) pthread_join(arvores[t].thread, NULL);
+    }
+
+    const NoMcts* raiz0 = &arvores[0].nos[0];
+    long long melhor = -1;
+    for (int i = 0; i < raiz0->num_filhos; i++) {
+        long long visitas = 0;
+        for (int t = 0; t < num_arvores; t++) {
+            if (arvores[t].nos[0].num_filhos == raiz0->num_filhos) {
+                visitas += arvores[t].nos[arvores[t].nos[0].primeiro_filho + i].visitas;
+            }
+        }
+        if (visitas > melhor) {
+            const NoMcts* filho = &arvores[0].nos[raiz0->primeiro_filho + i];
+            melhor = visitas;
+            lance.atacante = filho->atacante;
+            lance.defensor = filho->defensor;
+        }
+    }
+    for (int t = 0; t < num_arvores; t++) {
+        if (arvores[t].simulacoes > 0) lance.simulacoes += arvores[t].simulacoes;
+        devolverArena(&ia->arenas, arvores[t].arena);
+    }
+    return lance;
+}
+
+/**
+ * @brief Cada cor adversária com territórios faz um lance escolhido por MCTS.
+ */
+void turnoDosAdversarios(Mapa* mapa, CorId cor_jogador, const TabelaCores* cores, AdversarioMcts* ia,
+                         GeradorAleatorio* gerador) {
+    MEDIR_ESCOPO(FASE_TURNO_IA);
+    printf("\n--- TURNO DOS ADVERSARIOS ---\n");
+    for (int c = 0; c < cores->quantidade; c++) {
+        if ((CorId)c == cor_jogador || mapa->agregados->territorios[c] == 0) continue;
+
+        LanceIa lance = escolherLanceMcts(ia, mapa, (CorId)c, proximoAleatorio(gerador));
+        if (lance.atacante < 0) {
+            printf("[IA] %s passa a vez (%lld simulacoes).\n", nomeDaCor(cores, (CorId)c), lance.simulacoes);
+            continue;
+        }
+
+        ResultadoBatalha resultado;
+        printf("[IA] %s: %s (%d tropas) ataca %s (%s, %d tropas). ", nomeDaCor(cores, (CorId)c),
+               nomeDoTerritorio(mapa, lance.atacante), mapa->tropas[lance.atacante],
+               nomeDoTerritorio(mapa, lance.defensor), nomeDaCor(cores, mapa->dono[lance.defensor]),
+               mapa->tropas[lance.defensor]);
+        resolverBatalha(mapa, lance.atacante, lance.defensor, &resultado, gerador);
+        printf("Dados %d x %d: ", resultado.dado_ataque, resultado.dado_defesa);
+        if (resultado.conquista) {
+            printf("TERRITORIO CONQUISTADO!");
+        } else if (resultado.perdas_defensor > 0) {
+            printf("defensor perde %d tropas.", resultado.perdas_defensor);
+        } else {
+            printf("atacante perde 1 tropa.");
+        }
+        printf(" (%lld simulacoes)\n", lance.simulacoes);
+    }
+}
+
+// ============================================================================
+// --- Implementação do Servidor de Sessões ---
+// ============================================================================
+
+/**
+ * @brief Partida de uma conexão, num clone do mapa modelo em arena própria (clonarMapa()).
+ */
+typedef struct {
+    Arena arena;
+    Mapa* mapa;       // NULL até o primeiro OP_NOVA_SESSAO
+    Missao missao;
+    GeradorAleatorio gerador;
+} SessaoServidor;
+
+/**
+ * @brief Conexão de um cliente; pertence a um único trabalhador, que é o único a tocá-la.
+ */
+typedef struct ConexaoServidor {
+    int fd;
+    SessaoServidor sessao;
+    unsigned char entrada[TAMANHO_ENTRADA_CONEXAO];
+    size_t entrada_usada;
+    unsigned char* saida;   // Respostas ainda não enviadas
+    size_t saida_usada;
+    size_t saida_enviada;
+    size_t saida_capacidade;
+    int esperando_escrita;  // Registrada com EPOLLOUT em vez de EPOLLIN
+    struct ConexaoServidor* anterior;
+    struct ConexaoServidor* proximo;
+} ConexaoServidor;
+
+typedef struct {
+    uint64_t pedidos;
+    uint64_t ataques;
+    uint64_t recusados;
+    uint64_t sessoes_criadas;
+    uint64_t latencia[BALDES_LATENCIA]; // Por lote lido com ataques: do read() ao send() das respostas
+} EstatisticaServidor;
+
+struct ServidorSessoes;
+
+/**
+ * @brief Trabalhador: uma thread com o seu próprio epoll e as suas próprias conexões.
+ * @note As estatísticas são acumuladas sem travas em 'local' e publicadas uma vez
+ *       por segundo, sob a trava do próprio trabalhador.
+ */
+typedef struct {
+    struct ServidorSessoes* servidor;
+    pthread_t thread;
+    int epoll;
+    int canal[2];                   // Pipe pelo qual a thread principal entrega as conexões aceitas
+    ConexaoServidor* conexoes;
+    int num_conexoes;
+    EstatisticaServidor local;
+    EstatisticaServidor publicada;
+    int conexoes_publicadas;
+    pthread_mutex_t trava;
+} TrabalhadorServidor;
+
+typedef struct ServidorSessoes {
+    const Mapa* modelo;
+    const Missao* missoes;
+    int total_missoes;
+    CorId cor_jogador;
+    TrabalhadorServidor trabalhadores[MAX_THREADS];
+    int num_trabalhadores;
+} ServidorSessoes;
+
+static atomic_int servidor_encerrando;
+
+static void sinalEncerrarServidor(int sinal) {
+    (void)sinal;
+    atomic_store(&servidor_encerrando, 1);
+}
+
+static uint64_t relogioNs(void) {
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    return (uint64_t)agora.tv_sec * 1000000000ull + (uint64_t)agora.tv_nsec;
+}
+
+/**
+ * @brief Balde do histograma de latência: exato abaixo de 8 ns, depois 8 sub-baldes por potência de 2.
+ */
+static int baldeLatencia(uint64_t ns) {
+    if (ns < 8) return (int)ns;
+    int expoente = 63 - __builtin_clzll(ns);
+    int balde = (expoente - 2) * 8 + (int)((ns >> (expoente - 3)) & 7);
+    return balde < BALDES_LATENCIA ? balde : BALDES_LATENCIA - 1;
+}
+
+/**
+ * @brief Maior latência (ns) que cai no balde.
+ */
+static uint64_t limiteBaldeLatencia(int balde) {
+    if (balde < 8) return (uint64_t)balde;
+    int expoente = balde / 8 + 2;
+    if (expoente >= 63) return UINT64_MAX;
+    return ((uint64_t)(9 + balde % 8) << (expoente - 3)) - 1;
+}
+
+/**
+ * @brief Percentil q (0..1) do histograma, em microssegundos (limite superior do balde).
+ */
+static double percentilLatencia(const uint64_t* histograma, double q) {
+    uint64_t total = 0;
+    for (int b = 0; b < BALDES_LATENCIA; b++) total += histograma[b];
+    if (total == 0) return 0.0;
+
+    uint64_t alvo = (uint64_t)ceil(q * (double)total);
+    uint64_t acumulado = 0;
+    for (int b = 0; b < BALDES_LATENCIA; b++) {
+        acumulado += histograma[b];
+        if (acumulado >= alvo) return (double)limiteBaldeLatencia(b) / 1000.0;
+    }
+    return (double)limiteBaldeLatencia(BALDES_LATENCIA - 1) / 1000.0;
+}
+
+static void somarEstatisticaServidor(EstatisticaServidor* destino, const EstatisticaServidor* origem) {
+    destino->pedidos += origem->pedidos;
+    destino->ataques += origem->ataques;
+    destino->recusados += origem->recusados;
+    destino->sessoes_criadas += origem->sessoes_criadas;
+    for (int b = 0; b < BALDES_LATENCIA; b++) destino->latencia[b] += origem->latencia[b];
+}
+
+/**
+ * @brief (Re)cria a sessão a partir do mapa modelo, reaproveitando a arena se ela couber.
+ * @return 1 em caso de sucesso, 0 se faltou memória.
+ */
+static int criarSessaoServidor(SessaoServidor* sessao, const ServidorSessoes* servidor, uint64_t semente) {
+    size_t necessario = tamanhoArenaClone(servidor->modelo->tamanho);
+
+    sessao->mapa = NULL;
+    if (sessao->arena.base != NULL && sessao->arena.capacidade >= necessario) {
+        reiniciarArena(&sessao->arena);
+    } else {
+        destruirArena(&sessao->arena);
+        if (!criarArena(&sessao->arena, necessario)) return 0;
+    }
+
+    Mapa* mapa = clonarMapa(&sessao->arena, servidor->modelo);
+    if (mapa == NULL) return 0;
+
+    semearGerador(&sessao->gerador, semente, 0);
+    atribuirMissao(&sessao->missao, servidor->missoes, servidor->total_missoes, &sessao->gerador);
+    prepararMissao(mapa, &sessao->missao);
+    sessao->mapa = mapa;
+    return 1;
+}
+
+/**
+ * @brief Atende um pedido na sessão da conexão. Nada aqui é compartilhado entre threads.
+ */
+static void atenderPedido(TrabalhadorServidor* trabalhador, SessaoServidor* sessao, const PedidoServidor* pedido,
+                          RespostaServidor* resposta) {
+    const ServidorSessoes* servidor = trabalhador->servidor;
+    Mapa* mapa = sessao->mapa;
+
+    memset(resposta, 0, sizeof(*resposta));
+    resposta->operacao = pedido->operacao;
+    trabalhador->local.pedidos++;
+
+    if (pedido->operacao == OP_NOVA_SESSAO) {
+        if (!criarSessaoServidor(sessao, servidor, (uint64_t)pedido->a | ((uint64_t)pedido->b << 32))) {
+            resposta->status = RESPOSTA_SEM_MEMORIA;
+            return;
+        }
+        trabalhador->local.sessoes_criadas++;
+        resposta->valor_a = sessao->mapa->tamanho;
+        return;
+    }
+    if (mapa == NULL) {
+        resposta->status = RESPOSTA_SEM_SESSAO;
+        return;
+    }
+
+    uint32_t tamanho = (uint32_t)mapa->tamanho;
+    switch (pedido->operacao) {
+        case OP_ATACAR: {
+            if (pedido->a >= tamanho || pedido->b >= tamanho) {
+                resposta->status = RESPOSTA_INVALIDO;
+                break;
+            }
+            int a = (int)pedido->a, d = (int)pedido->b;
+            ErroAtaque motivo = validarAtaque(mapa, servidor->cor_jogador, a, d);
+            trabalhador->local.ataques++;
+            if (motivo != ATAQUE_VALIDO) {
+                trabalhador->local.recusados++;
+                resposta->status = RESPOSTA_RECUSADO;
+                resposta->dado_ataque = (uint8_t)motivo;
+                break;
+            }
+            ResultadoBatalha resultado;
+            resolverBatalha(mapa, a, d, &resultado, &sessao->gerador);
+            resposta->dado_ataque = (uint8_t)resultado.dado_ataque;
+            resposta->dado_defesa = (uint8_t)resultado.dado_defesa;
+            resposta->valor_a = mapa->tropas[a];
+            resposta->valor_b = mapa->tropas[d];
+            resposta->conquista = (uint8_t)resultado.conquista;
+            resposta->missao_cumprida = (uint8_t)verificarMissao(&sessao->missao, mapa, servidor->cor_jogador);
+            break;
+        }
+        case OP_VERIFICAR:
+            resposta->missao_cumprida = (uint8_t)verificarMissao(&sessao->missao, mapa, servidor->cor_jogador);
+            break;
+        case OP_CONSULTAR:
+            if (pedido->a >= tamanho) {
+                resposta->status = RESPOSTA_INVALIDO;
+                break;
+            }
+            resposta->valor_a = mapa->tropas[pedido->a];
+            resposta->valor_b = mapa->dono[pedido->a];
+            break;
+        default:
+            resposta->status = RESPOSTA_INVALIDO;
+            break;
+    }
+}
+
+/**
+ * @brief Troca os eventos da conexão no epoll: só escrita enquanto houver respostas pendentes.
+ */
+static int alternarEscrita(TrabalhadorServidor* trabalhador, ConexaoServidor* conexao, int esperar) {
+    if (conexao->esperando_escrita == esperar) return 1;
+
+    struct epoll_event evento = { .events = esperar ? EPOLLOUT : EPOLLIN, .data.ptr = conexao };
+    conexao->esperando_escrita = esperar;
+    return epoll_ctl(trabalhador->epoll, EPOLL_CTL_MOD, conexao->fd, &evento) == 0;
+}
+
+/**
+ * @brief Envia o que couber das respostas pendentes, sem bloquear.
+ * @return 0 se a conexão caiu.
+ */
+static int enviarPendentes(TrabalhadorServidor* trabalhador, ConexaoServidor* conexao) {
+    while (conexao->saida_enviada < conexao->saida_usada) {
+        ssize_t n = send(conexao->fd, conexao->saida + conexao->saida_enviada,
+                         conexao->saida_usada - conexao->saida_enviada, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return alternarEscrita(trabalhador, conexao, 1);
+            return 0;
+        }
+        conexao->saida_enviada += (size_t)n;
+    }
+    conexao->saida_usada = conexao->saida_enviada = 0;
+    return alternarEscrita(trabalhador, conexao, 0);
+}
+
+/**
+ * @brief Lê o que chegou, atende todos os pedidos completos e envia as respostas de uma vez.
+ * @note Enquanto houver resposta pendente a conexão só espera EPOLLOUT (alternarEscrita),
+ *       então a saída nunca passa das respostas de uma leitura.
+ * @return 0 se a conexão deve ser fechada.
+ */
+static int lerConexao(TrabalhadorServidor* trabalhador, ConexaoServidor* conexao) {
+    ssize_t n = read(conexao->fd, conexao->entrada + conexao->entrada_usada,
+                     sizeof(conexao->entrada) - conexao->entrada_usada);
+    if (n == 0) return 0;
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+    uint64_t chegada = relogioNs();
+    conexao->entrada_usada += (size_t)n;
+    size_t completos = conexao->entrada_usada / sizeof(PedidoServidor);
+    size_t necessario = conexao->saida_usada + completos * sizeof(RespostaServidor);
+    if (necessario > conexao->saida_capacidade) {
+        size_t capacidade = conexao->saida_capacidade ? conexao->saida_capacidade : 4096;
+        while (capacidade < necessario) capacidade *= 2;
+        unsigned char* maior = (unsigned char*)realloc(conexao->saida, capacidade);
+        if (maior == NULL) return 0;
+        conexao->saida = maior;
+        conexao->saida_capacidade = capacidade;
+    }
+
+    uint64_t ataques = 0;
+    for (size_t i = 0; i < completos; i++) {
+        PedidoServidor pedido;
+        RespostaServidor resposta;
+        memcpy(&pedido, conexao->entrada + i * sizeof(PedidoServidor), sizeof(pedido));
+        atenderPedido(trabalhador, &conexao->sessao, &pedido, &resposta);
+        memcpy(conexao->saida + conexao->saida_usada, &resposta, sizeof(resposta));
+        conexao->saida_usada += sizeof(resposta);
+        ataques += (pedido.operacao == OP_ATACAR);
+    }
+    size_t consumidos = completos * sizeof(PedidoServidor);
+    memmove(conexao->entrada, conexao->entrada + consumidos, conexao->entrada_usada - consumidos);
+    conexao->entrada_usada -= consumidos;
+
+    if (!enviarPendentes(trabalhador, conexao)) return 0;
+    if (ataques > 0) trabalhador->local.latencia[baldeLatencia(relogioNs() - chegada)]++;
+    return 1;
+}
+
+static void fecharConexao(TrabalhadorServidor* trabalhador, ConexaoServidor* conexao) {
+    epoll_ctl(trabalhador->epoll, EPOLL_CTL_DEL, conexao->fd, NULL);
+    close(conexao->fd);
+    if (conexao->anterior != NULL) conexao->anterior->proximo = conexao->proximo;
+    else trabalhador->conexoes = conexao->proximo;
+    if (conexao->proximo != NULL) conexao->proximo->anterior = conexao->anterior;
+    trabalhador->num_conexoes--;
+
+    destruirArena(&conexao->sessao.arena);
+    free(conexao->saida);
+    free(conexao);
+}
+
+/**
+ * @brief Recebe pelo pipe os descritores aceitos pela thread principal e passa a atendê-los.
+ */
+static void receberConexoes(TrabalhadorServidor* trabalhador) {
+    int fds[64];
+    ssize_t n;
+    while ((n = read(trabalhador->canal[0], fds, sizeof(fds))) > 0) {
+        for (int i = 0; i < (int)(n / (ssize_t)sizeof(int)); i++) {
+            ConexaoServidor* conexao = (ConexaoServidor*)calloc(1, sizeof(ConexaoServidor));
+            struct epoll_event evento = { .events = EPOLLIN, .data.ptr = conexao };
+            if (conexao == NULL || epoll_ctl(trabalhador->epoll, EPOLL_CTL_ADD, fds[i], &evento) != 0) {
+                free(conexao);
+                close(fds[i]);
+                continue;
+            }
+            conexao->fd = fds[i];
+            conexao->proximo = trabalhador->conexoes;
+            if (trabalhador->conexoes != NULL) trabalhador->conexoes->anterior = conexao;
+            trabalhador->conexoes = conexao;
+            trabalhador->num_conexoes++;
+        }
+    }
+}
+
+static void publicarEstatisticas(TrabalhadorServidor* trabalhador) {
+    pthread_mutex_lock(&trabalhador->trava);
+    somarEstatisticaServidor(&trabalhador->publicada, &trabalhador->local);
+    trabalhador->conexoes_publicadas = trabalhador->num_conexoes;
+    pthread_mutex_unlock(&trabalhador->trava);
+    memset(&trabalhador->local, 0, sizeof(trabalhador->local));
+}
+
+static void* executarTrabalhador(void* argumento) {
+    TrabalhadorServidor* trabalhador = (TrabalhadorServidor*)argumento;
+    struct epoll_event eventos[MAX_EVENTOS_EPOLL];
+    uint64_t ultima_publicacao = relogioNs();
+
+    while (!atomic_load(&servidor_encerrando)) {
+        int n = epoll_wait(trabalhador->epoll, eventos, MAX_EVENTOS_EPOLL, 200);
+        for (int i = 0; i < n; i++) {
+            ConexaoServidor* conexao = (ConexaoServidor*)eventos[i].data.ptr;
+            if (conexao == NULL) {
+                receberConexoes(trabalhador);
+                continue;
+            }
+            int aberta = conexao->esperando_escrita ? enviarPendentes(trabalhador, conexao)
+                                                    : lerConexao(trabalhador, conexao);
+            if (!aberta || (eventos[i].events & EPOLLERR)) fecharConexao(trabalhador, conexao);
+        }
+        if (relogioNs() - ultima_publicacao >= 1000000000ull) {
+            publicarEstatisticas(trabalhador);
+            ultima_publicacao = relogioNs();
+        }
+    }
+
+    while (trabalhador->conexoes != NULL) fecharConexao(trabalhador, trabalhador->conexoes);
+    publicarEstatisticas(trabalhador);
+    return NULL;
+}
+
+/**
+ * @brief Soma as estatísticas publicadas e imprime o intervalo desde o último relatório.
+ * @param anterior Totais do relatório anterior (atualizados aqui).
+ */
+static void relatarServidor(ServidorSessoes* servidor, EstatisticaServidor* anterior, double segundos, int final) {
+    static EstatisticaServidor total, intervalo;
+    int conexoes = 0;
+
+    memset(&total, 0, sizeof(total));
+    for (int t = 0; t < servidor->num_trabalhadores; t++) {
+        TrabalhadorServidor* trabalhador = &servidor->trabalhadores[t];
+        pthread_mutex_lock(&trabalhador->trava);
+        somarEstatisticaServidor(&total, &trabalhador->publicada);
+        conexoes += trabalhador->conexoes_publicadas;
+        pthread_mutex_unlock(&trabalhador->trava);
+    }
+
+    if (final) {
+        printf("[SERVIDOR] Total: %llu pedidos, %llu ataques (%llu recusados), %llu sessoes criadas.\n",
+               (unsigned long long)total.pedidos, (unsigned long long)total.ataques,
+               (unsigned long long)total.recusados, (unsigned long long)total.sessoes_criadas);
+        printf("[SERVIDOR] Latencia por lote: p50 %.1f us, p99 %.1f us, p99.9 %.1f us.\n",
+               percentilLatencia(total.latencia, 0.50), percentilLatencia(total.latencia, 0.99),
+               percentilLatencia(total.latencia, 0.999));
+    } else {
+        intervalo = total;
+        intervalo.pedidos -= anterior->pedidos;
+        intervalo.ataques -= anterior->ataques;
+        for (int b = 0; b < BALDES_LATENCIA; b++) intervalo.latencia[b] -= anterior->latencia[b];
+        if (intervalo.pedidos > 0) {
+            printf("[SERVIDOR] %d conexoes | %.0f ataques/s | %.0f pedidos/s | p50 %.1f us | p99 %.1f us\n",
+                   conexoes, (double)intervalo.ataques / segundos, (double)intervalo.pedidos / segundos,
+                   percentilLatencia(intervalo.latencia, 0.50), percentilLatencia(intervalo.latencia, 0.99));
+        }
+    }
+    fflush(stdout);
+    *anterior = total;
+}
+
+/**
+ * @brief Hospeda uma sessão independente por conexão num socket Unix, até SIGINT/SIGTERM.
+ * @note A thread principal só aceita conexões e as reparte, em rodízio, entre os
+ *       trabalhadores; cada trabalhador atende as suas com o próprio epoll, então
+ *       nenhuma trava é tomada no caminho de um ataque.
+ * @param modelo Mapa inicial de toda sessão (com fronteiras), lido por todas as threads.
+ * @return 1 se o servidor encerrou normalmente, 0 em caso de erro.
+ */
+int executarServidor(const char* caminho, const Mapa* modelo, const Missao missoes[], int total_missoes,
+                     CorId cor_jogador, int num_trabalhadores) {
+    struct sockaddr_un endereco = { .sun_family = AF_UNIX };
+    if (strlen(caminho) >= sizeof(endereco.sun_path)) {
+        printf("ERRO: Caminho de socket longo demais: '%s'.\n", caminho);
+        return 0;
+    }
+    strcpy(endereco.sun_path, caminho);
+
+    int escuta = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(caminho);
+    if (escuta < 0 || fcntl(escuta, F_SETFL, O_NONBLOCK) != 0 || bind(escuta, (struct sockaddr*)&endereco, sizeof(endereco)) != 0 ||
+        listen(escuta, SOMAXCONN) != 0) {
+        printf("ERRO: Nao foi possivel escutar em '%s'.\n", caminho);
+        if (escuta >= 0) close(escuta);
+        return 0;
+    }
+
+    ServidorSessoes* servidor = (ServidorSessoes*)calloc(1, sizeof(ServidorSessoes));
+    int epoll_escuta = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event evento_escuta = { .events = EPOLLIN, .data.ptr = NULL };
+    if (servidor == NULL || epoll_escuta < 0 || epoll_ctl(epoll_escuta, EPOLL_CTL_ADD, escuta, &evento_escuta) != 0) {
+        printf("ERRO: Falha ao iniciar o servidor.\n");
+        free(servidor);
+        if (epoll_escuta >= 0) close(epoll_escuta);
+        close(escuta);
+        unlink(caminho);
+        return 0;
+    }
+    servidor->modelo = modelo;
+    servidor->missoes = missoes;
+    servidor->total_missoes = total_missoes;
+    servidor->cor_jogador = cor_jogador;
+    if (num_trabalhadores < 1) num_trabalhadores = 1;
+    if (num_trabalhadores > MAX_THREADS) num_trabalhadores = MAX_THREADS;
+
+    atomic_store(&servidor_encerrando, 0);
+    struct sigaction acao = { .sa_handler = sinalEncerrarServidor };
+    sigemptyset(&acao.sa_mask);
+    sigaction(SIGINT, &acao, NULL);
+    sigaction(SIGTERM, &acao, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int t = 0; t < num_trabalhadores; t++) {
+        TrabalhadorServidor* trabalhador = &servidor->trabalhadores[t];
+        struct epoll_event evento_canal = { .events = EPOLLIN, .data.ptr = NULL };
+        trabalhador->servidor = servidor;
+        trabalhador->canal[0] = trabalhador->canal[1] = -1;
+        trabalhador->epoll = epoll_create1(EPOLL_CLOEXEC);
+        int iniciado = trabalhador->epoll >= 0 && pipe(trabalhador->canal) == 0 &&
+                       fcntl(trabalhador->canal[0], F_SETFL, O_NONBLOCK) == 0 &&
+                       epoll_ctl(trabalhador->epoll, EPOLL_CTL_ADD, trabalhador->canal[0], &evento_canal) == 0 &&
+                       pthread_mutex_init(&trabalhador->trava, NULL) == 0;
+        if (iniciado && pthread_create(&trabalhador->thread, NULL, executarTrabalhador, trabalhador) != 0) {
+            pthread_mutex_destroy(&trabalhador->trava);
+            iniciado = 0;
+        }
+        if (!iniciado) {
+            printf("AVISO: Apenas %d trabalhadores iniciados.\n", t);
+            if (trabalhador->epoll >= 0) close(trabalhador->epoll);
+            if (trabalhador->canal[0] >= 0) close(trabalhador->canal[0]);
+            if (trabalhador->canal[1] >= 0) close(trabalhador->canal[1]);
+            break;
+        }
+        servidor->num_trabalhadores++;
+    }
+
+    printf("[SERVIDOR] Escutando em '%s' com %d trabalhadores; cada sessao comeca no mapa de %d territorios.\n",
+           caminho, servidor->num_trabalhadores, modelo->tamanho);
+    printf("[SERVIDOR] Ctrl+C (SIGINT) ou SIGTERM encerra.\n");
+    fflush(stdout);
+
+    static EstatisticaServidor anterior;
+    memset(&anterior, 0, sizeof(anterior));
+    uint64_t inicio = relogioNs(), ultimo_relatorio = inicio;
+    int proximo = 0;
+    while (servidor->num_trabalhadores > 0 && !atomic_load(&servidor_encerrando)) {
+        struct epoll_event evento;
+        if (epoll_wait(epoll_escuta, &evento, 1, 1000) > 0) {
+            int cliente;
+            while ((cliente = accept(escuta, NULL, NULL)) >= 0) {
+                fcntl(cliente, F_SETFL, O_NONBLOCK);
+                TrabalhadorServidor* trabalhador = &servidor->trabalhadores[proximo];
+                proximo = (proximo + 1) % servidor->num_trabalhadores;
+                if (write(trabalhador->canal[1], &cliente, sizeof(cliente)) != (ssize_t)sizeof(cliente)) {
+                    close(cliente);
+                }
+            }
+        }
+        uint64_t agora = relogioNs();
+        if (agora - ultimo_relatorio >= (uint64_t)INTERVALO_RELATORIO_SERVIDOR * 1000000000ull) {
+            relatarServidor(servidor, &anterior, (double)(agora - ultimo_relatorio) * 1e-9, 0);
+            ultimo_relatorio = agora;
+        }
+    }
+
+    atomic_store(&servidor_encerrando, 1);
+    for (int t = 0; t < servidor->num_trabalhadores; t++) {
+        TrabalhadorServidor* trabalhador = &servidor->trabalhadores[t];
+        pthread_join(trabalhador->thread, NULL);
+        close(trabalhador->epoll);
+        close(trabalhador->canal[0]);
+        close(trabalhador->canal[1]);
+    }
+    printf("\n[SERVIDOR] Encerrado apos %.1f s.\n", (double)(relogioNs() - inicio) * 1e-9);
+    relatarServidor(servidor, &anterior, 0.0, 1);
+    for (int t = 0; t < servidor->num_trabalhadores; t++) pthread_mutex_destroy(&servidor->trabalhadores[t].trava);
+
+    close(epoll_escuta);
+    close(escuta);
+    unlink(caminho);
+    free(servidor);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    return 1;
+}
+
+// ============================================================================
+// --- Implementação do Cliente de Carga ---
+// ============================================================================
+
+/**
+ * @brief Conexões de uma thread do cliente e o que elas mediram.
+ */
+typedef struct {
+    const char* caminho;
+    int primeira;       // Índice global da primeira conexão (semente da sessão)
+    int quantidade;
+    long long pedidos;  // Por conexão
+    pthread_t thread;
+    long long enviados;
+    long long recusados;
+    long long conquistas;
+    int falhou;
+    uint64_t latencia[BALDES_LATENCIA]; // Ida e volta de cada janela de pedidos
+} ThreadCliente;
+
+static int receberTudo(int fd, void* destino, size_t tamanho) {
+    unsigned char* p = (unsigned char*)destino;
+    while (tamanho > 0) {
+        ssize_t n = read(fd, p, tamanho);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        p += n;
+        tamanho -= (size_t)n;
+    }
+    return 1;
+}
+
+static int conectarServidor(const char* caminho) {
+    struct sockaddr_un endereco = { .sun_family = AF_UNIX };
+    if (strlen(caminho) >= sizeof(endereco.sun_path)) return -1;
+    strcpy(endereco.sun_path, caminho);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&endereco, sizeof(endereco)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Abre as conexões da thread, cria uma sessão em cada e envia janelas de
+ *        JANELA_CLIENTE pedidos (ataques entre IDs vizinhos e, a cada 16, uma verificação).
+ */
+static void* executarThreadCliente(void* argumento) {
+    ThreadCliente* tc = (ThreadCliente*)argumento;
+    int fds[MAX_CONEXOES_THREAD_CLIENTE];
+    int tamanhos[MAX_CONEXOES_THREAD_CLIENTE];
+    PedidoServidor janela[JANELA_CLIENTE];
+    RespostaServidor respostas[JANELA_CLIENTE];
+    GeradorAleatorio gerador;
+    int abertas = 0;
+
+    semearGerador(&gerador, (uint64_t)tc->primeira, 1);
+    for (int c = 0; c < tc->quantidade; c++) {
+        PedidoServidor nova = { .operacao = OP_NOVA_SESSAO, .a = (uint32_t)(tc->primeira + c) };
+        RespostaServidor resposta;
+        fds[c] = conectarServidor(tc->caminho);
+        if (fds[c] < 0 || !gravarTudo(fds[c], &nova, sizeof(nova)) || !receberTudo(fds[c], &resposta, sizeof(resposta)) ||
+            resposta.status != RESPOSTA_OK || resposta.valor_a < 2) {
+            if (fds[c] >= 0) close(fds[c]);
+            tc->falhou = 1;
+            break;
+        }
+        tamanhos[c] = resposta.valor_a;
+        abertas++;
+    }
+
+    for (long long restantes = tc->pedidos; !tc->falhou && restantes > 0;) {
+        int n = restantes < JANELA_CLIENTE ? (int)restantes : JANELA_CLIENTE;
+        for (int c = 0; c < abertas && !tc->falhou; c++) {
+            for (int k = 0; k < n; k++) {
+                uint32_t a = sortearLimitado(&gerador, (uint32_t)tamanhos[c]);
+                janela[k].operacao = ((k & 15) == 15) ? OP_VERIFICAR : OP_ATACAR;
+                janela[k].a = a;
+                janela[k].b = (a + 1 < (uint32_t)tamanhos[c]) ? a + 1 : a - 1;
+            }
+            uint64_t envio = relogioNs();
+            if (!gravarTudo(fds[c], janela, (size_t)n * sizeof(PedidoServidor)) ||
+                !receberTudo(fds[c], respostas, (size_t)n * sizeof(RespostaServidor))) {
+                tc->falhou = 1;
+                break;
+            }
+            tc->latencia[baldeLatencia(relogioNs() - envio)]++;
+            for (int k = 0; k < n; k++) {
+                tc->recusados += (respostas[k].status == RESPOSTA_RECUSADO);
+                tc->conquistas += respostas[k].conquista;
+            }
+            tc->enviados += n;
+        }
+        restantes -= n;
+    }
+
+    for (int c = 0; c < abertas; c++) close(fds[c]);
+    return NULL;
+}
+
+/**
+ * @brief Gera carga contra um servidor: 'conexoes' sessões, 'pedidos' pedidos em cada.
+ * @return 1 se todas as conexões completaram, 0 caso contrário.
+ */
+int executarCliente(const char* caminho, int conexoes, long long pedidos) {
+    int num_threads = numeroDeThreads();
+    if (conexoes < 1) conexoes = 1;
+    if (conexoes > num_threads * MAX_CONEXOES_THREAD_CLIENTE) conexoes = num_threads * MAX_CONEXOES_THREAD_CLIENTE;
+    if (num_threads > conexoes) num_threads = conexoes;
+
+    ThreadCliente* threads = (ThreadCliente*)calloc((size_t)num_threads, sizeof(ThreadCliente));
+    if (threads == NULL) return 0;
+    signal(SIGPIPE, SIG_IGN);
+
+    uint64_t inicio = relogioNs();
+    int primeira = 0, iniciadas = 0;
+    for (int t = 0; t < num_threads; t++) {
+        threads[t].caminho = caminho;
+        threads[t].primeira = primeira;
+        threads[t].quantidade = conexoes / num_threads + (t < conexoes % num_threads);
+        threads[t].pedidos = pedidos;
+        primeira += threads[t].quantidade;
+        if (pthread_create(&threads[t].thread, NULL, executarThreadCliente, &threads[t]) != 0) break;
+        iniciadas++;
+    }
+
+    static uint64_t latencia[BALDES_LATENCIA];
+    long long enviados = 0, recusados = 0, conquistas = 0;
+    int falhou = (iniciadas < num_threads);
+    memset(latencia, 0, sizeof(latencia));
+    for (int t = 0; t < iniciadas; t++) {
+        pthread_join(threads[t].thread, NULL);
+        enviados += threads[t].enviados;
+        recusados += threads[t].recusados;
+        conquistas += threads[t].conquistas;
+        falhou |= threads[t].falhou;
+        for (int b = 0; b < BALDES_LATENCIA; b++) latencia[b] += threads[t].latencia[b];
+    }
+    double segundos = (double)(relogioNs() - inicio) * 1e-9;
+
+    if (falhou) printf("AVISO: Parte das conexoes com '%s' falhou.\n", caminho);
+    printf("[CLIENTE] %d conexoes, %lld pedidos em %.2f s: %.0f pedidos/s (%lld ataques recusados, %lld conquistas).\n",
+           conexoes, enviados, segundos, segundos > 0.0 ? (double)enviados / segundos : 0.0, recusados, conquistas);
+    printf("[CLIENTE] Ida e volta de uma janela de %d pedidos: p50 %.1f us, p99 %.1f us.\n", JANELA_CLIENTE,
+           percentilLatencia(latencia, 0.50), percentilLatencia(latencia, 0.99));
+    free(threads);
+    return !falhou;
+}
+
+// ============================================================================
+// --- Implementação do Torneio de Partidas Automáticas ---
+// ============================================================================
+
+/**
+ * @brief Estratégia de jogo: escolhe o ataque da cor no estado atual (atacante == -1: passar).
+ * @note Só lê o mapa; o torneio resolve o ataque escolhido.
  */
+typedef LanceIa (*FuncaoEstrategia)(const Mapa* mapa, CorId cor, GeradorAleatorio* gerador);
+
 typedef struct {
-    char nome[MAX_STRING];
-    char cor[MAX_COR]; // Cor do exército dominante (sempre armazenada em MAIÚSCULAS)
-    int tropas;
-} Territorio;
+    const char* nome;
+    FuncaoEstrategia escolher;
+} EstrategiaTorneio;
 
-// ============================================================================
-// --- Protótipos de Funções ---
-// ============================================================================
+/**
+ * @brief Resultados somados das partidas de uma missão.
+ * @note Só contadores inteiros: a soma não depende da ordem em que as threads terminam.
+ */
+typedef struct {
+    long long partidas;
+    long long vitorias;
+    long long derrotas;        // O jogador foi eliminado
+    long long impasses;        // Nenhuma cor pôde atacar, ou o limite de turnos acabou
+    long long turnos;          // Soma da duração de todas as partidas
+    long long turnos_vitoria;  // Soma dos turnos até cumprir a missão, nas vitórias
+    long long tropas_perdidas; // Tropas do jogador perdidas, atacando ou defendendo
+    long long ataques;
+} EstatisticaMissaoTorneio;
 
-// Gerenciamento de Memória
-Territorio* alocarMapa(int tamanho);
-char* alocarMissao(void);
-void liberarMemoria(Territorio* mapa, char* missao);
+/**
+ * @brief Estado compartilhado entre as threads do torneio.
+ * @note Como na estimativa, as threads retiram blocos de partidas de um contador atômico.
+ *       A partida i usa o fluxo i + 1 do gerador e a missão i % total_missoes, então
+ *       o resultado não depende de quantas threads jogaram nem de qual jogou cada bloco.
+ */
+typedef struct {
+    const Mapa* modelo;
+    const Missao* missoes;
+    int total_missoes;
+    int num_cores;
+    CorId cor_jogador;
+    FuncaoEstrategia estrategia_jogador;
+    FuncaoEstrategia estrategia_adversarios;
+    long long partidas;
+    long long total_blocos;
+    uint64_t semente;
+    PoolArenas arenas;
+    atomic_llong proximo_bloco;
+} TarefaTorneio;
 
-// Setup e Exibição
-void cadastrarTerritorios(Territorio* mapa, int tamanho);
-void exibirMapa(const Territorio* mapa, int tamanho);
-void exibirMissao(const char* missao);
+/**
+ * @brief Acumuladores de uma thread, escritos só por ela e somados após o join.
+ */
+typedef struct {
+    TarefaTorneio* tarefa;
+    pthread_t thread;
+    int falhou;
+    EstatisticaMissaoTorneio missoes[TOTAL_MISSOES];
+} ParcialTorneio;
 
-// Lógica do Jogo (Missões e Batalha)
-void atribuirMissao(char* destino, const char* missoes[], int totalMissoes);
-int verificarMissao(const char* missao, const Territorio* mapa, int tamanho, const char* cor_jogador);
-void faseDeAtaque(Territorio* mapa, int tamanho, const char* cor_jogador);
-void atacar(Territorio* atacante, Territorio* defensor);
+/**
+ * @brief Sorteia, com chance igual, um dos ataques válidos da cor (amostragem de reservatório).
+ */
+static LanceIa estrategiaAleatoria(const Mapa* mapa, CorId cor, GeradorAleatorio* gerador) {
+    const GrafoFronteiras* grafo = mapa->fronteiras;
+    const AgregadosMapa* ag = mapa->agregados;
+    LanceIa lance = { -1, -1, 0 };
+    uint32_t validos = 0;
 
-// Utilitárias
-void limparBufferEntrada(void);
-int rolarDado(void);
-void toUpperString(char* str); // Nova função para conversão
+    for (int a = ag->primeiro[cor]; a >= 0; a = ag->proximo[a]) {
+        if (mapa->tropas[a] < 2) continue;
+        for (int k = grafo->inicio[a]; k < grafo->inicio[a + 1]; k++) {
+            int d = grafo->vizinhos[k];
+            if (mapa->dono[d] == cor) continue;
+            if (sortearLimitado(gerador, ++validos) == 0) {
+                lance.atacante = a;
+                lance.defensor = d;
+            }
+        }
+    }
+    return lance;
+}
 
-// ============================================================================
-// --- Função Principal (main) ---
-// ============================================================================
+/**
+ * @brief Ataca onde a vantagem de tropas é maior (o primeiro par, em caso de empate).
+ */
+static LanceIa estrategiaGulosa(const Mapa* mapa, CorId cor, GeradorAleatorio* gerador) {
+    const GrafoFronteiras* grafo = mapa->fronteiras;
+    const AgregadosMapa* ag = mapa->agregados;
+    LanceIa lance = { -1, -1, 0 };
+    int melhor = INT_MIN;
+    (void)gerador;
 
-int main() {
-    srand((unsigned int)time(NULL)); 
-    
-    // Vetor de Strings para Missões
-    const char* missoes[] = {
-        "Conquistar 4 territorios seguidos.",
-        "Eliminar todas as tropas da cor VERDE.",
-        "Conquistar um total de 3 territorios no mapa.",
-        "Garantir que pelo menos 3 de seus territorios tenham mais de 5 tropas.",
-        "Dominar o mapa inteiro (todos os territorios)."
-    };
-    // Cor do jogador definida em MAIÚSCULAS para comparação consistente
-    const char* cor_jogador = "AZUL"; 
+    for (int a = ag->primeiro[cor]; a >= 0; a = ag->proximo[a]) {
+        if (mapa->tropas[a] < 2) continue;
+        for (int k = grafo->inicio[a]; k < grafo->inicio[a + 1]; k++) {
+            int d = grafo->vizinhos[k];
+            int vantagem = mapa->tropas[a] - mapa->tropas[d];
+            if (mapa->dono[d] != cor && vantagem > melhor) {
+                melhor = vantagem;
+                lance.atacante = a;
+                lance.defensor = d;
+            }
+        }
+    }
+    return lance;
+}
 
-    int num_territorios = 0;
-    Territorio* mapa = NULL; 
-    char* missao_jogador = NULL; 
+/**
+ * @brief Só ataca com vantagem de pelo menos 2 tropas; senão, passa a vez.
+ */
+static LanceIa estrategiaCautelosa(const Mapa* mapa, CorId cor, GeradorAleatorio* gerador) {
+    LanceIa lance = estrategiaGulosa(mapa, cor, gerador);
+    if (lance.atacante >= 0 && mapa->tropas[lance.atacante] - mapa->tropas[lance.defensor] < 2) {
+        lance.atacante = lance.defensor = -1;
+    }
+    return lance;
+}
 
-    printf("=======================================================\n");
-    printf("         WAR ESTRUTURADO - DESAFIO FINAL\n");
-    printf("=======================================================\n");
+static const EstrategiaTorneio estrategias_torneio[] = {
+    { "aleatoria", estrategiaAleatoria },
+    { "gulosa", estrategiaGulosa },
+    { "cautelosa", estrategiaCautelosa },
+};
 
-    printf("Informe o numero total de territorios (Min. 5): ");
-    if (scanf("%d", &num_territorios) != 1 || num_territorios < 5) {
-        printf("Numero de territorios ajustado para 5.\n");
-        num_territorios = 5;
+static FuncaoEstrategia buscarEstrategia(const char* nome) {
+    for (size_t i = 0; i < sizeof(estrategias_torneio) / sizeof(estrategias_torneio[0]); i++) {
+        if (strcmp(estrategias_torneio[i].nome, nome) == 0) return estrategias_torneio[i].escolher;
     }
-    limparBufferEntrada();
-    
-    mapa = alocarMapa(num_territorios);
-    missao_jogador = alocarMissao(); 
+    return NULL;
+}
 
-    if (mapa == NULL || missao_jogador == NULL) {
-        printf("ERRO: Falha ao alocar memoria. Encerrando o programa.\n");
-        liberarMemoria(mapa, missao_jogador);
-        return 1;
+/**
+ * @brief Joga uma partida completa, sem E/S: a cada turno, o jogador e depois cada
+ *        outra cor viva fazem um ataque (uma rodada de resolverBatalha()).
+ * @return 0 se faltou memória na arena.
+ */
+static int jogarPartidaTorneio(TarefaTorneio* tarefa, Arena* arena, long long partida,
+                               EstatisticaMissaoTorneio* estatisticas) {
+    CorId jogador = tarefa->cor_jogador;
+    GeradorAleatorio gerador;
+    semearGerador(&gerador, tarefa->semente, (uint64_t)partida + 1);
+
+    reiniciarArena(arena);
+    Mapa* mapa = clonarMapa(arena, tarefa->modelo);
+    if (mapa == NULL) return 0;
+    int indice_missao = (int)(partida % tarefa->total_missoes);
+    const Missao* missao = &tarefa->missoes[indice_missao];
+    prepararMissao(mapa, missao);
+
+    EstatisticaMissaoTorneio* estatistica = &estatisticas[indice_missao];
+    int turno = 0, vitoria = 0, derrota = 0;
+    while (!vitoria && !derrota && turno < TURNOS_MAXIMOS_TORNEIO) {
+        int ataques = 0;
+        turno++;
+        for (int k = 0; k < tarefa->num_cores && !vitoria && !derrota; k++) {
+            // O jogador abre o turno; as demais cores seguem a ordem dos CorId
+            CorId cor = (CorId)((jogador + k) % tarefa->num_cores);
+            if (mapa->agregados->territorios[cor] == 0) continue;
+
+            FuncaoEstrategia estrategia = (cor == jogador) ? tarefa->estrategia_jogador
+                                                           : tarefa->estrategia_adversarios;
+            LanceIa lance = estrategia(mapa, cor, &gerador);
+            if (lance.atacante < 0) continue;
+
+            ResultadoBatalha resultado;
+            CorId defensor = mapa->dono[lance.defensor];
+            resolverBatalha(mapa, lance.atacante, lance.defensor, &resultado, &gerador);
+            ataques++;
+            if (cor == jogador) estatistica->tropas_perdidas += resultado.perdas_atacante;
+            if (defensor == jogador) estatistica->tropas_perdidas += resultado.perdas_defensor;
+
+            vitoria = verificarMissao(missao, mapa, jogador);
+            derrota = (mapa->agregados->territorios[jogador] == 0);
+        }
+        estatistica->ataques += ataques;
+        if (ataques == 0) break;
     }
-    
-    atribuirMissao(missao_jogador, missoes, TOTAL_MISSOES);
-    exibirMissao(missao_jogador);
-    
-    printf("\n[ATENCAO] Seu exercito e a cor: %s\n", cor_jogador);
-    
-    // O cadastro agora garante que as cores sejam armazenadas em MAIÚSCULAS
-    cadastrarTerritorios(mapa, num_territorios);
 
-    int escolha = -1;
-    int vitoria = 0;
-    do {
-        exibirMapa(mapa, num_territorios);
-        printf("\n--- Menu de Acoes ---\n");
-        printf("1. Iniciar Ataque\n");
-        printf("2. Verificar Missao (Condicao de Vitoria)\n");
-        printf("0. Sair do Jogo\n");
-        printf("Sua escolha: ");
-        
-        if (scanf("%d", &escolha) != 1) {
-            limparBufferEntrada();
-            escolha = -1; 
-        } else {
-            limparBufferEntrada();
+    estatistica->partidas++;
+    estatistica->turnos += turno;
+    if (vitoria) {
+        estatistica->vitorias++;
+        estatistica->turnos_vitoria += turno;
+    } else if (derrota) {
+        estatistica->derrotas++;
+    } else {
+        estatistica->impasses++;
+    }
+    return 1;
+}
+
+static void* executarParcialTorneio(void* argumento) {
+    ParcialTorneio* parcial = (ParcialTorneio*)argumento;
+    TarefaTorneio* tarefa = parcial->tarefa;
+    Arena* arena = obterArena(&tarefa->arenas);
+    if (arena == NULL) {
+        parcial->falhou = 1;
+        return NULL;
+    }
+
+    for (;;) {
+        long long bloco = atomic_fetch_add(&tarefa->proximo_bloco, 1);
+        if (bloco >= tarefa->total_blocos) break;
+
+        long long fim = (bloco + 1) * PARTIDAS_POR_BLOCO_TORNEIO;
+        if (fim > tarefa->partidas) fim = tarefa->partidas;
+        for (long long p = bloco * PARTIDAS_POR_BLOCO_TORNEIO; p < fim; p++) {
+            if (!jogarPartidaTorneio(tarefa, arena, p, parcial->missoes)) parcial->falhou = 1;
         }
+    }
+    devolverArena(&tarefa->arenas, arena);
+    return NULL;
+}
 
-        if (escolha == 1) {
-            faseDeAtaque(mapa, num_territorios, cor_jogador);
-            vitoria = verificarMissao(missao_jogador, mapa, num_territorios, cor_jogador);
-        } else if (escolha == 2) {
-            vitoria = verificarMissao(missao_jogador, mapa, num_territorios, cor_jogador);
-            if (vitoria) {
-                printf("\n=======================================================\n");
-                printf("!!! MISSAO CUMPRIDA: VOCE VENCEU O JOGO !!!\n");
-                printf("=======================================================\n");
-            } else {
-                printf("\nA missao '%s' ainda nao foi cumprida. Continue lutando.\n", missao_jogador);
-            }
-        } else if (escolha != 0) {
-            printf("\nOpcao invalida. Tente novamente.\n");
+/**
+ * @brief Joga 'partidas' partidas completas em todos os núcleos e relata, por missão,
+ *        a taxa de vitória, a duração, as tropas perdidas e o tempo até cumprir a missão.
+ * @note Reproduzível pela semente: cada partida tem o seu fluxo do gerador e os
+ *       parciais de cada thread são somados, sem travas, depois do join.
+ * @param modelo Mapa inicial de todas as partidas (com fronteiras e agregados).
+ * @return 1 em caso de sucesso, 0 se a estratégia não existe ou faltou memória.
+ */
+int executarTorneio(const Mapa* modelo, const TabelaCores* cores, const Missao missoes[], int total_missoes,
+                    CorId cor_jogador, long long partidas, const char* estrategia_jogador,
+                    const char* estrategia_adversarios, uint64_t semente) {
+    static TarefaTorneio tarefa;
+    static ParcialTorneio parciais[MAX_THREADS];
+    char texto_missao[MAX_MISSAO_LEN];
+
+    memset(&tarefa, 0, sizeof(tarefa));
+    tarefa.estrategia_jogador = buscarEstrategia(estrategia_jogador);
+    tarefa.estrategia_adversarios = buscarEstrategia(estrategia_adversarios);
+    if (tarefa.estrategia_jogador == NULL || tarefa.estrategia_adversarios == NULL) {
+        printf("ERRO: Estrategia desconhecida '%s'. Disponiveis:",
+               tarefa.estrategia_jogador == NULL ? estrategia_jogador : estrategia_adversarios);
+        for (size_t i = 0; i < sizeof(estrategias_torneio) / sizeof(estrategias_torneio[0]); i++) {
+            printf(" %s", estrategias_torneio[i].nome);
         }
+        printf("\n");
+        return 0;
+    }
+    if (partidas <= 0 || total_missoes <= 0 || total_missoes > TOTAL_MISSOES) return 0;
 
-    } while (escolha != 0 && !vitoria);
+    tarefa.modelo = modelo;
+    tarefa.missoes = missoes;
+    tarefa.total_missoes = total_missoes;
+    tarefa.num_cores = cores->quantidade;
+    tarefa.cor_jogador = cor_jogador;
+    tarefa.partidas = partidas;
+    tarefa.total_blocos = (partidas + PARTIDAS_POR_BLOCO_TORNEIO - 1) / PARTIDAS_POR_BLOCO_TORNEIO;
+    tarefa.semente = semente;
+    atomic_init(&tarefa.proximo_bloco, 0);
 
-    liberarMemoria(mapa, missao_jogador);
-    printf("\nMemoria e recursos liberados. Programa finalizado.\n");
+    int num_threads = numeroDeThreads();
+    if (num_threads > MAX_THREADS) num_threads = MAX_THREADS;
+    if (num_threads > tarefa.total_blocos) num_threads = (int)tarefa.total_blocos;
+    if (!criarPoolArenas(&tarefa.arenas, num_threads, tamanhoArenaClone(modelo->tamanho))) {
+        printf("ERRO: Memoria insuficiente para o torneio.\n");
+        return 0;
+    }
 
-    return 0;
+    struct timespec inicio, fim;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    memset(parciais, 0, sizeof(parciais));
+    int criadas = 0;
+    parciais[0].tarefa = &tarefa; // A thread 0 é a própria chamadora
+    for (int t = 1; t < num_threads; t++) {
+        parciais[t].tarefa = &tarefa;
+        // Os blocos das threads que não puderam ser criadas ficam com as demais
+        if (pthread_create(&parciais[t].thread, NULL, executarParcialTorneio, &parciais[t]) != 0) break;
+        criadas = t;
+    }
+    executarParcialTorneio(&parciais[0]);
+    for (int t = 1; t <= criadas; t++) {
+        pthread_join(parciais[t].thread, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &fim);
+    destruirPoolArenas(&tarefa.arenas);
+
+    EstatisticaMissaoTorneio total[TOTAL_MISSOES] = { 0 };
+    EstatisticaMissaoTorneio geral = { 0 };
+    int falhou = 0;
+    for (int t = 0; t < num_threads; t++) {
+        falhou |= parciais[t].falhou;
+        for (int m = 0; m < total_missoes; m++) {
+            const EstatisticaMissaoTorneio* origem = &parciais[t].missoes[m];
+            EstatisticaMissaoTorneio* destinos[2] = { &total[m], &geral };
+            for (int k = 0; k < 2; k++) {
+                destinos[k]->partidas += origem->partidas;
+                destinos[k]->vitorias += origem->vitorias;
+                destinos[k]->derrotas += origem->derrotas;
+                destinos[k]->impasses += origem->impasses;
+                destinos[k]->turnos += origem->turnos;
+                destinos[k]->turnos_vitoria += origem->turnos_vitoria;
+                destinos[k]->tropas_perdidas += origem->tropas_perdidas;
+                destinos[k]->ataques += origem->ataques;
+            }
+        }
+    }
+    if (falhou) {
+        printf("ERRO: Memoria insuficiente para parte das partidas do torneio.\n");
+        return 0;
+    }
+
+    double segundos = (double)(fim.tv_sec - inicio.tv_sec) + (double)(fim.tv_nsec - inicio.tv_nsec) * 1e-9;
+    printf("[TORNEIO] %lld partidas em %.2f s (%.0f partidas/s, %d threads). Semente %llu.\n", partidas, segundos,
+           segundos > 0.0 ? (double)partidas / segundos : 0.0, num_threads, (unsigned long long)semente);
+    printf("[TORNEIO] Jogador (%s): %s. Adversarios: %s. Mapa de %d territorios, limite de %d turnos.\n\n",
+           nomeDaCor(cores, cor_jogador), estrategia_jogador, estrategia_adversarios, modelo->tamanho,
+           TURNOS_MAXIMOS_TORNEIO);
+    printf("| Missao | Partidas   | Vitorias | Derrotas | Impasses | Turnos  | Turnos p/ vencer | Tropas perdidas |\n");
+    printf("|--------|------------|----------|----------|----------|---------|------------------|-----------------|\n");
+    for (int m = 0; m <= total_missoes; m++) {
+        const EstatisticaMissaoTorneio* e = (m < total_missoes) ? &total[m] : &geral;
+        double n = e->partidas > 0 ? (double)e->partidas : 1.0;
+        char rotulo[8];
+        if (m < total_missoes) snprintf(rotulo, sizeof(rotulo), "%d", m + 1);
+        else snprintf(rotulo, sizeof(rotulo), "Todas");
+        if (m == total_missoes) {
+            printf("|--------|------------|----------|----------|----------|---------|------------------|-----------------|\n");
+        }
+        printf("| %-6s | %-10lld | %7.2f%% | %7.2f%% | %7.2f%% | %-7.1f | %-16.1f | %-15.2f |\n", rotulo, e->partidas,
+               100.0 * e->vitorias / n, 100.0 * e->derrotas / n, 100.0 * e->impasses / n, e->turnos / n,
+               e->vitorias > 0 ? (double)e->turnos_vitoria / e->vitorias : 0.0, e->tropas_perdidas / n);
+    }
+    printf("\n");
+    for (int m = 0; m < total_missoes; m++) {
+        printf("Missao %d: %s\n", m + 1, descreverMissao(&missoes[m], cores, texto_missao, sizeof(texto_missao)));
+    }
+    return 1;
 }
 
+#ifdef WAR_INSTRUMENTACAO
 // ============================================================================
-// --- Implementação das Funções de Gerenciamento de Memória ---
+// --- Implementação da Instrumentação ---
 // ============================================================================
 
-Territorio* alocarMapa(int tamanho) {
-    Territorio* mapa = (Territorio*)calloc(tamanho, sizeof(Territorio));
-    return mapa;
-}
+static const char* const nomesFases[TOTAL_FASES] = {
+    "entrada_ataque", "ataque", "batalha", "missao", "exibicao", "escrita",
+    "estimativa", "turno_ia", "busca_mcts"
+};
+static const char* const nomesContadores[TOTAL_CONTADORES] = {
+    "batalhas", "conquistas", "linhas_exibidas", "bytes_escritos", "simulacoes_mcts"
+};
 
-char* alocarMissao(void) {
-    char* missao = (char*)malloc(MAX_MISSAO_LEN * sizeof(char)); 
-    return missao;
+static _Thread_local RegistroInstrumentacao* registro_thread;
+static RegistroInstrumentacao* registros_vivos;    // Threads que já mediram algo
+static RegistroInstrumentacao registro_encerradas; // Soma das threads já encerradas
+static RegistroInstrumentacao registro_reserva;    // Usado se faltar memória (contagem aproximada)
+static pthread_mutex_t trava_instrumentacao = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t chave_instrumentacao;
+static pthread_once_t chave_instrumentacao_criada = PTHREAD_ONCE_INIT;
+static const char* arquivo_relatorio_saida;
+
+/**
+ * @brief Relógio das medições: contador de ciclos (rdtsc) em x86, nanossegundos nas demais.
+ */
+static inline uint64_t lerCiclos(void) {
+#if WAR_SIMD_X86
+    return __rdtsc();
+#else
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    return (uint64_t)agora.tv_sec * 1000000000ull + (uint64_t)agora.tv_nsec;
+#endif
 }
 
-void liberarMemoria(Territorio* mapa, char* missao) {
-    if (mapa != NULL) {
-        free(mapa);
+/**
+ * @brief Ciclos por segundo, calibrados uma vez contra o relógio monotônico (~20 ms).
+ */
+static double ciclosPorSegundo(void) {
+#if WAR_SIMD_X86
+    static double calibrado = 0.0;
+    if (calibrado == 0.0) {
+        struct timespec inicio, agora;
+        clock_gettime(CLOCK_MONOTONIC, &inicio);
+        uint64_t ciclos_inicio = lerCiclos();
+        double decorrido;
+        do {
+            clock_gettime(CLOCK_MONOTONIC, &agora);
+            decorrido = (double)(agora.tv_sec - inicio.tv_sec) + (double)(agora.tv_nsec - inicio.tv_nsec) * 1e-9;
+        } while (decorrido < 0.02);
+        calibrado = (double)(lerCiclos() - ciclos_inicio) / decorrido;
     }
-    if (missao != NULL) {
-        free(missao);
+    return calibrado;
+#else
+    return 1e9;
+#endif
+}
+
+static void somarRegistro(RegistroInstrumentacao* destino, const RegistroInstrumentacao* origem) {
+    for (int f = 0; f < TOTAL_FASES; f++) {
+        EstatisticaFase* d = &destino->fases[f];
+        const EstatisticaFase* o = &origem->fases[f];
+        if (o->chamadas == 0) continue;
+        if (d->chamadas == 0 || o->minimo < d->minimo) d->minimo = o->minimo;
+        if (o->maximo > d->maximo) d->maximo = o->maximo;
+        d->chamadas += o->chamadas;
+        d->total += o->total;
+        d->proprio += o->proprio;
+        for (int b = 0; b < BALDES_HISTOGRAMA; b++) d->histograma[b] += o->histograma[b];
     }
+    for (int c = 0; c < TOTAL_CONTADORES; c++) destino->contadores[c] += origem->contadores[c];
 }
 
-// ============================================================================
-// --- Implementação das Funções de Missão ---
-// ============================================================================
+/**
+ * @brief Destrutor da chave da thread: guarda o que ela mediu antes de liberar o registro.
+ */
+static void encerrarRegistroThread(void* dados) {
+    RegistroInstrumentacao* reg = (RegistroInstrumentacao*)dados;
 
-void atribuirMissao(char* destino, const char* missoes[], int totalMissoes) {
-    int indice_sorteado = rand() % totalMissoes; 
-    
-    strncpy(destino, missoes[indice_sorteado], MAX_MISSAO_LEN - 1);
-    destino[MAX_MISSAO_LEN - 1] = '\0';
+    pthread_mutex_lock(&trava_instrumentacao);
+    RegistroInstrumentacao** elo = &registros_vivos;
+    while (*elo != NULL && *elo != reg) elo = &(*elo)->proximo;
+    if (*elo != NULL) *elo = reg->proximo;
+    somarRegistro(&registro_encerradas, reg);
+    pthread_mutex_unlock(&trava_instrumentacao);
+    free(reg);
 }
 
-void exibirMissao(const char* missao) {
-    printf("\n[MISSAO SECRETA]: %s\n", missao);
+static void criarChaveInstrumentacao(void) {
+    pthread_key_create(&chave_instrumentacao, encerrarRegistroThread);
 }
 
 /**
- * @brief Verifica se a missão do jogador foi cumprida. 
- * @note As cores nos territorios estão garantidamente em MAIÚSCULAS.
+ * @brief Registro da thread atual, criado no primeiro uso.
+ * @note Depois disso, medir custa uma leitura de variável _Thread_local.
  */
-int verificarMissao(const char* missao, const Territorio* mapa, int tamanho, const char* cor_jogador) {
-    int count_tropas_altas = 0;
-    int count_territorios_jogador = 0;
-    int inimigo_verde_existe = 0;
+RegistroInstrumentacao* registroDaThread(void) {
+    RegistroInstrumentacao* reg = registro_thread;
+    if (__builtin_expect(reg != NULL, 1)) return reg;
 
-    // Conta os territórios do jogador
-    for (int i = 0; i < tamanho; i++) {
-        if (strcmp(mapa[i].cor, cor_jogador) == 0) {
-            count_territorios_jogador++;
-        }
+    reg = (RegistroInstrumentacao*)calloc(1, sizeof(RegistroInstrumentacao));
+    if (reg == NULL) {
+        registro_thread = &registro_reserva;
+        return registro_thread;
     }
+    pthread_once(&chave_instrumentacao_criada, criarChaveInstrumentacao);
+    pthread_setspecific(chave_instrumentacao, reg);
 
-    if (strstr(missao, "Eliminar todas as tropas da cor VERDE")) {
-        for (int i = 0; i < tamanho; i++) {
-            // A comparação agora é segura, pois mapa[i].cor foi convertido para MAIÚSCULAS no cadastro
-            if (strcmp(mapa[i].cor, "VERDE") == 0) {
-                inimigo_verde_existe = 1; 
-                break;
-            }
+    pthread_mutex_lock(&trava_instrumentacao);
+    reg->proximo = registros_vivos;
+    registros_vivos = reg;
+    pthread_mutex_unlock(&trava_instrumentacao);
+    registro_thread = reg;
+    return reg;
+}
+
+void iniciarMedicao(MedicaoEscopo* medicao, int fase) {
+    RegistroInstrumentacao* reg = registroDaThread();
+    medicao->fase = fase;
+    medicao->filhos = 0;
+    medicao->anterior = reg->atual;
+    reg->atual = medicao;
+    medicao->inicio = lerCiclos();
+}
+
+void encerrarMedicao(MedicaoEscopo* medicao) {
+    uint64_t duracao = lerCiclos() - medicao->inicio;
+    RegistroInstrumentacao* reg = registro_thread;
+    EstatisticaFase* e = &reg->fases[medicao->fase];
+
+    if (e->chamadas == 0 || duracao < e->minimo) e->minimo = duracao;
+    if (duracao > e->maximo) e->maximo = duracao;
+    e->chamadas++;
+    e->total += duracao;
+    e->proprio += duracao - (medicao->filhos < duracao ? medicao->filhos : duracao);
+    int balde = duracao ? 63 - __builtin_clzll(duracao) : 0;
+    e->histograma[balde < BALDES_HISTOGRAMA ? balde : BALDES_HISTOGRAMA - 1]++;
+
+    reg->atual = medicao->anterior;
+    if (medicao->anterior != NULL) medicao->anterior->filhos += duracao;
+}
+
+/**
+ * @brief Soma os registros de todas as threads (vivas e encerradas).
+ * @note Chamada pela thread principal com as threads de trabalho já encerradas
+ *       (após o join), então os registros lidos não estão sendo escritos.
+ */
+static void coletarInstrumentacao(RegistroInstrumentacao* total) {
+    memset(total, 0, sizeof(*total));
+    pthread_mutex_lock(&trava_instrumentacao);
+    somarRegistro(total, &registro_encerradas);
+    somarRegistro(total, &registro_reserva);
+    for (const RegistroInstrumentacao* reg = registros_vivos; reg != NULL; reg = reg->proximo) {
+        somarRegistro(total, reg);
+    }
+    pthread_mutex_unlock(&trava_instrumentacao);
+}
+
+/**
+ * @brief Estima o percentil q (0..1) pelo histograma: limite superior do balde em que ele cai.
+ * @return Ciclos (limitado ao máximo observado).
+ */
+static uint64_t percentilFase(const EstatisticaFase* e, double q) {
+    uint64_t alvo = (uint64_t)ceil(q * (double)e->chamadas);
+    uint64_t acumulado = 0;
+    for (int b = 0; b < BALDES_HISTOGRAMA; b++) {
+        acumulado += e->histograma[b];
+        if (acumulado >= alvo && acumulado > 0) {
+            uint64_t limite = (b + 1 < 64) ? (1ull << (b + 1)) - 1 : UINT64_MAX;
+            return limite < e->maximo ? limite : e->maximo;
         }
-        return !inimigo_verde_existe;
     }
-    
-    if (strstr(missao, "Dominar o mapa inteiro")) {
-        return (count_territorios_jogador == tamanho);
+    return e->maximo;
+}
+
+/**
+ * @brief Tabela de estatísticas por fase e contadores (opção do menu).
+ */
+void exibirInstrumentacao(void) {
+    RegistroInstrumentacao total;
+    coletarInstrumentacao(&total);
+    double us = 1e6 / ciclosPorSegundo();
+
+    printf("\n--- ESTATISTICAS DE DESEMPENHO ---\n");
+    printf("| %-14s | %9s | %11s | %11s | %10s | %10s | %10s | %10s |\n", "Fase", "Chamadas", "Total (ms)",
+           "Propr. (ms)", "Media (us)", "p50 (us)", "p99 (us)", "Max (us)");
+    for (int f = 0; f < TOTAL_FASES; f++) {
+        const EstatisticaFase* e = &total.fases[f];
+        if (e->chamadas == 0) continue;
+        printf("| %-14s | %9llu | %11.3f | %11.3f | %10.2f | %10.2f | %10.2f | %10.2f |\n", nomesFases[f],
+               (unsigned long long)e->chamadas, (double)e->total * us / 1000.0, (double)e->proprio * us / 1000.0,
+               (double)e->total * us / (double)e->chamadas, (double)percentilFase(e, 0.50) * us,
+               (double)percentilFase(e, 0.99) * us, (double)e->maximo * us);
     }
-    
-    if (strstr(missao, "Conquistar um total de 3 territorios")) {
-        return (count_territorios_jogador >= 3);
+    printf("Contadores:");
+    for (int c = 0; c < TOTAL_CONTADORES; c++) {
+        printf(" %s=%llu", nomesContadores[c], (unsigned long long)total.contadores[c]);
+    }
+    printf("\n(Tempo proprio exclui as fases medidas dentro da fase; percentis pelo histograma log2.)\n");
+}
+
+/**
+ * @brief Grava as estatísticas em JSON ou, se o caminho terminar em ".csv", em CSV.
+ * @return 1 em caso de sucesso, 0 em caso de erro de escrita.
+ */
+int gravarRelatorioInstrumentacao(const char* caminho) {
+    FILE* arquivo = fopen(caminho, "w");
+    if (arquivo == NULL) {
+        printf("ERRO: Nao foi possivel criar o relatorio '%s'.\n", caminho);
+        return 0;
     }
 
-    if (strstr(missao, "territorios tenham mais de 5 tropas")) {
-        for (int i = 0; i < tamanho; i++) {
-            if (strcmp(mapa[i].cor, cor_jogador) == 0 && mapa[i].tropas > 5) {
-                count_tropas_altas++;
+    RegistroInstrumentacao total;
+    coletarInstrumentacao(&total);
+    double ns = 1e9 / ciclosPorSegundo();
+    size_t n = strlen(caminho);
+    int csv = (n >= 4 && strcmp(caminho + n - 4, ".csv") == 0);
+
+    if (csv) {
+        fprintf(arquivo, "tipo,nome,chamadas,total_ns,proprio_ns,min_ns,max_ns,p50_ns,p99_ns\n");
+        for (int f = 0; f < TOTAL_FASES; f++) {
+            const EstatisticaFase* e = &total.fases[f];
+            fprintf(arquivo, "fase,%s,%llu,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f\n", nomesFases[f],
+                    (unsigned long long)e->chamadas, (double)e->total * ns, (double)e->proprio * ns,
+                    (double)e->minimo * ns, (double)e->maximo * ns, (double)percentilFase(e, 0.50) * ns,
+                    (double)percentilFase(e, 0.99) * ns);
+        }
+        for (int c = 0; c < TOTAL_CONTADORES; c++) {
+            fprintf(arquivo, "contador,%s,%llu,,,,,,\n", nomesContadores[c], (unsigned long long)total.contadores[c]);
+        }
+    } else {
+        fprintf(arquivo, "{\n  \"ciclos_por_segundo\": %.0f,\n  \"fases\": [\n", ciclosPorSegundo());
+        for (int f = 0; f < TOTAL_FASES; f++) {
+            const EstatisticaFase* e = &total.fases[f];
+            fprintf(arquivo,
+                    "    {\"nome\": \"%s\", \"chamadas\": %llu, \"total_ns\": %.0f, \"proprio_ns\": %.0f, "
+                    "\"min_ns\": %.0f, \"max_ns\": %.0f, \"p50_ns\": %.0f, \"p99_ns\": %.0f, \"histograma_log2_ciclos\": [",
+                    nomesFases[f], (unsigned long long)e->chamadas, (double)e->total * ns, (double)e->proprio * ns,
+                    (double)e->minimo * ns, (double)e->maximo * ns, (double)percentilFase(e, 0.50) * ns,
+                    (double)percentilFase(e, 0.99) * ns);
+            for (int b = 0; b < BALDES_HISTOGRAMA; b++) {
+                fprintf(arquivo, "%s%llu", b ? ", " : "", (unsigned long long)e->histograma[b]);
             }
+            fprintf(arquivo, "]}%s\n", f + 1 < TOTAL_FASES ? "," : "");
+        }
+        fprintf(arquivo, "  ],\n  \"contadores\": {");
+        for (int c = 0; c < TOTAL_CONTADORES; c++) {
+            fprintf(arquivo, "%s\"%s\": %llu", c ? ", " : "", nomesContadores[c],
+                    (unsigned long long)total.contadores[c]);
         }
-        return (count_tropas_altas >= 3);
+        fprintf(arquivo, "}\n}\n");
     }
-    
-    if (strstr(missao, "Conquistar 4 territorios seguidos")) {
-        return (count_territorios_jogador >= 4);
+
+    if (fclose(arquivo) != 0) {
+        printf("ERRO: Falha ao gravar o relatorio '%s'.\n", caminho);
+        return 0;
     }
+    return 1;
+}
 
-    return 0;
+static void gravarRelatorioAoSair(void) {
+    if (arquivo_relatorio_saida != NULL) gravarRelatorioInstrumentacao(arquivo_relatorio_saida);
 }
 
+/**
+ * @brief Agenda a gravação do relatório para o fim do programa (atexit).
+ */
+void relatorioInstrumentacaoAoSair(const char* caminho) {
+    if (arquivo_relatorio_saida == NULL) atexit(gravarRelatorioAoSair);
+    arquivo_relatorio_saida = caminho;
+}
+#endif // WAR_INSTRUMENTACAO
 
 // ============================================================================
-// --- Implementação das Funções de Setup e Exibição ---
+// --- Implementação do Gerador Aleatório ---
 // ============================================================================
 
 /**
- * @brief Converte todos os caracteres de uma string para maiúsculas.
- * @param str Ponteiro para a string a ser modificada.
+ * @brief Passo do splitmix64, usado apenas para espalhar a semente no estado.
  */
-void toUpperString(char* str) {
-    for (int i = 0; str[i] != '\0'; i++) {
-        str[i] = (char)toupper((unsigned char)str[i]);
+static uint64_t splitmix64(uint64_t* x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl64(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * @brief Inicializa um gerador a partir da semente do jogo.
+ * @param semente A semente de 64 bits do jogo (reproduz a partida inteira).
+ * @param fluxo Identificador do fluxo (0 para o jogo, 1..N para threads), gerando
+ *              sequências independentes a partir da mesma semente.
+ */
+void semearGerador(GeradorAleatorio* gerador, uint64_t semente, uint64_t fluxo) {
+    uint64_t x = semente;
+    x = splitmix64(&x) ^ (fluxo * 0xD1B54A32D192ED03ULL);
+    for (int i = 0; i < 4; i++) {
+        gerador->s[i] = splitmix64(&x);
     }
+    gerador->posicao = 0;
 }
 
 /**
- * @brief Solicita e armazena os dados de cada território.
+ * @brief Gera o próximo valor de 64 bits (xoshiro256**).
  */
-void cadastrarTerritorios(Territorio* mapa, int tamanho) {
-    for (int i = 0; i < tamanho; i++) {
-        printf("\n--- Cadastro do Territorio %d de %d ---\n", i + 1, tamanho);
+uint64_t proximoAleatorio(GeradorAleatorio* gerador) {
+    uint64_t* s = gerador->s;
+    uint64_t resultado = rotl64(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
 
-        printf("Nome do Territorio: ");
-        if (fgets(mapa[i].nome, MAX_STRING, stdin) == NULL) return;
-        mapa[i].nome[strcspn(mapa[i].nome, "\n")] = '\0';
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl64(s[3], 45);
+    gerador->posicao++;
 
-        printf("Cor do Exercito Dominante (Ex: Vermelho, Azul, Verde): ");
-        if (fgets(mapa[i].cor, MAX_COR, stdin) == NULL) return;
-        mapa[i].cor[strcspn(mapa[i].cor, "\n")] = '\0';
-        
-        // 🚨 NOVO: Garante que a cor seja armazenada em MAIÚSCULAS
-        toUpperString(mapa[i].cor);
-        
-        printf("Numero de Tropas: ");
-        if (scanf("%d", &mapa[i].tropas) != 1 || mapa[i].tropas <= 0) {
-             printf("Tropas invalidas. Definindo para 1.\n");
-             mapa[i].tropas = 1;
+    return resultado;
+}
+
+/**
+ * @brief Converte 32 bits aleatórios em um valor sem viés em [0, limite).
+ * @note Método da multiplicação de Lemire: só sorteia de novo quando o valor cai
+ *       na faixa que causaria viés, o que é raríssimo para limites pequenos.
+ */
+static inline uint32_t limitarSemVies(GeradorAleatorio* gerador, uint32_t x, uint32_t limite) {
+    uint64_t m = (uint64_t)x * limite;
+    uint32_t baixo = (uint32_t)m;
+
+    if (baixo < limite) {
+        uint32_t corte = (uint32_t)(-limite) % limite;
+        while (baixo < corte) {
+            x = (uint32_t)(proximoAleatorio(gerador) >> 32);
+            m = (uint64_t)x * limite;
+            baixo = (uint32_t)m;
         }
-        limparBufferEntrada(); 
     }
+    return (uint32_t)(m >> 32);
 }
 
-void exibirMapa(const Territorio* mapa, int tamanho) {
-    printf("\n\n=======================================================\n");
-    printf("               ESTADO ATUAL DO MAPA\n");
-    printf("=======================================================\n");
+/**
+ * @brief Sorteia um inteiro sem viés em [0, limite).
+ */
+uint32_t sortearLimitado(GeradorAleatorio* gerador, uint32_t limite) {
+    return limitarSemVies(gerador, (uint32_t)(proximoAleatorio(gerador) >> 32), limite);
+}
 
-    printf("| %-3s | %-20s | %-10s | %-10s |\n", "ID", "Territorio", "Exercito", "Tropas");
-    printf("|-----|----------------------|------------|------------|\n");
+/**
+ * @brief Rola um dado de 6 faces (1 a 6).
+ * @return O resultado da rolagem.
+ */
+int rolarDado(GeradorAleatorio* gerador) {
+    return (int)sortearLimitado(gerador, 6) + 1;
+}
 
-    for (int i = 0; i < tamanho; i++) {
-        printf("| %-3d | %-20s | %-10s | %-10d |\n", 
-               i + 1,
-               mapa[i].nome, 
-               mapa[i].cor, 
-               mapa[i].tropas);
+/**
+ * @brief Preenche um buffer com rolagens de dado (1 a 6) em uma única chamada.
+ * @note Cada saída de 64 bits do gerador produz dois dados.
+ */
+void rolarVariosDados(GeradorAleatorio* gerador, unsigned char* destino, size_t quantidade) {
+    size_t i = 0;
+
+    for (; i + 1 < quantidade; i += 2) {
+        uint64_t x = proximoAleatorio(gerador);
+        destino[i] = (unsigned char)(limitarSemVies(gerador, (uint32_t)(x >> 32), 6) + 1);
+        destino[i + 1] = (unsigned char)(limitarSemVies(gerador, (uint32_t)x, 6) + 1);
+    }
+    if (i < quantidade) {
+        destino[i] = (unsigned char)rolarDado(gerador);
     }
-    printf("|-----|----------------------|------------|------------|\n");
 }
 
 // ============================================================================
-// --- Implementação das Funções de Lógica do Jogo (Ataque) ---
+// --- Implementação da Função Utilitária ---
 // ============================================================================
 
-int rolarDado(void) {
-    return (rand() % 6) + 1;
-}
-
 /**
- * @brief Gerencia a interface de ataque e valida as escolhas do jogador.
- * @note A cor do territorio atacante foi convertida para MAIÚSCULAS no cadastro.
+ * @brief Linha corrente dos prompts interativos: lida com fgets() e consumida pelos
+ *        leitores abaixo, sem scanf() nem getchar() a cada caractere.
  */
-void faseDeAtaque(Territorio* mapa, int tamanho, const char* cor_jogador) {
-    int id_atacante, id_defensor;
-    
-    printf("\n--- FASE DE ATAQUE ---\n");
-    printf("Digite o ID do Territorio Atacante (1 a %d): ", tamanho);
-    if (scanf("%d", &id_atacante) != 1 || id_atacante < 1 || id_atacante > tamanho) {
-        printf("Erro: ID de atacante invalido.\n");
-        limparBufferEntrada();
-        return;
-    }
-
-    printf("Digite o ID do Territorio Defensor (1 a %d): ", tamanho);
-    if (scanf("%d", &id_defensor) != 1 || id_defensor < 1 || id_defensor > tamanho) {
-        printf("Erro: ID de defensor invalido.\n");
-        limparBufferEntrada();
-        return;
-    }
-    limparBufferEntrada();
+typedef struct {
+    char texto[TAMANHO_LINHA_TECLADO];
+    size_t cursor;
+    size_t tamanho;
+    int completa; // O trecho lido vai até o fim da linha ('\n' ou fim da entrada)
+} LinhaTeclado;
 
-    int i_atacante = id_atacante - 1;
-    int i_defensor = id_defensor - 1;
+static LinhaTeclado linha_teclado;
 
-    // --- Validacoes ---
-    if (i_atacante == i_defensor) {
-        printf("Ataque cancelado: Nao e possivel atacar o proprio territorio.\n");
-        return;
-    }
-    // A comparação é segura, pois mapa[i_atacante].cor é MAIÚSCULA
-    if (strcmp(mapa[i_atacante].cor, cor_jogador) != 0) {
-        printf("Ataque cancelado: Voce so pode atacar de seus proprios territorios (%s).\n", cor_jogador);
-        return;
-    }
-    if (mapa[i_atacante].tropas <= 1) {
-        printf("Ataque cancelado: O atacante precisa de no minimo 2 tropas.\n");
-        return;
-    }
-    // A comparação é segura
-    if (strcmp(mapa[i_atacante].cor, mapa[i_defensor].cor) == 0) {
-        printf("Ataque cancelado: Nao e possivel atacar um territorio do mesmo exercito.\n");
-        return;
-    }
-    
-    atacar(&mapa[i_atacante], &mapa[i_defensor]);
+static int carregarLinhaTeclado(void) {
+    LinhaTeclado* linha = &linha_teclado;
+    linha->cursor = linha->tamanho = 0;
+    linha->completa = 1;
+    if (fgets(linha->texto, sizeof(linha->texto), stdin) == NULL) return 0;
+    linha->tamanho = strlen(linha->texto);
+    linha->completa = (linha->tamanho > 0 && linha->texto[linha->tamanho - 1] == '\n') || feof(stdin);
+    return 1;
 }
 
-void atacar(Territorio* atacante, Territorio* defensor) {
-    int dado_a = rolarDado();
-    int dado_d = rolarDado();
-    
-    printf("\n--- RESULTADO DA BATALHA ---\n");
-    printf("Batalha: %s (%s) vs %s (%s)\n", atacante->nome, atacante->cor, defensor->nome, defensor->cor);
-    printf("Dados Sorteados: Atacante (%d) contra Defensor (%d)\n", dado_a, dado_d);
-           
-    if (dado_a > dado_d) {
-        printf("O Atacante %s VENCEU a rodada.\n", atacante->nome);
-        
-        if (defensor->tropas > 0) {
-            int tropas_perdidas = (defensor->tropas + 1) / 2;
-            defensor->tropas -= tropas_perdidas;
-            printf("Defensor perde %d tropas. Tropas restantes: %d\n", tropas_perdidas, defensor->tropas);
-        }
-
-        if (defensor->tropas <= 0) {
-            printf("\nTERRITORIO CONQUISTADO! %s agora pertence ao exercito %s.\n",
-                   defensor->nome, atacante->cor);
-                   
-            // Altera o dono. Como atacante->cor está em MAIÚSCULAS, o novo dono também estará.
-            strcpy(defensor->cor, atacante->cor);
-            atacante->tropas -= 1;
-            defensor->tropas = 1; 
-            
-            printf("Uma tropa de %s move-se para %s.\n", atacante->nome, defensor->nome);
-        }
-        
-    } else {
-        printf("O Defensor %s RESISTIU. Atacante perde 1 tropa.\n", defensor->nome);
-        atacante->tropas -= 1;
-        printf("Atacante perde 1 tropa. Tropas restantes em %s: %d\n", atacante->nome, atacante->tropas);
+/**
+ * @brief Lê o próximo inteiro digitado, pulando espaços e linhas em branco como scanf("%d").
+ * @note O resto da linha fica para o próximo leitor ou para limparBufferEntrada(), então
+ *       atacante e defensor podem vir na mesma linha ou em linhas separadas.
+ * @return 1 se leu um inteiro que cabe em int, 0 no fim da entrada ou se o texto não é número.
+ */
+int lerInteiroDoTeclado(int* valor) {
+    LinhaTeclado* linha = &linha_teclado;
+    for (;;) {
+        while (linha->cursor < linha->tamanho && isspace((unsigned char)linha->texto[linha->cursor])) linha->cursor++;
+        if (linha->cursor < linha->tamanho) break;
+        if (!carregarLinhaTeclado()) return 0;
     }
-    
-    printf("\nPressione ENTER para continuar...");
-    getchar(); 
+    const char* p = linha->texto + linha->cursor;
+    long lido;
+    if (!lerInteiro(&p, linha->texto + linha->tamanho, &lido) || lido > INT_MAX || lido < INT_MIN) return 0;
+    linha->cursor = (size_t)(p - linha->texto);
+    *valor = (int)lido;
+    return 1;
 }
 
-// ============================================================================
-// --- Implementação da Função Utilitária ---
-// ============================================================================
+/**
+ * @brief Lê o resto da linha corrente (ou a próxima linha) sem o '\n', truncado em
+ *        'tamanho' - 1 caracteres; o que passar disso é descartado com a linha.
+ * @return 0 no fim da entrada.
+ */
+int lerLinhaDoTeclado(char* destino, size_t tamanho) {
+    LinhaTeclado* linha = &linha_teclado;
+    if (linha->cursor >= linha->tamanho && !carregarLinhaTeclado()) return 0;
+    const char* inicio = linha->texto + linha->cursor;
+    size_t n = strcspn(inicio, "\n");
+    if (n > tamanho - 1) n = tamanho - 1;
+    memcpy(destino, inicio, n);
+    destino[n] = '\0';
+    limparBufferEntrada();
+    return 1;
+}
 
+/**
+ * @brief Descarta o resto da linha corrente; sem linha pendente, descarta a próxima
+ *        (é assim que se espera o ENTER).
+ */
 void limparBufferEntrada(void) {
-    int c;
-    while ((c = getchar()) != '\n' && c != EOF) {}
+    LinhaTeclado* linha = &linha_teclado;
+    if (linha->tamanho == 0 && !carregarLinhaTeclado()) return;
+    while (!linha->completa && carregarLinhaTeclado()) {}
+    linha->cursor = linha->tamanho = 0;
 }
\ No newline at end of file